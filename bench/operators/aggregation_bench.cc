@@ -0,0 +1,213 @@
+#include <benchmark/benchmark.h>
+#include <algorithm>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+#include "operators/operators.h"
+
+namespace {
+
+using buzzdb::operators::Batch;
+using buzzdb::operators::HashAggregation;
+using buzzdb::operators::Operator;
+using buzzdb::operators::Register;
+
+constexpr size_t NUM_TUPLES = 1 << 22;
+
+/// Produces `num_tuples` tuples of a group key and a value in batches. The
+/// keys are `i * 7919 % num_groups`, so all groups are equally large. If
+/// `sorted` is set, the keys are `i * num_groups / num_tuples` instead, so
+/// the tuples of every group are adjacent.
+class GroupSource : public Operator {
+ private:
+  size_t num_tuples;
+  uint64_t num_groups;
+  bool sorted;
+  size_t current_index = 0;
+  std::vector<Register> output_regs;
+  std::vector<Register*> output;
+
+ public:
+  GroupSource(size_t num_tuples, uint64_t num_groups, bool sorted = false)
+      : num_tuples(num_tuples), num_groups(num_groups), sorted(sorted) {}
+
+  int64_t key(size_t index) const {
+    return static_cast<int64_t>(sorted ? index * num_groups / num_tuples
+                                       : index * 7919 % num_groups);
+  }
+
+  void open() override {
+    output_regs.resize(2);
+    output = {&output_regs[0], &output_regs[1]};
+    current_index = 0;
+  }
+
+  bool next() override {
+    if (current_index == num_tuples) return false;
+    output_regs[0] = Register::from_int(key(current_index));
+    output_regs[1] = Register::from_int(static_cast<int64_t>(current_index));
+    ++current_index;
+    return true;
+  }
+
+  bool next_batch(Batch& batch) override {
+    batch.reset(2);
+    while (current_index < num_tuples && !batch.full()) {
+      size_t row = batch.append_row();
+      batch.column(0)[row] = Register::from_int(key(current_index));
+      batch.column(1)[row] =
+          Register::from_int(static_cast<int64_t>(current_index));
+      ++current_index;
+    }
+    return batch.size() > 0;
+  }
+
+  void close() override {}
+
+  const std::vector<Register*>& get_output() override { return output; }
+};
+
+/// Computes SUM, COUNT, MIN and MAX per group. The first argument is the
+/// number of groups, the second one selects the interface: 0 = `next()`,
+/// 1 = `next_batch()`.
+void BM_HashAggregation(benchmark::State& state) {
+  using AggrFunc = HashAggregation::AggrFunc;
+  for (auto _ : state) {
+    GroupSource source{NUM_TUPLES, static_cast<uint64_t>(state.range(0))};
+    HashAggregation aggregation{source,
+                                {0},
+                                {AggrFunc{AggrFunc::SUM, 1},
+                                 AggrFunc{AggrFunc::COUNT, 1},
+                                 AggrFunc{AggrFunc::MIN, 1},
+                                 AggrFunc{AggrFunc::MAX, 1}}};
+
+    size_t count = 0;
+    aggregation.open();
+    if (state.range(1)) {
+      Batch batch;
+      while (aggregation.next_batch(batch)) count += batch.size();
+    } else {
+      while (aggregation.next()) ++count;
+    }
+    aggregation.close();
+    benchmark::DoNotOptimize(count);
+  }
+  state.SetItemsProcessed(state.iterations() * NUM_TUPLES);
+}
+
+BENCHMARK(BM_HashAggregation)
+    ->ArgsProduct({{16, 1 << 20}, {0, 1}})
+    ->Unit(benchmark::kMillisecond);
+
+/// Aggregates like `BM_HashAggregation` through `next_batch()`. The first
+/// argument is the number of groups, the second one the number of threads.
+void BM_HashAggregationParallel(benchmark::State& state) {
+  using AggrFunc = HashAggregation::AggrFunc;
+  for (auto _ : state) {
+    GroupSource source{NUM_TUPLES, static_cast<uint64_t>(state.range(0))};
+    HashAggregation::Options options;
+    options.num_threads = static_cast<size_t>(state.range(1));
+    HashAggregation aggregation{source,
+                                {0},
+                                {AggrFunc{AggrFunc::SUM, 1},
+                                 AggrFunc{AggrFunc::COUNT, 1},
+                                 AggrFunc{AggrFunc::MIN, 1},
+                                 AggrFunc{AggrFunc::MAX, 1}},
+                                options};
+
+    size_t count = 0;
+    aggregation.open();
+    Batch batch;
+    while (aggregation.next_batch(batch)) count += batch.size();
+    aggregation.close();
+    benchmark::DoNotOptimize(count);
+  }
+  state.SetItemsProcessed(state.iterations() * NUM_TUPLES);
+}
+
+/// Scales from one thread to all hardware threads for few and many groups.
+void GroupsAndThreadCounts(benchmark::internal::Benchmark* benchmark) {
+  int64_t max_threads = std::max(1u, std::thread::hardware_concurrency());
+  for (int64_t groups : {16, 1 << 20}) {
+    for (int64_t threads = 1; threads < max_threads; threads *= 2)
+      benchmark->Args({groups, threads});
+    benchmark->Args({groups, max_threads});
+  }
+}
+
+BENCHMARK(BM_HashAggregationParallel)
+    ->Apply(GroupsAndThreadCounts)
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
+
+/// Aggregates 2^20 groups through `next_batch()` with a memory budget of
+/// the argument in MiB, so the groups are spilled unless the budget is
+/// large enough.
+void BM_HashAggregationSpill(benchmark::State& state) {
+  using AggrFunc = HashAggregation::AggrFunc;
+  for (auto _ : state) {
+    GroupSource source{NUM_TUPLES, 1 << 20};
+    HashAggregation::Options options;
+    options.memory_budget = static_cast<size_t>(state.range(0)) << 20;
+    HashAggregation aggregation{source,
+                                {0},
+                                {AggrFunc{AggrFunc::SUM, 1},
+                                 AggrFunc{AggrFunc::COUNT, 1},
+                                 AggrFunc{AggrFunc::MIN, 1},
+                                 AggrFunc{AggrFunc::MAX, 1}},
+                                options};
+
+    size_t count = 0;
+    aggregation.open();
+    Batch batch;
+    while (aggregation.next_batch(batch)) count += batch.size();
+    aggregation.close();
+    benchmark::DoNotOptimize(count);
+    state.counters["spilled_bytes"] =
+        static_cast<double>(aggregation.get_statistics().spilled_bytes);
+  }
+  state.SetItemsProcessed(state.iterations() * NUM_TUPLES);
+}
+
+BENCHMARK(BM_HashAggregationSpill)
+    ->Arg(1)
+    ->Arg(16)
+    ->Arg(1024)
+    ->Unit(benchmark::kMillisecond);
+
+/// Computes SUM, COUNT, MIN and MAX per group of sorted input. The first
+/// argument is the number of groups, the second one selects the mode:
+/// 0 = hash table, 1 = `Options::ordered_input`.
+void BM_HashAggregationOrdered(benchmark::State& state) {
+  using AggrFunc = HashAggregation::AggrFunc;
+  for (auto _ : state) {
+    GroupSource source{NUM_TUPLES, static_cast<uint64_t>(state.range(0)),
+                       true};
+    HashAggregation::Options options;
+    options.ordered_input = state.range(1) != 0;
+    HashAggregation aggregation{source,
+                                {0},
+                                {AggrFunc{AggrFunc::SUM, 1},
+                                 AggrFunc{AggrFunc::COUNT, 1},
+                                 AggrFunc{AggrFunc::MIN, 1},
+                                 AggrFunc{AggrFunc::MAX, 1}},
+                                options};
+
+    size_t count = 0;
+    aggregation.open();
+    Batch batch;
+    while (aggregation.next_batch(batch)) count += batch.size();
+    aggregation.close();
+    benchmark::DoNotOptimize(count);
+  }
+  state.SetItemsProcessed(state.iterations() * NUM_TUPLES);
+}
+
+BENCHMARK(BM_HashAggregationOrdered)
+    ->ArgsProduct({{16, 1 << 20}, {0, 1}})
+    ->Unit(benchmark::kMillisecond);
+
+}  // namespace
+
+BENCHMARK_MAIN();
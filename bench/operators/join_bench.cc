@@ -0,0 +1,155 @@
+#include <benchmark/benchmark.h>
+#include <algorithm>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+#include "operators/operators.h"
+
+namespace {
+
+using buzzdb::operators::Batch;
+using buzzdb::operators::HashJoin;
+using buzzdb::operators::Operator;
+using buzzdb::operators::Register;
+using buzzdb::operators::RuntimeFilter;
+
+constexpr size_t NUM_BUILD_TUPLES = 1 << 20;
+constexpr size_t NUM_PROBE_TUPLES = 1 << 22;
+
+/// Produces `num_tuples` tuples of a key and a payload in batches. Keys are
+/// `i * step % modulus`, so every key in `[0, modulus)` occurs equally often
+/// when `step` and `modulus` are coprime.
+class KeySource : public Operator {
+ private:
+  size_t num_tuples;
+  uint64_t step, modulus;
+  size_t current_index = 0;
+  std::vector<Register> output_regs;
+  std::vector<Register*> output;
+
+ public:
+  KeySource(size_t num_tuples, uint64_t step, uint64_t modulus)
+      : num_tuples(num_tuples), step(step), modulus(modulus) {}
+
+  void open() override {
+    output_regs.resize(2);
+    output = {&output_regs[0], &output_regs[1]};
+    current_index = 0;
+  }
+
+  bool next() override {
+    if (current_index == num_tuples) return false;
+    output_regs[0] = Register::from_int(
+        static_cast<int64_t>(current_index * step % modulus));
+    output_regs[1] = Register::from_int(static_cast<int64_t>(current_index));
+    ++current_index;
+    return true;
+  }
+
+  bool next_batch(Batch& batch) override {
+    batch.reset(2);
+    while (current_index < num_tuples && !batch.full()) {
+      size_t row = batch.append_row();
+      batch.column(0)[row] = Register::from_int(
+          static_cast<int64_t>(current_index * step % modulus));
+      batch.column(1)[row] =
+          Register::from_int(static_cast<int64_t>(current_index));
+      ++current_index;
+    }
+    return batch.size() > 0;
+  }
+
+  void close() override {}
+
+  const std::vector<Register*>& get_output() override { return output; }
+};
+
+/// Joins unique build keys with probe keys of which half match. The
+/// argument selects the interface: 0 = `next()`, 1 = `next_batch()`.
+void BM_HashJoin(benchmark::State& state) {
+  for (auto _ : state) {
+    KeySource build{NUM_BUILD_TUPLES, 7919, NUM_BUILD_TUPLES};
+    KeySource probe{NUM_PROBE_TUPLES, 104729, 2 * NUM_BUILD_TUPLES};
+    HashJoin join{build, probe, 0, 0};
+
+    size_t count = 0;
+    join.open();
+    if (state.range(0)) {
+      Batch batch;
+      while (join.next_batch(batch)) count += batch.size();
+    } else {
+      while (join.next()) ++count;
+    }
+    join.close();
+    benchmark::DoNotOptimize(count);
+  }
+  state.SetItemsProcessed(state.iterations() *
+                          (NUM_BUILD_TUPLES + NUM_PROBE_TUPLES));
+}
+
+BENCHMARK(BM_HashJoin)->Arg(0)->Arg(1)->Unit(benchmark::kMillisecond);
+
+/// Joins a small left input with keys spread over the whole key range, so
+/// few right tuples match. The argument enables the runtime filter.
+void BM_HashJoinRuntimeFilter(benchmark::State& state) {
+  for (auto _ : state) {
+    KeySource build{NUM_BUILD_TUPLES / 64, 7919, 2 * NUM_BUILD_TUPLES};
+    KeySource probe{NUM_PROBE_TUPLES, 104729, 2 * NUM_BUILD_TUPLES};
+    RuntimeFilter filter{probe, 0};
+    HashJoin join{build, filter, 0, 0};
+    if (state.range(0)) join.add_runtime_filter(filter);
+
+    size_t count = 0;
+    join.open();
+    Batch batch;
+    while (join.next_batch(batch)) count += batch.size();
+    join.close();
+    state.counters["pruned"] = filter.get_statistics().get_pruning_ratio();
+    benchmark::DoNotOptimize(count);
+  }
+  state.SetItemsProcessed(state.iterations() * NUM_PROBE_TUPLES);
+}
+
+BENCHMARK(BM_HashJoinRuntimeFilter)
+    ->Arg(0)
+    ->Arg(1)
+    ->Unit(benchmark::kMillisecond);
+
+/// Joins like `BM_HashJoin` through `next_batch()` with the number of
+/// threads given by the argument.
+void BM_HashJoinParallel(benchmark::State& state) {
+  for (auto _ : state) {
+    KeySource build{NUM_BUILD_TUPLES, 7919, NUM_BUILD_TUPLES};
+    KeySource probe{NUM_PROBE_TUPLES, 104729, 2 * NUM_BUILD_TUPLES};
+    HashJoin::Options options;
+    options.num_threads = static_cast<size_t>(state.range(0));
+    HashJoin join{build, probe, 0, 0, options};
+
+    size_t count = 0;
+    join.open();
+    Batch batch;
+    while (join.next_batch(batch)) count += batch.size();
+    join.close();
+    benchmark::DoNotOptimize(count);
+  }
+  state.SetItemsProcessed(state.iterations() *
+                          (NUM_BUILD_TUPLES + NUM_PROBE_TUPLES));
+}
+
+/// Scales from one thread to all hardware threads.
+void ThreadCounts(benchmark::internal::Benchmark* benchmark) {
+  size_t max_threads = std::max(1u, std::thread::hardware_concurrency());
+  for (size_t threads = 1; threads < max_threads; threads *= 2)
+    benchmark->Arg(static_cast<int64_t>(threads));
+  benchmark->Arg(static_cast<int64_t>(max_threads));
+}
+
+BENCHMARK(BM_HashJoinParallel)
+    ->Apply(ThreadCounts)
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
+
+}  // namespace
+
+BENCHMARK_MAIN();
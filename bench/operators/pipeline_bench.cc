@@ -0,0 +1,90 @@
+#include <benchmark/benchmark.h>
+#include <cstdint>
+#include <vector>
+
+#include "operators/operators.h"
+
+namespace {
+
+using buzzdb::operators::Batch;
+using buzzdb::operators::Operator;
+using buzzdb::operators::Projection;
+using buzzdb::operators::Register;
+using buzzdb::operators::Select;
+
+constexpr size_t NUM_TUPLES = 1 << 20;
+constexpr size_t NUM_ATTRIBUTES = 4;
+
+/// Produces `NUM_TUPLES` integer tuples, either one at a time or natively in
+/// batches.
+class RangeSource : public Operator {
+ private:
+  size_t current_index = 0;
+  std::vector<Register> output_regs;
+  std::vector<Register*> output;
+
+ public:
+  void open() override {
+    output_regs.resize(NUM_ATTRIBUTES);
+    for (auto& reg : output_regs) output.push_back(&reg);
+    current_index = 0;
+  }
+
+  bool next() override {
+    if (current_index == NUM_TUPLES) return false;
+    for (size_t attr = 0; attr < NUM_ATTRIBUTES; ++attr)
+      output_regs[attr] =
+          Register::from_int(static_cast<int64_t>(current_index + attr));
+    ++current_index;
+    return true;
+  }
+
+  bool next_batch(Batch& batch) override {
+    batch.reset(NUM_ATTRIBUTES);
+    while (current_index < NUM_TUPLES && !batch.full()) {
+      size_t row = batch.append_row();
+      for (size_t attr = 0; attr < NUM_ATTRIBUTES; ++attr)
+        batch.column(attr)[row] =
+            Register::from_int(static_cast<int64_t>(current_index + attr));
+      ++current_index;
+    }
+    return batch.size() > 0;
+  }
+
+  void close() override {}
+
+  const std::vector<Register*>& get_output() override { return output; }
+};
+
+/// Filters half of the tuples and projects two attributes. The argument
+/// selects the interface: 0 = `next()`, 1 = `next_batch()`.
+void BM_FilterProject(benchmark::State& state) {
+  for (auto _ : state) {
+    RangeSource source;
+    Select select{source,
+                  Select::PredicateAttributeInt64{
+                      0, NUM_TUPLES / 2, Select::PredicateType::LT}};
+    Projection projection{select, {3, 1}};
+
+    size_t count = 0;
+    projection.open();
+    if (state.range(0)) {
+      Batch batch;
+      while (projection.next_batch(batch)) count += batch.size();
+    } else {
+      while (projection.next()) {
+        benchmark::DoNotOptimize(projection.get_output());
+        ++count;
+      }
+    }
+    projection.close();
+    benchmark::DoNotOptimize(count);
+  }
+  state.SetItemsProcessed(state.iterations() * NUM_TUPLES);
+}
+
+BENCHMARK(BM_FilterProject)->Arg(0)->Arg(1)->Unit(benchmark::kMillisecond);
+
+}  // namespace
+
+BENCHMARK_MAIN();
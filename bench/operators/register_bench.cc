@@ -0,0 +1,117 @@
+#include <benchmark/benchmark.h>
+#include <cstdint>
+#include <experimental/optional>
+#include <functional>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "operators/operators.h"
+
+namespace {
+
+using buzzdb::operators::Register;
+
+/// The register layout before it was made fixed width. Kept here so that the
+/// cost of copying, hashing and comparing tuples can be compared.
+class LegacyRegister {
+ public:
+  static LegacyRegister from_int(int64_t value) {
+    LegacyRegister r{};
+    r.intVal = value;
+    return r;
+  }
+
+  static LegacyRegister from_string(const std::string& value) {
+    LegacyRegister r{};
+    r.strVal = value;
+    return r;
+  }
+
+  bool is_int() const { return static_cast<bool>(this->intVal); }
+
+  uint64_t get_hash() const {
+    if (this->is_int()) return std::hash<int64_t>{}(*this->intVal);
+    return std::hash<std::string>{}(*this->strVal);
+  }
+
+  friend bool operator<(const LegacyRegister& r1, const LegacyRegister& r2) {
+    return r1.is_int() ? *r1.intVal < *r2.intVal
+                       : r1.strVal->compare(*r2.strVal) < 0;
+  }
+
+ private:
+  std::experimental::optional<int64_t> intVal;
+  std::experimental::optional<std::string> strVal;
+};
+
+constexpr size_t NUM_REGISTERS = 1 << 16;
+
+std::string random_string(std::mt19937_64& rng) {
+  std::string value(16, ' ');
+  for (auto& c : value) c = static_cast<char>('a' + rng() % 26);
+  return value;
+}
+
+template <typename R>
+std::vector<R> make_registers(bool strings) {
+  std::mt19937_64 rng{42};
+  std::vector<R> registers;
+  registers.reserve(NUM_REGISTERS);
+  for (size_t i = 0; i < NUM_REGISTERS; ++i) {
+    if (strings)
+      registers.push_back(R::from_string(random_string(rng)));
+    else
+      registers.push_back(R::from_int(static_cast<int64_t>(rng())));
+  }
+  return registers;
+}
+
+template <typename R>
+void BM_Copy(benchmark::State& state) {
+  auto registers = make_registers<R>(state.range(0));
+  std::vector<R> copy;
+  copy.reserve(registers.size());
+  for (auto _ : state) {
+    copy.assign(registers.begin(), registers.end());
+    benchmark::DoNotOptimize(copy.data());
+    benchmark::ClobberMemory();
+  }
+  state.SetItemsProcessed(state.iterations() * registers.size());
+  state.SetBytesProcessed(state.iterations() * registers.size() * sizeof(R));
+}
+
+template <typename R>
+void BM_Hash(benchmark::State& state) {
+  auto registers = make_registers<R>(state.range(0));
+  for (auto _ : state) {
+    uint64_t sum = 0;
+    for (const auto& reg : registers) sum += reg.get_hash();
+    benchmark::DoNotOptimize(sum);
+  }
+  state.SetItemsProcessed(state.iterations() * registers.size());
+}
+
+template <typename R>
+void BM_Compare(benchmark::State& state) {
+  auto registers = make_registers<R>(state.range(0));
+  for (auto _ : state) {
+    size_t count = 0;
+    for (size_t i = 1; i < registers.size(); ++i)
+      count += registers[i - 1] < registers[i];
+    benchmark::DoNotOptimize(count);
+  }
+  state.SetItemsProcessed(state.iterations() * (registers.size() - 1));
+}
+
+// The argument selects the register type: 0 = INT64, 1 = CHAR16.
+BENCHMARK_TEMPLATE(BM_Copy, LegacyRegister)->Arg(0)->Arg(1);
+BENCHMARK_TEMPLATE(BM_Copy, Register)->Arg(0)->Arg(1);
+BENCHMARK_TEMPLATE(BM_Hash, LegacyRegister)->Arg(0)->Arg(1);
+BENCHMARK_TEMPLATE(BM_Hash, Register)->Arg(0)->Arg(1);
+BENCHMARK_TEMPLATE(BM_Compare, LegacyRegister)->Arg(0)->Arg(1);
+BENCHMARK_TEMPLATE(BM_Compare, Register)->Arg(0)->Arg(1);
+
+}  // namespace
+
+BENCHMARK_MAIN();
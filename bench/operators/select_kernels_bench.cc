@@ -0,0 +1,74 @@
+#include <benchmark/benchmark.h>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include "operators/operators.h"
+#include "operators/select_kernels.h"
+
+namespace {
+
+using buzzdb::operators::Batch;
+using buzzdb::operators::Register;
+using buzzdb::operators::Select;
+using buzzdb::operators::kernels::detect_instruction_set;
+using buzzdb::operators::kernels::InstructionSet;
+using buzzdb::operators::kernels::select_char16;
+using buzzdb::operators::kernels::select_int64;
+
+/// The argument selects the instruction set: 0 = scalar, 1 = SSE4.2,
+/// 2 = AVX2.
+bool skip_unsupported(benchmark::State& state) {
+  if (state.range(0) > static_cast<int64_t>(detect_instruction_set())) {
+    state.SkipWithError("instruction set not supported");
+    return true;
+  }
+  return false;
+}
+
+void BM_SelectInt64(benchmark::State& state) {
+  if (skip_unsupported(state)) return;
+  auto isa = static_cast<InstructionSet>(state.range(0));
+  std::mt19937_64 rng{42};
+  std::vector<int64_t> values(Batch::CAPACITY);
+  for (auto& value : values) value = static_cast<int64_t>(rng() % 1000);
+  std::vector<uint16_t> selection(Batch::CAPACITY);
+
+  for (auto _ : state) {
+    size_t count =
+        select_int64(isa, Select::PredicateType::LT, values.data(),
+                     values.size(), 500, nullptr, selection.data());
+    benchmark::DoNotOptimize(count);
+  }
+  state.SetItemsProcessed(state.iterations() * values.size());
+}
+
+void BM_SelectChar16(benchmark::State& state) {
+  if (skip_unsupported(state)) return;
+  auto isa = static_cast<InstructionSet>(state.range(0));
+  std::mt19937_64 rng{42};
+  std::vector<Register> registers;
+  for (size_t i = 0; i < Batch::CAPACITY; ++i) {
+    std::string value(16, 'a');
+    value[rng() % 16] = static_cast<char>('a' + rng() % 26);
+    registers.push_back(Register::from_string(value));
+  }
+  auto constant = Register::from_string("aaaaaaaammmmmmmm");
+  std::vector<uint16_t> selection(Batch::CAPACITY);
+
+  for (auto _ : state) {
+    size_t count = select_char16(
+        isa, Select::PredicateType::LT, registers[0].payload_data(),
+        sizeof(Register), registers.size(), constant.payload_data(), nullptr,
+        selection.data());
+    benchmark::DoNotOptimize(count);
+  }
+  state.SetItemsProcessed(state.iterations() * registers.size());
+}
+
+BENCHMARK(BM_SelectInt64)->DenseRange(0, 2);
+BENCHMARK(BM_SelectChar16)->DenseRange(0, 2);
+
+}  // namespace
+
+BENCHMARK_MAIN();
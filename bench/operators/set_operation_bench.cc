@@ -0,0 +1,145 @@
+#include <benchmark/benchmark.h>
+#include <cstdint>
+#include <vector>
+
+#include "operators/operators.h"
+
+namespace {
+
+using buzzdb::operators::Batch;
+using buzzdb::operators::ExceptAll;
+using buzzdb::operators::Intersect;
+using buzzdb::operators::Operator;
+using buzzdb::operators::Register;
+using buzzdb::operators::Union;
+using buzzdb::operators::UnionAll;
+
+constexpr size_t NUM_TUPLES = 1 << 20;
+
+/// Produces `num_tuples` tuples of two attributes in batches. The tuples
+/// are `(k, k % 7)` with `k = offset + i * 7919 % num_distinct`, so every
+/// distinct tuple occurs equally often. If `sorted` is set, `k` is
+/// `offset + i * num_distinct / num_tuples` instead, so the tuples are
+/// sorted.
+class TupleSource : public Operator {
+ private:
+  size_t num_tuples;
+  uint64_t num_distinct;
+  uint64_t offset;
+  bool sorted;
+  size_t current_index = 0;
+  std::vector<Register> output_regs;
+  std::vector<Register*> output;
+
+  int64_t key(size_t index) const {
+    return static_cast<int64_t>(
+        offset + (sorted ? index * num_distinct / num_tuples
+                         : index * 7919 % num_distinct));
+  }
+
+ public:
+  TupleSource(size_t num_tuples, uint64_t num_distinct, uint64_t offset,
+              bool sorted = false)
+      : num_tuples(num_tuples),
+        num_distinct(num_distinct),
+        offset(offset),
+        sorted(sorted) {}
+
+  void open() override {
+    output_regs.resize(2);
+    output = {&output_regs[0], &output_regs[1]};
+    current_index = 0;
+  }
+
+  bool next() override {
+    if (current_index == num_tuples) return false;
+    int64_t k = key(current_index++);
+    output_regs[0] = Register::from_int(k);
+    output_regs[1] = Register::from_int(k % 7);
+    return true;
+  }
+
+  bool next_batch(Batch& batch) override {
+    batch.reset(2);
+    while (current_index < num_tuples && !batch.full()) {
+      size_t row = batch.append_row();
+      int64_t k = key(current_index++);
+      batch.column(0)[row] = Register::from_int(k);
+      batch.column(1)[row] = Register::from_int(k % 7);
+    }
+    return batch.size() > 0;
+  }
+
+  void close() override {}
+
+  const std::vector<Register*>& get_output() override { return output; }
+};
+
+/// Runs the set operator on two inputs whose distinct tuples overlap by
+/// half. The first argument is the number of distinct tuples per input, the
+/// second one selects sorted inputs, which are merged.
+template <typename SetOperator>
+void BM_SetOperation(benchmark::State& state) {
+  const auto num_distinct = static_cast<uint64_t>(state.range(0));
+  const bool sorted = state.range(1) != 0;
+  for (auto _ : state) {
+    TupleSource left{NUM_TUPLES, num_distinct, 0, sorted};
+    TupleSource right{NUM_TUPLES, num_distinct, num_distinct / 2, sorted};
+    typename SetOperator::Options options;
+    options.sorted_inputs = sorted;
+    SetOperator set_operator{left, right, options};
+
+    size_t count = 0;
+    set_operator.open();
+    Batch batch;
+    while (set_operator.next_batch(batch)) count += batch.size();
+    set_operator.close();
+    benchmark::DoNotOptimize(count);
+  }
+  state.SetItemsProcessed(state.iterations() * 2 * NUM_TUPLES);
+}
+
+BENCHMARK_TEMPLATE(BM_SetOperation, Union)
+    ->ArgsProduct({{1 << 10, 1 << 20}, {0, 1}})
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(BM_SetOperation, UnionAll)
+    ->ArgsProduct({{1 << 10, 1 << 20}, {0, 1}})
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(BM_SetOperation, Intersect)
+    ->ArgsProduct({{1 << 10, 1 << 20}, {0, 1}})
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(BM_SetOperation, ExceptAll)
+    ->ArgsProduct({{1 << 10, 1 << 20}, {0, 1}})
+    ->Unit(benchmark::kMillisecond);
+
+/// Reads four inputs with UnionAll. The argument is the number of threads.
+void BM_UnionAllParallel(benchmark::State& state) {
+  for (auto _ : state) {
+    std::vector<TupleSource> sources;
+    for (uint64_t i = 0; i < 4; ++i)
+      sources.emplace_back(NUM_TUPLES, NUM_TUPLES, i);
+    std::vector<Operator*> inputs;
+    for (TupleSource& source : sources) inputs.push_back(&source);
+    UnionAll union_all{inputs,
+                       UnionAll::Options{static_cast<size_t>(state.range(0))}};
+
+    size_t count = 0;
+    union_all.open();
+    Batch batch;
+    while (union_all.next_batch(batch)) count += batch.size();
+    union_all.close();
+    benchmark::DoNotOptimize(count);
+  }
+  state.SetItemsProcessed(state.iterations() * 4 * NUM_TUPLES);
+}
+
+BENCHMARK(BM_UnionAllParallel)
+    ->Arg(1)
+    ->Arg(2)
+    ->Arg(4)
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
+
+}  // namespace
+
+BENCHMARK_MAIN();
@@ -0,0 +1,105 @@
+#include <benchmark/benchmark.h>
+#include <algorithm>
+#include <cstdint>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "operators/operators.h"
+
+namespace {
+
+using buzzdb::operators::Batch;
+using buzzdb::operators::Operator;
+using buzzdb::operators::Register;
+using buzzdb::operators::Sort;
+
+constexpr size_t NUM_TUPLES = 1 << 21;
+constexpr size_t NUM_ATTRIBUTES = 2;
+
+/// Produces `NUM_TUPLES` tuples of a random key and a payload in batches.
+class RandomSource : public Operator {
+ private:
+  std::vector<int64_t> keys;
+  size_t current_index = 0;
+  std::vector<Register*> output;
+
+ public:
+  RandomSource() : keys(NUM_TUPLES) {
+    std::mt19937_64 rng(42);
+    for (auto& key : keys) key = static_cast<int64_t>(rng());
+  }
+
+  void open() override { current_index = 0; }
+
+  bool next() override { return false; }
+
+  bool next_batch(Batch& batch) override {
+    batch.reset(NUM_ATTRIBUTES);
+    while (current_index < NUM_TUPLES && !batch.full()) {
+      size_t row = batch.append_row();
+      batch.column(0)[row] = Register::from_int(keys[current_index]);
+      batch.column(1)[row] =
+          Register::from_int(static_cast<int64_t>(current_index));
+      ++current_index;
+    }
+    return batch.size() > 0;
+  }
+
+  void close() override {}
+
+  const std::vector<Register*>& get_output() override { return output; }
+};
+
+/// Sorts the tuples by their key. The argument is the number of threads.
+void BM_Sort(benchmark::State& state) {
+  RandomSource source;
+  for (auto _ : state) {
+    Sort::Options options;
+    options.num_threads = static_cast<size_t>(state.range(0));
+    Sort sort{source, {{0, false}}, options};
+
+    size_t count = 0;
+    sort.open();
+    while (sort.next()) ++count;
+    sort.close();
+    benchmark::DoNotOptimize(count);
+  }
+  state.SetItemsProcessed(state.iterations() * NUM_TUPLES);
+}
+
+/// Returns the first tuples only. The argument is the limit, 0 sorts the
+/// whole input.
+void BM_SortLimit(benchmark::State& state) {
+  RandomSource source;
+  for (auto _ : state) {
+    Sort::Options options;
+    if (state.range(0)) options.limit = static_cast<size_t>(state.range(0));
+    Sort sort{source, {{0, false}}, options};
+
+    size_t count = 0;
+    sort.open();
+    for (size_t i = 0; i < 100 && sort.next(); ++i) ++count;
+    sort.close();
+    benchmark::DoNotOptimize(count);
+  }
+  state.SetItemsProcessed(state.iterations() * NUM_TUPLES);
+}
+
+BENCHMARK(BM_SortLimit)->Arg(0)->Arg(100)->Arg(10000)->Unit(
+    benchmark::kMillisecond);
+
+/// Scales from one thread to all hardware threads.
+void ThreadCounts(benchmark::internal::Benchmark* benchmark) {
+  size_t max_threads = std::max(1u, std::thread::hardware_concurrency());
+  for (size_t threads = 1; threads < max_threads; threads *= 2)
+    benchmark->Arg(static_cast<int64_t>(threads));
+  benchmark->Arg(static_cast<int64_t>(max_threads));
+}
+
+BENCHMARK(BM_Sort)->Apply(ThreadCounts)->UseRealTime()->Unit(
+    benchmark::kMillisecond);
+
+}  // namespace
+
+BENCHMARK_MAIN();
@@ -0,0 +1,87 @@
+#include "common/thread_pool.h"
+
+namespace buzzdb {
+
+ThreadPool::ThreadPool(size_t num_threads) {
+  for (size_t i = 1; i < num_threads; ++i)
+    this->workers.emplace_back([this, i] { this->work(i); });
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->stopping = true;
+  }
+  this->work_available.notify_all();
+  for (auto& worker : this->workers) worker.join();
+}
+
+void ThreadPool::run_tasks(const std::function<void(size_t, size_t)>& task,
+                           size_t num_tasks, size_t thread) {
+  for (size_t i = this->next_task++; i < num_tasks; i = this->next_task++) {
+    try {
+      task(i, thread);
+    } catch (...) {
+      std::lock_guard<std::mutex> lock(this->mutex);
+      if (!this->error) this->error = std::current_exception();
+    }
+  }
+}
+
+void ThreadPool::work(size_t thread) {
+  std::unique_lock<std::mutex> lock(this->mutex);
+  uint64_t seen = 0;
+  while (true) {
+    this->work_available.wait(lock, [&] {
+      return this->stopping || (this->task && this->generation != seen);
+    });
+    if (this->stopping) return;
+
+    seen = this->generation;
+    const auto& task = *this->task;
+    size_t num_tasks = this->num_tasks;
+    this->active++;
+    lock.unlock();
+    this->run_tasks(task, num_tasks, thread);
+    lock.lock();
+    if (--this->active == 0) this->work_done.notify_all();
+  }
+}
+
+void ThreadPool::parallel_for(size_t num_tasks,
+                              const std::function<void(size_t)>& task) {
+  this->parallel_for(num_tasks, [&task](size_t i, size_t) { task(i); });
+}
+
+void ThreadPool::parallel_for(
+    size_t num_tasks, const std::function<void(size_t, size_t)>& task) {
+  if (this->workers.empty()) {
+    for (size_t i = 0; i < num_tasks; ++i) task(i, 0);
+    return;
+  }
+
+  {
+    std::unique_lock<std::mutex> lock(this->mutex);
+    this->work_done.wait(lock, [this] { return this->active == 0; });
+    this->task = &task;
+    this->num_tasks = num_tasks;
+    this->next_task = 0;
+    this->generation++;
+    this->error = nullptr;
+    this->active++;
+  }
+  this->work_available.notify_all();
+  this->run_tasks(task, num_tasks, 0);
+
+  std::exception_ptr error;
+  {
+    std::unique_lock<std::mutex> lock(this->mutex);
+    this->active--;
+    this->work_done.wait(lock, [this] { return this->active == 0; });
+    this->task = nullptr;
+    error = this->error;
+  }
+  if (error) std::rethrow_exception(error);
+}
+
+}  // namespace buzzdb
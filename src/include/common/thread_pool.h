@@ -0,0 +1,65 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace buzzdb {
+
+/// A fixed set of threads that execute the tasks of `parallel_for()`. The
+/// calling thread takes part in the work, so a pool with `num_threads`
+/// threads starts `num_threads - 1` workers.
+class ThreadPool {
+ public:
+  /// Creates a pool of `num_threads` threads. A pool of one thread runs all
+  /// tasks on the calling thread.
+  explicit ThreadPool(size_t num_threads);
+
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  /// Returns the number of threads including the calling one.
+  size_t get_num_threads() const { return this->workers.size() + 1; }
+
+  /// Calls `task(i)` for all `i < num_tasks` and returns when all calls
+  /// finished. Tasks are handed out in increasing order to the next idle
+  /// thread. When tasks throw, the first exception is rethrown.
+  void parallel_for(size_t num_tasks, const std::function<void(size_t)>& task);
+
+  /// Like `parallel_for()`, but calls `task(i, thread)` with the index of
+  /// the executing thread, which is below `get_num_threads()`. Tasks of the
+  /// same thread never run concurrently, so they can share thread-local
+  /// state without synchronization.
+  void parallel_for(size_t num_tasks,
+                    const std::function<void(size_t, size_t)>& task);
+
+ private:
+  std::vector<std::thread> workers;
+  std::mutex mutex;
+  std::condition_variable work_available;
+  std::condition_variable work_done;
+
+  /// The current job, guarded by `mutex`. A new job is only published when
+  /// no thread is working on the previous one anymore.
+  const std::function<void(size_t, size_t)>* task = nullptr;
+  size_t num_tasks = 0;
+  std::atomic<size_t> next_task{0};
+  uint64_t generation = 0;
+  size_t active = 0;
+  bool stopping = false;
+  std::exception_ptr error;
+
+  void work(size_t thread);
+  void run_tasks(const std::function<void(size_t, size_t)>& task,
+                 size_t num_tasks, size_t thread);
+};
+
+}  // namespace buzzdb
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "operators/operators.h"
+
+namespace buzzdb {
+namespace operators {
+
+/// Hash table of a hash aggregation with one row per group. A row consists
+/// of the gathered key of the group (see `CompositeKey`) followed by the
+/// state of its aggregates, and all rows are stored one after the other in
+/// a contiguous arena. The directory is an open addressing table with
+/// linear probing, which is doubled whenever it gets half full. Rows are
+/// referenced by their index, since the arena moves when it grows.
+class AggregationHashTable {
+ public:
+  /// Removes all groups and sets the number of key registers and of all
+  /// registers per row.
+  void reset(size_t key_size, size_t row_width);
+
+  /// Removes all groups but keeps the size of the directory, so a table
+  /// which is filled over and over again is not grown every time.
+  void clear();
+
+  /// Returns the number of key registers per row.
+  size_t get_key_size() const { return this->key_size; }
+
+  /// Returns the number of registers per row.
+  size_t get_row_width() const { return this->row_width; }
+
+  /// Returns the number of bytes a group with `row_width` registers takes,
+  /// including its share of the directory.
+  static size_t memory_per_group(size_t row_width);
+
+  /// Returns the number of groups.
+  size_t get_num_groups() const {
+    return this->row_width ? this->rows.size() / this->row_width : 0;
+  }
+
+  /// Returns the row of the group with the given index.
+  const Register* get_row(size_t group) const {
+    return &this->rows[group * this->row_width];
+  }
+  Register* get_row(size_t group) {
+    return &this->rows[group * this->row_width];
+  }
+
+  /// Returns the hash of the key of the group with the given index.
+  uint64_t get_hash(size_t group) const { return this->hashes[group]; }
+
+  /// Returns the row of the group whose key equals the gathered `key`, and
+  /// whether the group was inserted by this call. The state registers of an
+  /// inserted group are NULL and have to be initialized by the caller.
+  /// `hash` must be the `CompositeKey::hash()` of `key`. The row is valid
+  /// until the next insert.
+  std::pair<Register*, bool> insert(const Register* key, uint64_t hash);
+
+  /// Returns the row of the group whose key equals the gathered `key`, or
+  /// null when there is none.
+  Register* find(const Register* key, uint64_t hash);
+
+  /// Prefetches the directory slot for `hash`, which hides the cache miss
+  /// when the slot is probed a little later.
+  void prefetch(uint64_t hash) const {
+    if (!this->slots.empty())
+      __builtin_prefetch(&this->slots[this->slot_index(hash)]);
+  }
+
+ private:
+  static constexpr uint32_t NONE = UINT32_MAX;
+
+  struct Slot {
+    uint64_t hash;
+    /// Index of the group, `NONE` for empty slots.
+    uint32_t group;
+  };
+
+  size_t key_size = 0;
+  size_t row_width = 0;
+  std::vector<Register> rows;
+  /// The hash of every group.
+  std::vector<uint64_t> hashes;
+  std::vector<Slot> slots;
+  /// The directory has `2^(64 - shift)` slots.
+  unsigned shift = 64;
+
+  /// Returns the home slot of `hash` by Fibonacci hashing, like
+  /// `JoinHashTable` does.
+  size_t slot_index(uint64_t hash) const {
+    return static_cast<size_t>((hash * 0x9E3779B97F4A7C15ull) >> this->shift);
+  }
+
+  /// Doubles the directory and reinserts all groups.
+  void grow();
+};
+
+}  // namespace operators
+}  // namespace buzzdb
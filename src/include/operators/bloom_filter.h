@@ -0,0 +1,85 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace buzzdb {
+namespace operators {
+
+/// A blocked Bloom filter over 64 bit hashes. Every key sets one bit in each
+/// of the eight 32 bit words of a single 32 byte block (a split block Bloom
+/// filter), so inserting and testing a key touches one cache line.
+class BloomFilter {
+ public:
+  /// Number of bits per key the filter is sized for. This gives a false
+  /// positive rate below 0.5%.
+  static constexpr size_t BITS_PER_KEY = 16;
+
+  /// Creates an empty filter sized for `num_keys` keys.
+  explicit BloomFilter(size_t num_keys);
+
+  /// Adds the key with the given hash.
+  void insert(uint64_t hash) {
+    Block& block = this->blocks[this->block_index(hash)];
+    Block mask = make_mask(hash);
+    for (size_t i = 0; i < WORDS_PER_BLOCK; ++i) block[i] |= mask[i];
+  }
+
+  /// Returns false when no key with the given hash was inserted.
+  bool may_contain(uint64_t hash) const {
+    const Block& block = this->blocks[this->block_index(hash)];
+    Block mask = make_mask(hash);
+    uint32_t missing = 0;
+    for (size_t i = 0; i < WORDS_PER_BLOCK; ++i)
+      missing |= mask[i] & ~block[i];
+    return missing == 0;
+  }
+
+  /// Returns the size of the filter in bytes.
+  size_t get_size() const { return this->blocks.size() * sizeof(Block); }
+
+  /// Returns the probability that `may_contain()` returns true for a key
+  /// which was not inserted, estimated from the bits set in every block.
+  double estimate_false_positive_rate() const;
+
+ private:
+  static constexpr size_t WORDS_PER_BLOCK = 8;
+  using Block = std::array<uint32_t, WORDS_PER_BLOCK>;
+
+  std::vector<Block> blocks;
+
+  /// Mixes the hash (the finalizer of MurmurHash3), since integers hash to
+  /// themselves.
+  static uint64_t mix(uint64_t hash) {
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdull;
+    hash ^= hash >> 33;
+    hash *= 0xc4ceb9fe1a85ec53ull;
+    hash ^= hash >> 33;
+    return hash;
+  }
+
+  /// Returns the block of a key from the high half of its mixed hash.
+  size_t block_index(uint64_t hash) const {
+    return static_cast<size_t>(((mix(hash) >> 32) * this->blocks.size()) >>
+                               32);
+  }
+
+  /// Returns the bits of a key in every word, derived from the low half of
+  /// its mixed hash by multiplying with a different odd salt per word.
+  static Block make_mask(uint64_t hash) {
+    static constexpr Block SALTS{0x47b6137bu, 0x44974d91u, 0x8824ad5bu,
+                                 0xa2b7289du, 0x705495c7u, 0x2df1424bu,
+                                 0x9efc4947u, 0x5c6bfb31u};
+    uint32_t key = static_cast<uint32_t>(mix(hash));
+    Block mask;
+    for (size_t i = 0; i < WORDS_PER_BLOCK; ++i)
+      mask[i] = uint32_t{1} << ((key * SALTS[i]) >> 27);
+    return mask;
+  }
+};
+
+}  // namespace operators
+}  // namespace buzzdb
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "operators/operators.h"
+
+namespace buzzdb {
+namespace operators {
+
+/// Hash table over the build side of a hash join. The tuples are stored row
+/// after row in one contiguous arena and never move once the table is
+/// built, so they can be referenced by their index or by pointers. The
+/// directory is an open addressing table with linear probing and one slot
+/// per distinct key. Tuples with equal keys are chained in their insertion
+/// order. Tuples whose key has a NULL attribute are stored but cannot be
+/// found. The keys are gathered into normalized key bytes when the table is
+/// built (see `CompositeKey`), so probes compare them with one `memcmp`
+/// without touching the tuples.
+class JoinHashTable {
+ public:
+  /// Marks the end of a chain of matches.
+  static constexpr uint32_t NONE = UINT32_MAX;
+
+  /// Removes all tuples and sets the number of attributes per tuple and the
+  /// attributes on which tuples are matched.
+  void reset(size_t width, CompositeKey key);
+
+  /// Returns the storage for the `width` registers of a new tuple. The
+  /// tuple cannot be found before `build()` is called.
+  Register* append_tuple();
+
+  /// Builds the directory over all appended tuples.
+  void build();
+
+  /// Returns the number of attributes per tuple.
+  size_t get_width() const { return this->width; }
+
+  /// Returns the number of bytes a tuple with `width` attributes and a key
+  /// of `key_size` attributes takes in a built table, including its key and
+  /// its share of the directory.
+  static size_t memory_per_tuple(size_t width, size_t key_size);
+
+  /// Returns the number of tuples.
+  size_t get_num_tuples() const {
+    return this->width ? this->tuples.size() / this->width : 0;
+  }
+
+  /// Returns the tuple with the given index.
+  const Register* get_tuple(uint32_t tuple) const {
+    return &this->tuples[tuple * this->width];
+  }
+  Register* get_tuple(uint32_t tuple) {
+    return &this->tuples[tuple * this->width];
+  }
+
+  /// Returns the first tuple whose key equals the gathered `key`, or
+  /// `NONE`. `hash` must be the `CompositeKey::hash()` of `key`.
+  uint32_t find(const Register* key, uint64_t hash) const;
+  uint32_t find(const Register* key) const {
+    return this->find(key, CompositeKey::hash(key, this->key.size()));
+  }
+
+  /// Returns the next tuple with the same key as `tuple`, or `NONE`.
+  uint32_t next_match(uint32_t tuple) const { return this->next[tuple]; }
+
+  /// Prefetches the directory slot for `hash`, which hides the cache miss
+  /// when the slot is probed a little later.
+  void prefetch(uint64_t hash) const {
+    if (!this->slots.empty())
+      __builtin_prefetch(&this->slots[this->slot_index(hash)]);
+  }
+
+ private:
+  struct Slot {
+    uint64_t hash;
+    /// First tuple with this key, `NONE` for empty slots.
+    uint32_t first;
+  };
+
+  size_t width = 0;
+  CompositeKey key;
+  std::vector<Register> tuples;
+  /// The gathered key of every tuple, filled by `build()`.
+  std::vector<Register> keys;
+  /// The next tuple with the same key for every tuple.
+  std::vector<uint32_t> next;
+  std::vector<Slot> slots;
+  /// The directory has `2^(64 - shift)` slots.
+  unsigned shift = 64;
+
+  /// Returns the home slot of `hash`. The hash is multiplied by the golden
+  /// ratio (Fibonacci hashing) and its high bits are used, so weak hashes
+  /// such as the identity hash of integers are still spread well.
+  size_t slot_index(uint64_t hash) const {
+    return static_cast<size_t>((hash * 0x9E3779B97F4A7C15ull) >> this->shift);
+  }
+};
+
+}  // namespace operators
+}  // namespace buzzdb
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+namespace buzzdb {
+namespace operators {
+
+/// Tree of losers for merging `k` sorted inputs (Knuth, TAOCP 5.4.1). The
+/// inputs are identified by their index, `less(a, b)` must return true when
+/// the current element of input `a` is smaller than the one of input `b`.
+/// Exhausted inputs must compare greater than all other inputs. Finding the
+/// next element then takes a single pass from a leaf to the root with one
+/// comparison per level.
+class LoserTree {
+ public:
+  /// Builds the tree over the current elements of `k` inputs.
+  template <typename Less>
+  void init(size_t k, Less less) {
+    this->k = k;
+    this->nodes.assign(k ? k : 1, 0);
+    if (k == 0) return;
+
+    // Leaves are the (virtual) nodes k..2k-1, node n has the children 2n and
+    // 2n+1. `winners` holds the winner of every subtree while building.
+    std::vector<size_t> winners(2 * k);
+    for (size_t i = 0; i < k; ++i) winners[k + i] = i;
+    for (size_t n = k - 1; n >= 1; --n) {
+      size_t a = winners[2 * n], b = winners[2 * n + 1];
+      if (less(b, a)) std::swap(a, b);
+      winners[n] = a;
+      this->nodes[n] = b;
+    }
+    this->nodes[0] = (k == 1) ? 0 : winners[1];
+  }
+
+  /// Returns the input with the smallest current element.
+  size_t winner() const { return this->nodes[0]; }
+
+  /// Restores the tree after the current element of `winner()` changed.
+  template <typename Less>
+  void replay(Less less) {
+    size_t winner = this->nodes[0];
+    for (size_t n = (this->k + winner) / 2; n >= 1; n /= 2)
+      if (less(this->nodes[n], winner)) std::swap(this->nodes[n], winner);
+    this->nodes[0] = winner;
+  }
+
+ private:
+  size_t k = 0;
+  /// `nodes[0]` is the overall winner, the other nodes hold the loser of
+  /// the match at that node.
+  std::vector<size_t> nodes;
+};
+
+}  // namespace operators
+}  // namespace buzzdb
@@ -1,25 +1,40 @@
 #pragma once
 
 #include <algorithm>
+#include <array>
 #include <cassert>
 #include <cstddef>
 #include <cstdint>
-#include <experimental/optional>
+#include <cstring>
 #include <functional>
+#include <limits>
+#include <memory>
 #include <ostream>
 #include <string>
+#include <string_view>
+#include <type_traits>
 #include <unordered_map>
 #include <unordered_set>
+#include <utility>
 #include <vector>
 
 #include "common/macros.h"
+#include "operators/loser_tree.h"
 
 namespace buzzdb {
+
+class ThreadPool;
+
 namespace operators {
 
+/// A single attribute value. Registers have a fixed width and own no heap
+/// memory, so they can be copied with `memcpy` and stored densely in tuple
+/// buffers.
 class Register {
  public:
-  enum class Type { INT64, CHAR16 };
+  /// `NULL_VALUE` registers hold the SQL NULL, e.g. for the attributes of
+  /// outer join tuples without a partner.
+  enum class Type : uint8_t { INT64, CHAR16, NULL_VALUE };
 
   Register() = default;
   Register(const Register&) = default;
@@ -31,14 +46,20 @@ class Register {
   /// Creates a `Register` from a given `int64_t`.
   static Register from_int(int64_t value);
 
-  /// Creates a `Register` from a given `std::string`. The register must only
-  /// be able to hold fixed size strings of size 16, so `value` must be at
-  /// most 16 characters long.
-  static Register from_string(const std::string& value);
+  /// Creates a `Register` from a given string. The register must only be
+  /// able to hold fixed size strings of size 16, so `value` must be at most
+  /// 16 characters long. Throws `std::invalid_argument` otherwise.
+  static Register from_string(std::string_view value);
+
+  /// Creates a NULL `Register`.
+  static Register null();
 
   /// Returns the type of the register.
   Type get_type() const;
 
+  /// Returns whether the register is NULL.
+  bool is_null() const { return this->type == Type::NULL_VALUE; }
+
   /// Returns the `int64_t` value for this register. Must only be called when
   /// this register really is an integer.
   int64_t as_int() const;
@@ -47,10 +68,33 @@ class Register {
   /// when this register really is a string.
   std::string as_string() const;
 
+  /// Returns a view on the characters of this register without copying them.
+  /// Must only be called when this register really is a string. The view is
+  /// only valid as long as the register is neither modified nor destroyed.
+  std::string_view as_string_view() const;
+
+  /// Returns the raw payload, i.e. the bytes of the `int64_t` value or the 16
+  /// zero padded characters. This is meant for vectorized kernels which load
+  /// the values of many registers at once.
+  const char* payload_data() const { return this->payload; }
+
+  /// Size of the keys written by `write_sort_key()`.
+  static constexpr size_t SORT_KEY_SIZE = REGISTER_SIZE;
+
+  /// Writes a binary-comparable key of `SORT_KEY_SIZE` bytes to `key`.
+  /// Comparing the keys of two registers of the same type with `memcmp`
+  /// orders them like `operator<` does, or in reverse when `desc` is set.
+  /// Keys of different types order by type in both directions, so NULLs
+  /// sort last.
+  void write_sort_key(char* key, bool desc) const;
+
   /// Returns the hash value for this register.
   uint64_t get_hash() const;
 
-  /// Compares two register for equality.
+  /// Compares two registers for equality. Registers of different types are
+  /// never equal, two NULLs are. Operators which follow SQL semantics, such
+  /// as the predicates of `Select` and the keys of `HashJoin`, handle NULLs
+  /// before comparing.
   friend bool operator==(const Register& r1, const Register& r2);
 
   /// Compares two registers for inequality.
@@ -73,10 +117,169 @@ class Register {
   friend bool operator>=(const Register& r1, const Register& r2);
 
  private:
-  std::experimental::optional<int64_t> intVal;
-  std::experimental::optional<std::string> strVal;
+  /// Either the bytes of an `int64_t` or up to 16 characters followed by the
+  /// null delimiter. Unused bytes are always zero, so two strings of the same
+  /// register type compare like their `std::string`s when using `memcmp`.
+  char payload[REGISTER_SIZE] = {};
+  Type type = Type::CHAR16;
+};
+
+static_assert(std::is_trivially_copyable<Register>::value,
+              "Register must be copyable with memcpy");
+static_assert(sizeof(Register) == REGISTER_SIZE + sizeof(Register::Type),
+              "Register must not have padding bytes");
+
+/// A column-major chunk of up to `Batch::CAPACITY` tuples that is passed
+/// between operators by `Operator::next_batch()`. Filters do not remove rows
+/// from a batch. Instead they shrink its selection vector, which lists the
+/// physical indexes of the rows that are still part of the batch.
+class Batch {
+ public:
+  /// Maximum number of rows in a batch.
+  static constexpr size_t CAPACITY = 1024;
+
+  /// Removes all rows and the selection vector and sets the number of
+  /// attributes per row.
+  void reset(size_t num_columns);
+
+  /// Returns the number of attributes per row.
+  size_t num_columns() const { return this->columns.size(); }
+
+  /// Returns the number of physical rows, including the unselected ones.
+  size_t num_rows() const { return this->rows; }
+
+  /// Returns the number of selected rows.
+  size_t size() const { return this->selected ? this->num_selected : rows; }
+
+  /// Returns the physical index of the `i`-th selected row.
+  size_t row(size_t i) const { return this->selected ? selection[i] : i; }
+
+  /// Returns true when no more rows can be appended.
+  bool full() const { return this->rows == CAPACITY; }
+
+  /// Returns the registers of attribute `attr_index` for all physical rows.
+  Register* column(size_t attr_index) { return this->columns[attr_index]; }
+  const Register* column(size_t attr_index) const {
+    return this->columns[attr_index];
+  }
+
+  /// Appends a row and returns its physical index. The registers of the new
+  /// row still contain old values and have to be written by the caller. Must
+  /// not be called after a selection has been applied.
+  size_t append_row();
+
+  /// Returns true when a selection has been applied to the batch.
+  bool has_selection() const { return this->selected; }
+
+  /// Returns the selection vector, which has room for `CAPACITY` row
+  /// indexes. Filters may refine it in place, because the `i`-th selected row
+  /// is only ever overwritten with a row that was selected at position `i` or
+  /// later.
+  uint16_t* selection_vector() { return this->selection.data(); }
+
+  /// Marks the first `count` entries of the selection vector as the selected
+  /// rows.
+  void set_selection(size_t count);
+
+  /// Replaces the attributes of the batch with the attributes at
+  /// `attr_indexes` without copying any registers.
+  void project(const std::vector<size_t>& attr_indexes);
+
+ private:
+  std::vector<Register> storage;
+  std::vector<Register*> columns;
+  std::vector<Register*> projected_columns;
+  std::array<uint16_t, CAPACITY> selection;
+  size_t rows = 0;
+  size_t num_selected = 0;
+  bool selected = false;
+};
+
+/// Mixes two 64-bit values into a hash by folding their 128-bit product,
+/// like wyhash does. Composite keys combine the hashes of their attributes
+/// with it, which needs neither memory nor a pass over the combined bytes.
+inline uint64_t hash_combine(uint64_t seed, uint64_t hash) {
+  // `__int128` is an extension, which -Wpedantic warns about otherwise.
+  __extension__ using uint128 = unsigned __int128;
+  uint128 product = static_cast<uint128>(seed ^ 0xa0761d6478bd642full) *
+                    (hash ^ 0xe7037ed1a0b428dbull);
+  return static_cast<uint64_t>(product) ^ static_cast<uint64_t>(product >> 64);
+}
+
+/// The attributes on which hash-based operators match or group tuples. A
+/// key is gathered into normalized key bytes, which are the registers of
+/// its attributes back to back. Registers have no padding and zero their
+/// unused bytes, so two keys are equal exactly when their bytes are, and
+/// they are compared with a single `memcmp`.
+class CompositeKey {
+ public:
+  CompositeKey() = default;
+  explicit CompositeKey(std::vector<size_t> attrs) : attrs(std::move(attrs)) {}
+
+  /// Returns the key attributes.
+  const std::vector<size_t>& get_attrs() const { return this->attrs; }
+
+  /// Returns the number of registers of a key.
+  size_t size() const { return this->attrs.size(); }
+
+  /// Gathers the key of `tuple` into the `size()` registers at `key`.
+  void gather(const Register* tuple, Register* key) const {
+    for (size_t i = 0; i < this->attrs.size(); ++i)
+      key[i] = tuple[this->attrs[i]];
+  }
+  void gather(const std::vector<Register*>& tuple, Register* key) const {
+    for (size_t i = 0; i < this->attrs.size(); ++i)
+      key[i] = *tuple[this->attrs[i]];
+  }
+
+  /// Gathers the key of the physical row `row` of `batch`.
+  void gather(const Batch& batch, size_t row, Register* key) const {
+    for (size_t i = 0; i < this->attrs.size(); ++i)
+      key[i] = batch.column(this->attrs[i])[row];
+  }
+
+  /// Returns true when the key of `tuple` equals the gathered `key`.
+  bool matches(const Register* tuple, const Register* key) const {
+    for (size_t i = 0; i < this->attrs.size(); ++i)
+      if (tuple[this->attrs[i]] != key[i]) return false;
+    return true;
+  }
+
+  /// Returns the hash of the `num_attrs` registers at `key`. A key with a
+  /// single attribute hashes like its register.
+  static uint64_t hash(const Register* key, size_t num_attrs) {
+    if (num_attrs == 0) return 0;
+    uint64_t hash = key[0].get_hash();
+    for (size_t i = 1; i < num_attrs; ++i)
+      hash = hash_combine(hash, key[i].get_hash());
+    return hash;
+  }
+
+  /// Compares the `num_attrs` registers at `key1` and `key2` for equality.
+  static bool equal(const Register* key1, const Register* key2,
+                    size_t num_attrs) {
+    // Empty keys may be null pointers, which `memcmp` must not get.
+    if (num_attrs == 0) return true;
+    return std::memcmp(key1, key2, num_attrs * sizeof(Register)) == 0;
+  }
+
+  /// Returns true when one of the `num_attrs` registers at `key` is NULL.
+  /// SQL keys with a NULL attribute equal no other key.
+  static bool has_null(const Register* key, size_t num_attrs) {
+    for (size_t i = 0; i < num_attrs; ++i)
+      if (key[i].is_null()) return true;
+    return false;
+  }
+
+ private:
+  std::vector<size_t> attrs;
 };
 
+class AggregationHashTable;
+class BloomFilter;
+class JoinHashTable;
+class SpillFile;
+
 class Operator {
  public:
   virtual ~Operator() = default;
@@ -94,8 +297,17 @@ class Operator {
   /// This returns the pointers to the registers of the generated tuple. When
   /// `next()` returns true, the Registers will contain the values for the
   /// next tuple. Each `Register*` in the vector stands for one attribute of
-  /// the tuple.
-  virtual std::vector<Register*> get_output() = 0;
+  /// the tuple. The vector is owned by the operator and stays valid until
+  /// the next call to `next()`, so calling this does not allocate and may be
+  /// repeated.
+  virtual const std::vector<Register*>& get_output() = 0;
+
+  /// Tries to generate the next batch of tuples into `batch`. Returns true
+  /// when the batch contains at least one selected row. A consumer must use
+  /// either `next()` or `next_batch()` between `open()` and `close()`, but
+  /// not both. The default implementation collects tuples from `next()`, so
+  /// every operator can be used in batch-at-a-time pipelines.
+  virtual bool next_batch(Batch& batch);
 };
 
 class UnaryOperator : public Operator {
@@ -123,7 +335,8 @@ class BinaryOperator : public Operator {
 /// Prints all tuples from its input into the stream. Tuples are separated by a
 /// newline character ("\n") and attributes are separated by a single comma
 /// without any extra spaces. The last line also ends with a newline. Calling
-/// `next()` prints the next tuple.
+/// `next()` prints the next tuple, calling `next_batch()` prints the next batch
+/// of tuples and leaves the given batch empty.
 class Print : public UnaryOperator {
  public:
   Print(Operator& input, std::ostream& stream);
@@ -133,17 +346,20 @@ class Print : public UnaryOperator {
   void open() override;
   bool next() override;
   void close() override;
-  std::vector<Register*> get_output() override;
+  const std::vector<Register*>& get_output() override;
+  bool next_batch(Batch& batch) override;
 
  private:
   std::ostream* stream;
+  std::vector<Register*> output;
 };
 
 /// Generates tuples from the input with only a subset of their attributes.
 class Projection : public UnaryOperator {
  private:
   std::vector<size_t> attr_indexes;
-  std::vector<Register> output_regs;
+  /// Points to the registers of the input tuple.
+  std::vector<Register*> output;
 
  public:
   Projection(Operator& input, std::vector<size_t> attr_indexes);
@@ -153,7 +369,8 @@ class Projection : public UnaryOperator {
   void open() override;
   bool next() override;
   void close() override;
-  std::vector<Register*> get_output() override;
+  const std::vector<Register*>& get_output() override;
+  bool next_batch(Batch& batch) override;
 };
 
 /// Filters tuples with the given predicate.
@@ -168,8 +385,6 @@ class Select : public UnaryOperator {
     GE   // a >= b
   };
 
-  enum class PrecidateAttribute { INT, CHAR, ATTRIBUTE };
-
   /// Predicate of the form:
   /// tuple[attr_index] P constant
   /// where P is given by `predicate_type`.
@@ -197,28 +412,196 @@ class Select : public UnaryOperator {
     PredicateType predicate_type;
   };
 
+  /// A tree of predicates: either one of the comparisons above, or the
+  /// conjunction (AND), disjunction (OR) or negation (NOT) of other
+  /// predicates. In batch mode, conjunctions and disjunctions measure the
+  /// selectivity and cost of their children and periodically reorder them,
+  /// so that cheap children which decide most rows run first.
+  class Predicate {
+   public:
+    enum class Kind { INT, CHAR, ATTRIBUTE, AND, OR, NOT };
+
+    /// Number of batches after which conjunctions and disjunctions reorder
+    /// their children.
+    static constexpr size_t REORDER_INTERVAL = 8;
+
+    static Predicate from_int(PredicateAttributeInt64 predicate);
+    static Predicate from_string(PredicateAttributeChar16 predicate);
+    static Predicate from_attributes(PredicateAttributeAttribute predicate);
+    static Predicate conjunction(std::vector<Predicate> children);
+    static Predicate disjunction(std::vector<Predicate> children);
+    static Predicate negation(Predicate child);
+
+    /// Returns the kind of the root of this tree.
+    Kind get_kind() const { return this->kind; }
+
+    /// Returns the comparison of INT, CHAR and ATTRIBUTE predicates.
+    PredicateType get_predicate_type() const { return this->predicate_type; }
+
+    /// Returns the children in their current evaluation order.
+    const std::vector<Predicate>& get_children() const {
+      return this->children;
+    }
+
+    /// Returns true when the tuple passes the predicate. Conjunctions and
+    /// disjunctions stop at the first child that decides the result.
+    /// Comparisons with NULL are unknown, and so is their negation, so NOT
+    /// only passes the tuples for which its child is false.
+    bool evaluate(const std::vector<Register*>& regs) const;
+
+    /// Keeps those of the `count` rows of `batch` listed in `rows` which pass
+    /// the predicate and returns their number. `rows` must be in ascending
+    /// order, the remaining rows are moved to its front. `values` is scratch
+    /// space with room for `Batch::CAPACITY` integers.
+    size_t select(const Batch& batch, uint16_t* rows, size_t count,
+                  std::vector<int64_t>& values);
+
+   private:
+    Kind kind;
+
+    /// Comparisons are evaluated as
+    /// tuple[attr_left_index] P right
+    /// where right is `constant` for INT and CHAR predicates and
+    /// tuple[attr_right_index] for ATTRIBUTE predicates.
+    PredicateType predicate_type = PredicateType::EQ;
+    size_t attr_left_index = 0;
+    size_t attr_right_index = 0;
+    Register constant;
+
+    std::vector<Predicate> children;
+    size_t num_batches = 0;
+
+    /// Statistics of this predicate while evaluated by its parent. They are
+    /// halved whenever the parent reorders its children, so that they
+    /// follow changes in the data.
+    uint64_t rows_in = 0;
+    uint64_t rows_out = 0;
+    uint64_t nanoseconds = 0;
+
+    /// Scratch space of disjunctions.
+    std::vector<uint16_t> candidates, remaining, result, merged;
+
+    explicit Predicate(Kind kind) : kind(kind) {}
+
+    /// Compares two registers, or returns whether their comparison is false
+    /// when `negated`. Neither holds when one of them is NULL.
+    bool compare(const Register& left, const Register& right,
+                 bool negated) const;
+
+    /// Like the public versions, but return whether the predicate is false
+    /// instead of true when `negated`, which NOT passes to its child.
+    bool evaluate(const std::vector<Register*>& regs, bool negated) const;
+    size_t select(const Batch& batch, uint16_t* rows, size_t count,
+                  std::vector<int64_t>& values, bool negated);
+
+    /// Evaluates `child` and records its statistics.
+    size_t select_child(Predicate& child, const Batch& batch, uint16_t* rows,
+                        size_t count, std::vector<int64_t>& values,
+                        bool negated);
+
+    /// Sorts the children of a conjunction, or of a disjunction, by their
+    /// expected cost per decided row.
+    void reorder_children(bool conjunction);
+  };
+
  private:
-  std::vector<Register> output_regs;
+  /// Points to the registers of the input tuple.
+  std::vector<Register*> output;
+
+  Predicate predicate;
 
-  PredicateAttributeInt64 intPredicate;
-  PredicateAttributeChar16 charPredicate;
-  PredicateAttributeAttribute attributePredicate;
-  PrecidateAttribute predicateAttribute;
+  /// Scratch space into which `next_batch()` gathers the integers of the
+  /// filtered attributes, so that they can be compared with SIMD
+  /// instructions.
+  std::vector<int64_t> values;
 
  public:
   Select(Operator& input, PredicateAttributeInt64 predicate);
   Select(Operator& input, PredicateAttributeChar16 predicate);
   Select(Operator& input, PredicateAttributeAttribute predicate);
+  Select(Operator& input, Predicate predicate);
+
+  /// Returns the predicate, whose children may have been reordered.
+  const Predicate& get_predicate() const { return this->predicate; }
 
   ~Select() override;
 
   void open() override;
   bool next() override;
   void close() override;
-  std::vector<Register*> get_output() override;
+  const std::vector<Register*>& get_output() override;
+  bool next_batch(Batch& batch) override;
+};
+
+/// Discards tuples whose key cannot have a join partner. The filter is
+/// published at runtime by a `HashJoin` over its left keys (see
+/// `HashJoin::add_runtime_filter()`), and placed directly above the source
+/// of the right input, so non-matching tuples are dropped before they are
+/// materialized. Until a filter is published, all tuples pass.
+class RuntimeFilter : public UnaryOperator {
+ public:
+  /// A filter over the keys of a join's left input.
+  struct Filter {
+    /// Contains the hashes of the keys as computed by `CompositeKey::hash()`.
+    std::shared_ptr<const BloomFilter> bloom;
+    /// The range of the keys, only set when all keys are single integers.
+    bool has_range = false;
+    int64_t min = 0, max = 0;
+  };
+
+  struct Statistics {
+    /// Number of tuples tested against the filter.
+    uint64_t num_tuples = 0;
+    /// Number of tuples discarded by the range and by the Bloom filter.
+    uint64_t num_pruned_by_range = 0;
+    uint64_t num_pruned_by_bloom = 0;
+
+    /// Returns the fraction of the tested tuples that were discarded.
+    double get_pruning_ratio() const {
+      return this->num_tuples ? static_cast<double>(this->num_pruned_by_range +
+                                                    this->num_pruned_by_bloom) /
+                                    this->num_tuples
+                              : 0;
+    }
+  };
+
+ private:
+  CompositeKey key;
+  Filter filter;
+  Statistics statistics;
+  std::vector<Register*> output;
+  /// The key of the tested tuple.
+  std::vector<Register> key_buffer;
+
+  /// Returns true when the gathered key in `key_buffer` passes the filter.
+  bool test();
+
+ public:
+  /// Filters on the attribute `attr_index`.
+  RuntimeFilter(Operator& input, size_t attr_index);
+  /// Filters on the composite key of the attributes `attr_indexes`.
+  RuntimeFilter(Operator& input, std::vector<size_t> attr_indexes);
+
+  ~RuntimeFilter() override;
+
+  /// Sets the filter for all tuples read from now on.
+  void set_filter(Filter filter);
+
+  /// Returns the published filter. Its Bloom filter is null until a filter
+  /// was published.
+  const Filter& get_filter() const { return this->filter; }
+
+  const Statistics& get_statistics() const { return this->statistics; }
+
+  void open() override;
+  bool next() override;
+  void close() override;
+  const std::vector<Register*>& get_output() override;
+  bool next_batch(Batch& batch) override;
 };
 
-/// Sorts the input by the given criteria.
+/// Sorts the input by the given criteria. The first criterion decides the
+/// order, later criteria break ties in the earlier ones.
 class Sort : public UnaryOperator {
  public:
   struct Criterion {
@@ -228,22 +611,146 @@ class Sort : public UnaryOperator {
     bool desc;
   };
 
+  /// Value of `Options::limit` to return all tuples.
+  static constexpr size_t NO_LIMIT = std::numeric_limits<size_t>::max();
+
+  struct Options {
+    /// Keep tuples with equal sort keys in their input order?
+    bool stable = false;
+    /// Maximum number of bytes used for buffering tuples in memory. When
+    /// the input exceeds it, sorted runs are spilled to temporary files and
+    /// merged while producing the output.
+    size_t memory_budget = std::numeric_limits<size_t>::max();
+    /// Number of threads sorting the tuples in memory. With more than one
+    /// thread, the output is the one of a stable sort.
+    size_t num_threads = 1;
+    /// Maximum number of tuples to return. With a limit, only the best
+    /// `offset + limit` tuples are kept in a heap while reading the input,
+    /// they are sorted stable and never spilled.
+    size_t limit = NO_LIMIT;
+    /// Number of tuples to skip before returning the first one.
+    size_t offset = 0;
+  };
+
+  struct Statistics {
+    /// Number of bytes written to spill files, including the ones written
+    /// by intermediate merge passes.
+    uint64_t spilled_bytes = 0;
+    /// Number of sorted runs spilled from memory.
+    size_t num_runs = 0;
+    /// Number of passes over the spilled data. The last pass produces the
+    /// output.
+    size_t num_merge_passes = 0;
+  };
+
+  /// Maximum number of runs merged at once. More runs are first merged into
+  /// longer runs by intermediate merge passes.
+  static constexpr size_t MERGE_FAN_IN = 64;
+
+  /// Minimum number of tuples sorted by each thread. Smaller inputs are
+  /// sorted by fewer threads.
+  static constexpr size_t MIN_TUPLES_PER_THREAD = 16 * 1024;
+
  private:
+  /// A sorted run in a spill file, and its tuple which is merged next.
+  struct Run {
+    std::unique_ptr<SpillFile> file;
+    std::vector<Register> tuple;
+    std::vector<char> key;
+    bool exhausted = false;
+  };
+
   size_t current_index = 0;
+  size_t num_skipped = 0;
+  size_t num_returned = 0;
   bool isFinished = false;
-  std::vector<Register> output_regs;
-  std::vector<std::vector<Register>> registers;
+  std::vector<Register*> output;
   std::vector<Criterion> criteria;
+  Options options;
+  Statistics statistics;
+
+  /// Number of attributes per tuple.
+  size_t width = 0;
+  /// The input tuples, stored row after row.
+  std::vector<Register> tuples;
+  /// The sort key of every tuple: the concatenated keys of the criteria as
+  /// written by `Register::write_sort_key()`, so two tuples are compared
+  /// with a single `memcmp`.
+  std::vector<char> keys;
+  /// Indexes of the tuples in output order. Only the indexes are moved
+  /// while sorting, the tuples stay in place.
+  std::vector<uint32_t> order;
+
+  /// The runs which are merged by the last merge pass, the tree of losers
+  /// over them, and whether `next()` has to advance the winner first.
+  std::vector<Run> runs;
+  LoserTree merge_tree;
+  bool advance_winner = false;
+
+  /// The threads which sort the tuples in memory, shared by all runs.
+  std::unique_ptr<ThreadPool> pool;
+
+  /// Returns the size of the sort key of a tuple.
+  size_t key_size() const {
+    return this->criteria.size() * Register::SORT_KEY_SIZE;
+  }
+
+  /// Reads the input and sorts it, spilling runs when the input exceeds the
+  /// memory budget.
+  void sort_input();
+
+  /// Reads the input and keeps the first `k` tuples of the sorted input in
+  /// `order`.
+  void collect_top_tuples(size_t k);
+
+  /// Returns the next tuple of the sorted input.
+  bool next_tuple();
+
+  /// Sorts the tuples in memory by filling `order`.
+  void sort_tuples();
+
+  /// Sorts `order` on `num_threads` threads of `pool` by splitting it into
+  /// one partition per thread, sorting the partitions concurrently, and
+  /// merging them pairwise. Every merge is split into equally sized parts
+  /// along its merge path, so all threads take part in all merge rounds.
+  void sort_tuples_parallel(size_t num_threads);
+
+  /// Sorts the tuples in memory and moves them into a new spill file.
+  void spill_tuples(std::vector<std::unique_ptr<SpillFile>>& files);
+
+  /// Writes the sort key of `tuple` to `key`.
+  void write_key(const Register* tuple, char* key) const;
+
+  /// Rewinds `files` and reads the first tuple of each of them.
+  std::vector<Run> open_runs(std::vector<std::unique_ptr<SpillFile>> files);
+
+  /// Reads the next tuple of `run` and computes its sort key.
+  void read_run(Run& run);
+
+  /// Returns true when the current tuple of run `a` has to be output before
+  /// the one of run `b`. Exhausted runs come last, and equal tuples are
+  /// ordered by their run so that the merge is stable.
+  static bool run_less(const std::vector<Run>& runs, size_t a, size_t b,
+                       size_t key_size);
+
+  /// Merges `files` into a single sorted spill file.
+  std::unique_ptr<SpillFile> merge_files(
+      std::vector<std::unique_ptr<SpillFile>> files);
 
  public:
   Sort(Operator& input, std::vector<Criterion> criteria);
+  Sort(Operator& input, std::vector<Criterion> criteria, Options options);
 
   ~Sort() override;
 
   void open() override;
   bool next() override;
   void close() override;
-  std::vector<Register*> get_output() override;
+  const std::vector<Register*>& get_output() override;
+
+  /// Returns the spill statistics. They are complete once `next()` returned
+  /// the first tuple.
+  const Statistics& get_statistics() const { return this->statistics; }
 };
 
 /// This can be used to store registers in an `std::unordered_map` or
@@ -263,174 +770,802 @@ struct RegisterHasher {
 /// RegisterVectorHasher> set_of_tuples;
 struct RegisterVectorHasher {
   uint64_t operator()(const std::vector<Register>& registers) const {
-    std::string hash_values;
-    for (auto& reg : registers) {
-      uint64_t hash = reg.get_hash();
-      hash_values.append(reinterpret_cast<char*>(&hash), sizeof(hash));
-    }
-    return std::hash<std::string>{}(hash_values);
+    return CompositeKey::hash(registers.data(), registers.size());
   }
 };
 
-/// Computes the inner equi-join of the two inputs on one attribute.
+/// Computes the equi-join of the two inputs on one or more pairs of
+/// attributes, whose keys are compared as a whole. Besides the
+/// inner join, outer joins pad the tuples without partner with NULLs, and
+/// semi and anti joins return the left tuples with and without partner.
+/// Keys with a NULL attribute have no partners.
+///
+/// The left input is loaded into a hash table. When it exceeds the memory
+/// budget, the join continues as a hybrid hash join: both inputs are
+/// partitioned by the hash of their keys, the first partition stays in
+/// memory as long as it fits, and the other ones are spilled and joined one
+/// after the other once the right input is exhausted. Spilled partitions
+/// which still do not fit are partitioned again with other hash bits.
+///
+/// With multiple threads and a left input within the budget, the left input
+/// is radix partitioned into cache sized partitions. The right input is read
+/// in chunks which fit into the rest of the budget, and the partitions of a
+/// chunk are joined in parallel, a few per thread at a time, whose matches
+/// are output before the next ones are joined. Only inner joins are
+/// parallelized.
 class HashJoin : public BinaryOperator {
+ public:
+  enum class JoinType {
+    INNER,        // matching pairs
+    LEFT_OUTER,   // matching pairs and left tuples without partner
+    RIGHT_OUTER,  // matching pairs and right tuples without partner
+    FULL_OUTER,   // matching pairs and all tuples without partner
+    LEFT_SEMI,    // left tuples with a partner, only their attributes
+    LEFT_ANTI     // left tuples without partner, only their attributes
+  };
+
+  struct Options {
+    JoinType join_type = JoinType::INNER;
+    /// Maximum number of bytes used for the hash table.
+    size_t memory_budget = std::numeric_limits<size_t>::max();
+    /// Number of threads joining the inputs.
+    size_t num_threads = 1;
+  };
+
+  struct Statistics {
+    /// Number of bytes written to spill files.
+    uint64_t spilled_bytes = 0;
+    /// Number of partitions which were joined from spill files.
+    size_t num_spilled_partitions = 0;
+    /// Maximum number of times a partition was partitioned, 0 when the
+    /// left input fit into memory.
+    size_t max_partitioning_depth = 0;
+  };
+
+  /// Number of bits of the hash used per partitioning pass, and the number
+  /// of partitions it creates.
+  static constexpr unsigned PARTITION_BITS = 4;
+  static constexpr size_t NUM_PARTITIONS = size_t{1} << PARTITION_BITS;
+  /// Partitions are not partitioned any further after this many passes,
+  /// e.g. when they consist of a single key.
+  static constexpr size_t MAX_PARTITIONING_DEPTH = 8;
+
  private:
-  size_t attr_index_left, attr_index_right;
-  std::unordered_map<Register, std::vector<Register>, RegisterHasher> regs_map;
-  std::vector<Register> output_regs;
+  /// What `probe_next()` found: a right tuple to join, the end of the right
+  /// tuples of the current hash table, or the end of all right tuples.
+  enum class Probe { TUPLE, TABLE_DONE, DONE };
+
+  /// A pair of spilled partitions, and how often they have been
+  /// partitioned. One side may be missing for outer and anti joins.
+  struct Partition {
+    std::unique_ptr<SpillFile> left, right;
+    size_t depth;
+  };
+
+  CompositeKey key_left, key_right;
+  Options options;
+  Statistics statistics;
+  /// The tuples of the left input, or of the partition which is currently
+  /// joined.
+  std::unique_ptr<JoinHashTable> table;
+  /// Points to the matching left tuple in `table` followed by the registers
+  /// of the right input.
+  std::vector<Register*> output;
+  size_t left_width = 0;
+  size_t right_width = 0;
+  /// The next left tuple that matches the current right tuple, or
+  /// `JoinHashTable::NONE` when the next right tuple has to be probed.
+  uint32_t match;
+  /// The registers of the current right tuple.
+  const std::vector<Register*>* probe_tuple = nullptr;
+  /// Whether a left tuple in `table` had a partner. Semi and anti joins
+  /// mark all tuples of a key on its first match and skip it afterwards.
+  std::vector<uint8_t> matched;
+  /// Whether the left tuples without partner of `table` are output, and
+  /// the next one to check.
+  bool draining = false;
+  size_t unmatched_index = 0;
+  /// NULLs for the missing side of outer join tuples.
+  std::vector<Register> null_tuple;
+  /// The batch of the right input that is currently probed in
+  /// `next_batch()`, the next selected row in it to probe, and the row
+  /// whose matches are currently output.
+  Batch probe_batch;
+  size_t probe_index = 0;
+  size_t probe_row = 0;
+  /// The gathered keys and their hashes in `probe_batch`, by selected row.
+  std::vector<Register> probe_keys;
+  std::vector<uint64_t> probe_hashes;
+  /// The gathered key of the left and the right tuple which is hashed or
+  /// probed in tuple-at-a-time mode.
+  std::vector<Register> left_key, right_key;
+
+  /// Whether the inputs are partitioned, whether the first partition is
+  /// still joined in memory, and the spill files of the other partitions.
+  bool partitioned = false;
+  bool memory_partition = false;
+  std::vector<std::unique_ptr<SpillFile>> left_files, right_files;
+  bool right_exhausted = false;
+  /// The spilled partitions which still have to be joined.
+  std::vector<Partition> partitions;
+  /// The right tuples of the partition which is currently joined, and the
+  /// tuple which was read last.
+  bool probing_partition = false;
+  std::unique_ptr<SpillFile> probe_file;
+  std::vector<Register> right_tuple;
+  std::vector<Register*> right_tuple_output;
+
+  /// The filters to which a filter over the left keys is published.
+  std::vector<RuntimeFilter*> runtime_filters;
+
+  /// Whether the inputs are joined in parallel, the partitions and matches
+  /// of the parallel join, and the threads which join them. The threads
+  /// are kept across `open()`.
+  struct ParallelJoin;
+  bool parallel = false;
+  std::unique_ptr<ParallelJoin> parallel_join;
+  std::unique_ptr<ThreadPool> pool;
+
+  /// Returns the partition of a key with the given hash in the partitioning
+  /// pass `depth`.
+  static size_t partition_of(uint64_t hash, size_t depth);
+
+  /// Gathers the key of a left or right tuple into `left_key` or
+  /// `right_key` and returns its hash.
+  uint64_t hash_left(const Register* tuple);
+  uint64_t hash_right(const Register* tuple);
+
+  /// Adds a left tuple to the hash table or to its spill file.
+  void add_left_tuple(const Register* tuple);
+
+  /// Partitions the tuples in the hash table once it exceeds the budget.
+  void start_partitioning();
+
+  /// Moves the first partition from the hash table into its spill file.
+  void spill_memory_partition();
+
+  /// Returns whether left or right tuples without partner are output.
+  bool preserves_left() const;
+  bool preserves_right() const;
+
+  /// Adds the spilled partitions which can have results to `partitions`.
+  void collect_partitions(std::vector<std::unique_ptr<SpillFile>>& left,
+                          std::vector<std::unique_ptr<SpillFile>>& right,
+                          size_t depth);
+
+  /// Partitions the spilled partition again, or loads its left tuples into
+  /// the hash table and starts probing its right tuples.
+  void join_partition(Partition partition);
+
+  /// Reads the next right tuple and finds its first match.
+  Probe probe_next();
+
+  /// Points the output to the current match and advances to the next one.
+  void output_match();
+
+  /// Points the output to the next left tuple without partner. Returns
+  /// false when there is none.
+  bool output_unmatched_left();
+
+  /// Points the output to NULLs and the current right tuple.
+  void output_unmatched_right();
+
+  /// Builds a filter over all left keys and publishes it to
+  /// `runtime_filters`. Spilled left tuples are read once more for it.
+  void publish_runtime_filters();
+
+  /// Partitions the left tuples in `table` and the first chunk of right
+  /// tuples for a parallel radix join.
+  void join_parallel();
+
+  /// Reads and partitions the next chunk of right tuples of the parallel
+  /// join. Returns false when the right input is exhausted.
+  bool read_right_chunk();
+
+  /// Returns the next match of the parallel join as the index of the left
+  /// tuple in `table` and of the right tuple in the current chunk, or null
+  /// when all matches were returned. Joins the next partitions, or reads
+  /// the next chunk, once the matches of the last ones were returned.
+  const std::pair<uint32_t, uint32_t>* next_parallel_match();
+
+  /// Returns the registers of a right tuple of the current chunk.
+  Register* parallel_right_tuple(uint32_t tuple);
 
  public:
   HashJoin(Operator& input_left, Operator& input_right, size_t attr_index_left,
            size_t attr_index_right);
+  HashJoin(Operator& input_left, Operator& input_right, size_t attr_index_left,
+           size_t attr_index_right, Options options);
+  /// Joins the tuples whose attributes `attr_indexes_left` equal their
+  /// counterparts `attr_indexes_right`, which must be as many.
+  HashJoin(Operator& input_left, Operator& input_right,
+           std::vector<size_t> attr_indexes_left,
+           std::vector<size_t> attr_indexes_right);
+  HashJoin(Operator& input_left, Operator& input_right,
+           std::vector<size_t> attr_indexes_left,
+           std::vector<size_t> attr_indexes_right, Options options);
 
   ~HashJoin() override;
 
+  /// Publishes a filter over the left keys to `filter` after the left input
+  /// was read in `open()`. `filter` must read from the right input before
+  /// any join, and filter on the attributes that are joined.
+  void add_runtime_filter(RuntimeFilter& filter);
+
   void open() override;
   bool next() override;
   void close() override;
-  std::vector<Register*> get_output() override;
+  const std::vector<Register*>& get_output() override;
+  bool next_batch(Batch& batch) override;
+
+  /// Returns the spill statistics. They are complete once `next()` returned
+  /// false.
+  const Statistics& get_statistics() const { return this->statistics; }
 };
 
 /// Groups and calculates (potentially multiple) aggregates on the input.
+/// Every output tuple holds the attributes of a group followed by its
+/// aggregates in the order of `aggr_funcs`. Without group by attributes,
+/// the whole input is one group and exactly one tuple is output, even for
+/// an empty input. NULL group by attributes are grouped like other values.
+/// Groups are output in no particular order.
+///
+/// The groups are kept in one hash table keyed on all group by attributes.
+/// The state of all aggregates of a group is stored right behind its key,
+/// so a single lookup per input tuple updates all aggregates.
+///
+/// With multiple threads, the aggregation runs in two phases. First, the
+/// input is read in batches, and every thread pre-aggregates the batches it
+/// is handed into a small thread-local table. When that table is full, its
+/// partial groups are moved into hash partitions and it starts over. Threads
+/// which barely reduce their input, e.g. because most groups are unique,
+/// stop pre-aggregating and move their tuples into the partitions right
+/// away. Second, the partial groups of every partition are merged into one
+/// table per partition, again in parallel, and the output is streamed from
+/// these tables.
+///
+/// When the groups exceed the memory budget, the table is moved into spill
+/// files by the hash partition of its groups and starts over. The partial
+/// groups keep the layout of the table rows. Once the input is exhausted,
+/// the spilled partitions are merged one after the other while the output
+/// is produced, by as many threads as there are partitions left, and each
+/// with its share of the budget. Partitions which still do not fit are
+/// partitioned again with other hash bits. With multiple threads, a thread
+/// spills its partitions when they exceed its share of the budget.
+///
+/// The state of an aggregate may span several registers, e.g. the sum and
+/// count of AVG, or the sketches of the approximate aggregates. Since all
+/// states are merged from partial states, the approximate aggregates work
+/// with the parallel aggregation and with spilling as they are. COUNT
+/// DISTINCT is the exception: a second `HashAggregation` groups the input
+/// by the group by attributes and the counted attribute, and this one
+/// merges the resulting groups and counts them.
+///
+/// When `Options::ordered_input` is set, the aggregation streams instead:
+/// it keeps only the group of the current input tuple and outputs it as
+/// soon as a tuple with other group by attributes arrives, so groups are
+/// output in input order. Nothing is hashed, and memory is constant. This
+/// mode is serial, and it is not used with COUNT_DISTINCT, whose groups
+/// are aggregated in a hash table first.
 class HashAggregation : public UnaryOperator {
  public:
-  /// Represents an aggregation function. For MIN, MAX, and SUM `attr_index`
-  /// stands for the attribute which is being aggregated. For SUM the
-  /// attribute must be in an `INT64` register.
+  /// Represents an aggregation function on the attribute `attr_index`.
+  /// All functions ignore NULLs, and MIN, MAX, SUM, AVG and APPROX_QUANTILE
+  /// are NULL for groups without other values. For SUM, AVG and
+  /// APPROX_QUANTILE the attribute must be in an `INT64` register, and AVG
+  /// is truncated towards zero like an integer division. COUNT counts the
+  /// values, COUNT_DISTINCT the distinct values. All COUNT_DISTINCT
+  /// aggregates of an aggregation must be on the same attribute.
+  ///
+  /// APPROX_COUNT_DISTINCT estimates the number of distinct values with a
+  /// `HyperLogLog` sketch, and APPROX_QUANTILE the `quantile` of the values
+  /// with a `QuantileSketch`, rounded to an integer. Their state has a
+  /// fixed size however many values a group has.
   struct AggrFunc {
-    enum Func { MIN, MAX, SUM, COUNT };
+    enum Func {
+      MIN,
+      MAX,
+      SUM,
+      COUNT,
+      AVG,
+      COUNT_DISTINCT,
+      APPROX_COUNT_DISTINCT,
+      APPROX_QUANTILE
+    };
 
     Func func;
     size_t attr_index;
+    /// The quantile of APPROX_QUANTILE, between 0 and 1.
+    double quantile = 0.5;
   };
 
+  struct Options {
+    /// Number of threads aggregating the input.
+    size_t num_threads = 1;
+    /// Maximum number of bytes used for the groups.
+    size_t memory_budget = std::numeric_limits<size_t>::max();
+    /// Whether the tuples of every group are adjacent in the input, e.g.
+    /// because it is sorted on the group by attributes. See the class
+    /// comment.
+    bool ordered_input = false;
+  };
+
+  struct Statistics {
+    /// Number of partial groups which were moved from the thread-local
+    /// tables into the partitions, including the tuples which were moved
+    /// without pre-aggregation.
+    uint64_t num_partial_groups = 0;
+    /// Number of threads which stopped pre-aggregating.
+    size_t num_passthrough_threads = 0;
+    /// Number of bytes written to spill files.
+    uint64_t spilled_bytes = 0;
+    /// Number of partitions which were merged from spill files.
+    size_t num_spilled_partitions = 0;
+    /// Maximum number of times a partition was partitioned, 0 when the
+    /// groups fit into memory.
+    size_t max_partitioning_depth = 0;
+  };
+
+  /// Number of bits of the hash which select the partition of a group in
+  /// the parallel aggregation and per partitioning pass, and the number of
+  /// partitions.
+  static constexpr unsigned PARTITION_BITS = 6;
+  static constexpr size_t NUM_PARTITIONS = size_t{1} << PARTITION_BITS;
+  /// Partitions are not partitioned any further after this many passes,
+  /// e.g. when their groups do not fit into the budget at all.
+  static constexpr size_t MAX_PARTITIONING_DEPTH = 8;
+
+  /// Number of groups after which a thread-local table is moved into the
+  /// partitions. Small tables stay in the cache of their core.
+  static constexpr size_t MAX_LOCAL_GROUPS = 4096;
+
+  /// Number of batches which are read before they are aggregated in
+  /// parallel, per thread.
+  static constexpr size_t BATCHES_PER_THREAD = 4;
+
  private:
-  bool isFinished = false;
-  int counter = 0, numberOfKeys = 0;
-  std::vector<std::vector<Register>> temp_sumcount_registers;
-  std::vector<size_t> group_by_attrs;
+  /// The groups of one partition which a thread moved out of its table:
+  /// their rows one after the other, and their hashes.
+  struct PartialGroups {
+    std::vector<Register> rows;
+    std::vector<uint64_t> hashes;
+  };
+
+  /// The spill files of the partial groups of a partition, and how often
+  /// they have been partitioned.
+  struct Partition {
+    std::vector<std::unique_ptr<SpillFile>> files;
+    size_t depth;
+  };
+
+  /// The state of a thread in the first phase of the parallel aggregation.
+  struct LocalState {
+    std::unique_ptr<AggregationHashTable> table;
+    std::vector<PartialGroups> partitions;
+    /// The spill files of the partitions, the number of partial groups in
+    /// `partitions`, and how many of them fit into the thread's budget.
+    std::vector<std::unique_ptr<SpillFile>> files;
+    size_t num_buffered_groups = 0;
+    size_t max_buffered_groups = 0;
+    /// The gathered group keys of the current batch and their hashes.
+    std::vector<Register> keys;
+    std::vector<uint64_t> hashes;
+    /// Number of aggregated tuples and of partial groups, and whether the
+    /// thread moves its tuples into the partitions without pre-aggregation.
+    uint64_t num_tuples = 0;
+    uint64_t num_partial_groups = 0;
+    bool passthrough = false;
+  };
+
+  CompositeKey group_key;
   std::vector<AggrFunc> aggr_funcs;
-  std::vector<Register> output_regs;
+  Options options;
+  Statistics statistics;
+  /// The offset of the state of every aggregate in the row of a group, and
+  /// the number of registers of a row.
+  std::vector<size_t> state_offsets;
+  size_t row_width = 0;
+  /// Whether an aggregate merges partial states from its input instead of
+  /// updating its state with values, which is how the groups of
+  /// `distinct_groups` are merged. A partial state is read from consecutive
+  /// attributes starting at `attr_index`.
+  std::vector<bool> partial_input;
+  /// Whether the rows of the groups are output as they are, i.e. with the
+  /// states of the aggregates instead of their results.
+  bool partial_output = false;
+  /// For COUNT_DISTINCT, the aggregation of the input by the group by
+  /// attributes and the counted attribute, which is the input of this one.
+  std::unique_ptr<HashAggregation> distinct_groups;
+  /// The groups which are output: one table, one table per partition after
+  /// a parallel aggregation, or one per merged spilled partition.
+  std::vector<std::unique_ptr<AggregationHashTable>> tables;
+  /// The threads of the aggregation and of merging spilled partitions.
+  std::unique_ptr<ThreadPool> pool;
+  /// The spill files of the partitions while the input is aggregated, and
+  /// the spilled partitions which still have to be merged.
+  std::vector<std::unique_ptr<SpillFile>> spill_files;
+  std::vector<Partition> partitions;
+  /// The initial state of the aggregates of a new group.
+  std::vector<Register> initial_state;
+  /// The gathered group keys of the current batch and their hashes.
+  std::vector<Register> keys;
+  std::vector<uint64_t> hashes;
+  /// Whether the input was aggregated, and the next group to output.
+  bool isFinished = false;
+  size_t output_table = 0;
+  size_t next_group = 0;
+  /// The results of the aggregates of the current output tuple.
+  std::vector<Register> results;
+  std::vector<Register*> output;
+  /// For ordered input, the row of the current group and whether it
+  /// exists, the row of the group which is output by `next()`, and the
+  /// current batch of the input with the position of its next row.
+  std::vector<Register> group_row;
+  bool has_group = false;
+  std::vector<Register> output_row;
+  Batch input_batch;
+  size_t input_pos = 0;
+
+  /// Returns the number of registers of the state of `func`.
+  static size_t state_size(AggrFunc::Func func);
+
+  /// Returns the row of the group with the gathered `key` in `table`,
+  /// which is inserted when it does not exist yet.
+  Register* find_group(AggregationHashTable& table, const Register* key,
+                       uint64_t hash) const;
+
+  /// Updates the aggregate `aggr` in `state` with `value`. Throws
+  /// `std::overflow_error` when a SUM or AVG overflows.
+  void update(size_t aggr, Register* state, const Register& value) const;
+
+  /// Merges the partial state `partial` of the aggregate `aggr` into
+  /// `state`.
+  void merge(size_t aggr, Register* state, const Register* partial) const;
+
+  /// Updates all aggregates of the group `row` with an input tuple, whose
+  /// attribute `attr` is returned by `values(attr)`.
+  template <typename Values>
+  void update_group(Register* row, const Values& values) const;
+
+  /// Returns the result of the aggregate `aggr` with the given state.
+  Register finalize(size_t aggr, const Register* state) const;
+
+  /// Adds all tuples of the input to their groups.
+  void aggregate_tuples();
+  void aggregate_batches(Batch& batch);
+
+  /// Returns the partition of a group with the given hash in the
+  /// partitioning pass `depth`.
+  static size_t partition_of(uint64_t hash, size_t depth);
+
+  /// Returns the number of groups that fit into `memory_budget`, at least
+  /// one.
+  size_t max_groups(size_t memory_budget) const;
+
+  /// Writes the groups of `table` to the spill files of their partitions
+  /// in the partitioning pass `depth` and clears the table.
+  void spill_table(AggregationHashTable& table,
+                   std::vector<std::unique_ptr<SpillFile>>& files,
+                   size_t depth) const;
+
+  /// Adds the partial group `partial` with the given hash to `table`.
+  void merge_group(AggregationHashTable& table, const Register* partial,
+                   uint64_t hash) const;
+
+  /// Merges the partial groups of `partition` into `table`. When they
+  /// exceed `memory_budget`, they are partitioned again into the spill
+  /// files `files` and `table` is left empty.
+  void merge_partition(Partition& partition, AggregationHashTable& table,
+                       size_t memory_budget,
+                       std::vector<std::unique_ptr<SpillFile>>& files) const;
+
+  /// Adds the spilled partitions in `files` to `partitions`.
+  void collect_partitions(std::vector<std::unique_ptr<SpillFile>>& files,
+                          size_t depth);
+
+  /// Merges the next spilled partitions in parallel into `tables`.
+  void merge_partitions();
+
+  /// Pre-aggregates `batch` into the thread-local `state`.
+  void preaggregate(LocalState& state, const Batch& batch) const;
+
+  /// Moves the groups of the thread-local table into the partitions.
+  void flush(LocalState& state) const;
+
+  /// Moves the partial groups of the partitions into their spill files.
+  void spill_partitions(LocalState& state) const;
+
+  /// Aggregates the input by the two phases of the parallel aggregation.
+  void aggregate_parallel();
+
+  /// Aggregates the whole input, reading it into `batch` unless it is
+  /// null.
+  void aggregate_input(Batch* batch);
+
+  /// Returns the row of the next group to output, or null when all groups
+  /// were output.
+  Register* next_row();
+
+  /// Points the output to the key and the aggregates of the group `row`.
+  void set_output(Register* row);
+
+  /// Appends the key and the aggregates of the group `row` to `batch`.
+  void append_group(Batch& batch, const Register* row);
+
+  /// Starts the current group of ordered input with the gathered `key`.
+  void start_group(const Register* key);
+
+  /// Moves the last group of ordered input to `output_row` once the input
+  /// is exhausted. Returns false when no group is left.
+  bool finish_ordered();
+
+  /// Implement `next()` and `next_batch()` for ordered input.
+  bool next_ordered();
+  bool next_batch_ordered(Batch& batch);
 
  public:
   HashAggregation(Operator& input, std::vector<size_t> group_by_attrs,
                   std::vector<AggrFunc> aggr_funcs);
+  HashAggregation(Operator& input, std::vector<size_t> group_by_attrs,
+                  std::vector<AggrFunc> aggr_funcs, Options options);
 
   ~HashAggregation() override;
 
   void open() override;
   bool next() override;
   void close() override;
-  std::vector<Register*> get_output() override;
+  const std::vector<Register*>& get_output() override;
+  bool next_batch(Batch& batch) override;
+
+  /// Returns the statistics of the parallel aggregation and of spilling,
+  /// including those of the aggregation for COUNT_DISTINCT. They are
+  /// complete once `next()` returned false.
+  const Statistics& get_statistics() const { return this->statistics; }
 };
 
-/// Computes the union of the two inputs with set semantics.
-class Union : public BinaryOperator {
+/// Computes a set operation of the two inputs on whole tuples. Tuples are
+/// compared like composite keys of all their attributes, so NULLs equal
+/// each other. Both inputs are read once into a single hash table, whose
+/// rows hold a distinct tuple followed by the number of its occurrences in
+/// the left and in the right input. The `Policy` decides from both counts
+/// how often the tuple is returned:
+///
+/// struct Policy {
+///   static constexpr int64_t count(int64_t left, int64_t right);
+///   /// Does `count()` never decrease when either count grows?
+///   static constexpr bool MONOTONE;
+/// };
+///
+/// The output is pipelined for monotone policies: a tuple is returned as
+/// soon as it qualifies while the inputs are read, so the first tuples do
+/// not wait for the whole input. Other policies return the tuples in the
+/// order the tuples first appear once both inputs are read.
+///
+/// When both inputs are sorted, `Options::sorted_inputs` merges them in
+/// lockstep instead: the run of every distinct tuple is counted on both
+/// sides at once, so only that tuple is kept in memory.
+///
+/// Sorted tuples are ordered ascending on all attributes from left to
+/// right, with NULLs last like `Sort` orders them. See `Union` for the
+/// operators built on it.
+template <typename Policy>
+class SetOperation : public BinaryOperator {
+ public:
+  struct Options {
+    /// Are both inputs sorted? Inputs which turn out not to be sorted raise
+    /// an error. The output is then sorted too.
+    bool sorted_inputs = false;
+    /// Return the tuples sorted? Hashed inputs are then read completely
+    /// before the first tuple is returned.
+    bool sorted_output = false;
+  };
+
  private:
-  int counter = 0;
+  Options options;
+  /// Rows of `width + 2` registers: the tuple and both counts.
+  std::unique_ptr<AggregationHashTable> table;
+  size_t width = 0;
+  /// The groups of the table which are returned, in output order.
+  std::vector<uint32_t> groups;
+  size_t current_group = 0;
+  /// How often the current row is still returned.
+  int64_t remaining = 0;
+  Register* current_row = nullptr;
   bool isFinished = false;
-  std::vector<Register> output_regs, registers;
+  std::vector<Register*> output;
+
+  /// The input which is read, 0 for the left and 1 for the right one, and
+  /// its current batch and tuple.
+  size_t side = 0;
+  Batch input_batch;
+  size_t input_pos = 0;
+  std::vector<Register> tuple;
+
+  /// The tuple of the current run when merging sorted inputs, and whether
+  /// the inputs hold an unconsumed tuple.
+  std::vector<Register> run_tuple;
+  bool has_left = false;
+  bool has_right = false;
+
+  /// Returns true when hashed tuples are returned while the inputs are
+  /// read.
+  bool pipelined() const {
+    return Policy::MONOTONE && !this->options.sorted_inputs &&
+           !this->options.sorted_output;
+  }
 
- public:
-  Union(Operator& input_left, Operator& input_right);
+  /// Reads the next tuple of the inputs into `tuple`. Returns false when
+  /// both inputs are exhausted.
+  bool read_tuple();
 
-  ~Union() override;
+  /// Counts `tuple` for the input `side` and returns its row, or null when
+  /// it was not inserted because the policy never returns it. `added` is
+  /// set to the number of copies by which the tuple's output grew.
+  Register* count_tuple(int64_t& added);
 
-  void open() override;
-  bool next() override;
-  void close() override;
-  std::vector<Register*> get_output() override;
-};
+  /// Reads both inputs into the table and collects the returned groups.
+  /// Sorted inputs are only advanced to their first tuple.
+  void build();
 
-/// Computes the union of the two inputs with bag semantics.
-class UnionAll : public BinaryOperator {
- private:
-  int counter = 0;
-  bool isFinished = false;
-  std::vector<Register> output_regs, registers;
+  /// Returns the row of the next returned tuple, or null at the end.
+  Register* next_row();
+
+  /// Advances `input` to its next tuple. Returns false at its end.
+  bool advance(Operator& input);
+
+  /// Consumes the run of tuples of `input` which equal `run_tuple`, starting
+  /// with its current one, and returns its length.
+  int64_t count_run(Operator& input, bool& has_tuple);
+
+  /// Returns the next returned tuple of sorted inputs, or null at the end.
+  Register* next_merged();
 
  public:
-  UnionAll(Operator& input_left, Operator& input_right);
+  SetOperation(Operator& input_left, Operator& input_right);
+  SetOperation(Operator& input_left, Operator& input_right, Options options);
 
-  ~UnionAll() override;
+  ~SetOperation() override;
 
   void open() override;
   bool next() override;
   void close() override;
-  std::vector<Register*> get_output() override;
+  const std::vector<Register*>& get_output() override;
+  bool next_batch(Batch& batch) override;
 };
 
-/// Computes the intersection of the two inputs with set semantics.
-class Intersect : public BinaryOperator {
- private:
-  int counter = 0;
-  bool isFinished = false;
-  std::vector<Register> output_regs, registers;
+/// Policies of the set operators for `SetOperation`.
+struct UnionPolicy {
+  static constexpr int64_t count(int64_t left, int64_t right) {
+    return left + right > 0;
+  }
+  static constexpr bool MONOTONE = true;
+};
+struct IntersectPolicy {
+  static constexpr int64_t count(int64_t left, int64_t right) {
+    return left > 0 && right > 0;
+  }
+  static constexpr bool MONOTONE = true;
+};
+struct IntersectAllPolicy {
+  static constexpr int64_t count(int64_t left, int64_t right) {
+    return std::min(left, right);
+  }
+  static constexpr bool MONOTONE = true;
+};
+struct ExceptPolicy {
+  static constexpr int64_t count(int64_t left, int64_t right) {
+    return left > 0 && right == 0;
+  }
+  static constexpr bool MONOTONE = false;
+};
+struct ExceptAllPolicy {
+  static constexpr int64_t count(int64_t left, int64_t right) {
+    return std::max<int64_t>(left - right, 0);
+  }
+  static constexpr bool MONOTONE = false;
+};
 
+/// Computes the union of the two inputs with set semantics.
+using Union = SetOperation<UnionPolicy>;
+
+/// Computes the union of its inputs with bag semantics by returning the
+/// tuples of one input after the other. Tuples and batches of the inputs
+/// are passed through without copying, so the union needs no memory of its
+/// own.
+///
+/// With multiple threads, the inputs are read concurrently: every thread
+/// reads its share of the inputs and hands their batches over through a
+/// queue of at most `QUEUE_CAPACITY` batches. The tuples of different
+/// inputs are then interleaved in no particular order.
+///
+/// Sorted inputs can instead be merged into a sorted output, see
+/// `Options::sorted_inputs`.
+class UnionAll : public Operator {
  public:
-  Intersect(Operator& input_left, Operator& input_right);
+  struct Options {
+    /// Number of threads reading the inputs. At most one thread per input
+    /// is used.
+    size_t num_threads = 1;
+    /// Are all inputs sorted like `SetOperation` sorts tuples? They are
+    /// then merged with a tree of losers on a single thread, so the output
+    /// is sorted too.
+    bool sorted_inputs = false;
+  };
 
-  ~Intersect() override;
+  /// Maximum number of batches which the threads read ahead.
+  static constexpr size_t QUEUE_CAPACITY = 8;
 
-  void open() override;
-  bool next() override;
-  void close() override;
-  std::vector<Register*> get_output() override;
-};
-
-/// Computes the intersection of the two inputs with bag semantics.
-class IntersectAll : public BinaryOperator {
  private:
-  int counter = 0;
-  bool isFinished = false;
-  std::vector<Register> output_regs, registers;
+  /// The queue and threads of a parallel union.
+  struct ReadAhead;
 
- public:
-  IntersectAll(Operator& input_left, Operator& input_right);
+  std::vector<Operator*> inputs;
+  Options options;
+  size_t current_input = 0;
+  /// Whether the next tuple is the first one of `current_input`.
+  bool first_tuple = true;
+  /// Number of attributes, `UNKNOWN_WIDTH` before the first tuple.
+  size_t width;
+  std::vector<Register*> output;
 
-  ~IntersectAll() override;
+  std::unique_ptr<ReadAhead> read_ahead;
+  /// The batch whose tuples `next()` returns when reading in parallel.
+  Batch current_batch;
+  size_t current_row = 0;
 
-  void open() override;
-  bool next() override;
-  void close() override;
-  std::vector<Register*> get_output() override;
-};
+  /// The tree of losers over sorted inputs, which inputs hold an unconsumed
+  /// tuple, and whether `next()` has to advance the winner first.
+  LoserTree merge_tree;
+  std::vector<bool> has_tuple;
+  bool merge_started = false;
+  bool advance_winner = false;
 
-/// Computes input_left - input_right with set semantics.
-class Except : public BinaryOperator {
- private:
-  int counter = 0;
-  bool isFinished = false;
-  std::vector<Register> output_regs, registers;
+  static constexpr size_t UNKNOWN_WIDTH = std::numeric_limits<size_t>::max();
 
- public:
-  Except(Operator& input_left, Operator& input_right);
+  /// Checks that all inputs have the same number of attributes.
+  void check_width(size_t width);
 
-  ~Except() override;
+  /// Starts the threads reading the inputs.
+  void start_read_ahead();
 
-  void open() override;
-  bool next() override;
-  void close() override;
-  std::vector<Register*> get_output() override;
-};
+  /// Stops and joins the threads reading the inputs.
+  void stop_read_ahead();
 
-/// Computes input_left - input_right with bag semantics.
-class ExceptAll : public BinaryOperator {
- private:
-  int counter = 0;
-  bool isFinished = false;
-  std::vector<Register> output_regs, registers;
+  /// Moves the next batch read by the threads into `batch`. Returns false
+  /// when all inputs are exhausted.
+  bool next_read_ahead(Batch& batch);
+
+  /// Returns the next tuple of sorted inputs in `get_output()` of the
+  /// winner.
+  bool next_merged();
 
  public:
-  ExceptAll(Operator& input_left, Operator& input_right);
+  UnionAll(Operator& input_left, Operator& input_right);
+  UnionAll(Operator& input_left, Operator& input_right, Options options);
+  /// Computes the union of any number of inputs.
+  explicit UnionAll(std::vector<Operator*> inputs);
+  UnionAll(std::vector<Operator*> inputs, Options options);
 
-  ~ExceptAll() override;
+  ~UnionAll() override;
 
   void open() override;
   bool next() override;
   void close() override;
-  std::vector<Register*> get_output() override;
+  const std::vector<Register*>& get_output() override;
+  bool next_batch(Batch& batch) override;
 };
 
+/// Computes the intersection of the two inputs with set semantics.
+using Intersect = SetOperation<IntersectPolicy>;
+
+/// Computes the intersection of the two inputs with bag semantics.
+using IntersectAll = SetOperation<IntersectAllPolicy>;
+
+/// Computes input_left - input_right with set semantics.
+using Except = SetOperation<ExceptPolicy>;
+
+/// Computes input_left - input_right with bag semantics.
+using ExceptAll = SetOperation<ExceptAllPolicy>;
+
 }  // namespace operators
 }  // namespace buzzdb
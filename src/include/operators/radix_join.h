@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "common/thread_pool.h"
+#include "operators/operators.h"
+
+namespace buzzdb {
+namespace operators {
+namespace radix {
+
+/// A tuple in a partition: the hash of its key and its index in the input.
+struct Entry {
+  uint64_t hash;
+  uint32_t tuple;
+};
+
+/// The tuples of an input grouped by the radix of their hash. The entries
+/// of partition `p` are `entries[bounds[p]]` to `entries[bounds[p + 1]]`.
+struct Partitions {
+  std::vector<Entry> entries;
+  std::vector<size_t> bounds;
+};
+
+/// A pair of joined tuples by their indexes in the left and right input.
+using Match = std::pair<uint32_t, uint32_t>;
+
+/// Size of the data of a partition which should fit into the cache of a
+/// core while it is joined.
+constexpr size_t PARTITION_CACHE_SIZE = 256 * 1024;
+
+/// Maximum number of radix bits. Larger fan-outs exceed the TLB and the L1
+/// cache with the write-combine buffers of a single partitioning pass.
+constexpr unsigned MAX_RADIX_BITS = 12;
+
+/// Number of partitions per thread which are joined at a time. Threads
+/// whose partitions are small pick up more of them meanwhile.
+constexpr size_t PARTITIONS_PER_THREAD = 4;
+
+/// Returns the number of radix bits for partitioning `num_left_tuples` of
+/// the given width, so that a partition fits into the cache and every
+/// thread gets several partitions to join.
+unsigned choose_radix_bits(size_t num_left_tuples, size_t left_width,
+                           size_t num_threads);
+
+/// Partitions the `num_tuples` tuples of `width` registers starting at
+/// `tuples` by `2^bits` radixes of the hash of their `key`.
+/// Each thread of `pool` histograms and scatters a chunk of the tuples;
+/// entries are collected in cache line sized write-combine buffers before
+/// they are written to their partition.
+Partitions partition(ThreadPool& pool, const Register* tuples, size_t width,
+                     size_t num_tuples, const CompositeKey& key,
+                     unsigned bits);
+
+/// Joins the `num_partitions` partitions starting at `first_partition` of
+/// the left and the right tuples pairwise on the threads of `pool`. The
+/// matches of partition `first_partition + i` are stored in `matches[i]` in
+/// the order of the right tuples, and for every right tuple in the order of
+/// the left tuples.
+void join(ThreadPool& pool, const Register* left, size_t left_width,
+          const CompositeKey& left_key, const Partitions& left_partitions,
+          const Register* right, size_t right_width,
+          const CompositeKey& right_key, const Partitions& right_partitions,
+          size_t first_partition, size_t num_partitions,
+          std::vector<std::vector<Match>>& matches);
+
+}  // namespace radix
+}  // namespace operators
+}  // namespace buzzdb
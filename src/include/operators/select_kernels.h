@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "operators/operators.h"
+
+namespace buzzdb {
+namespace operators {
+namespace kernels {
+
+/// The instruction sets for which selection kernels are implemented.
+enum class InstructionSet { SCALAR, SSE42, AVX2 };
+
+/// Returns the best instruction set supported by the CPU. The result is
+/// determined once and cached.
+InstructionSet detect_instruction_set();
+
+/// Evaluates `values[i] P constant` for all `i < count`, where P is given by
+/// `predicate_type`. For every qualifying `i` the kernel appends `rows[i]`
+/// (or `i` itself when `rows` is null) to `selection` and returns the number
+/// of appended entries. `selection` may alias `rows`.
+size_t select_int64(InstructionSet isa, Select::PredicateType predicate_type,
+                    const int64_t* values, size_t count, int64_t constant,
+                    const uint16_t* rows, uint16_t* selection);
+
+/// Evaluates `chars(i) P constant` for all `i < count`, where `chars(i)` are
+/// the 16 zero padded characters at `base + row * stride` with `row` being
+/// `rows[i]` (or `i` when `rows` is null). Strings are compared like
+/// `std::string::compare` does. The qualifying rows are appended to
+/// `selection`, which may alias `rows`, and their number is returned.
+size_t select_char16(InstructionSet isa, Select::PredicateType predicate_type,
+                     const char* base, size_t stride, size_t count,
+                     const char* constant, const uint16_t* rows,
+                     uint16_t* selection);
+
+}  // namespace kernels
+}  // namespace operators
+}  // namespace buzzdb
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "operators/operators.h"
+
+namespace buzzdb {
+namespace operators {
+
+/// HyperLogLog sketch for approximate distinct counts. The state is a fixed
+/// number of `INT64` registers, so it can be stored in the row of a group
+/// and spilled like any other aggregate state. Two sketches are merged by
+/// taking the maximum of every bucket, which gives the same sketch as
+/// adding all values to a single one.
+class HyperLogLog {
+ public:
+  /// Number of hash bits which select a bucket. The standard error of the
+  /// estimate is `1.04 / sqrt(NUM_BUCKETS)`, about 3.3%.
+  static constexpr unsigned PRECISION = 10;
+  static constexpr size_t NUM_BUCKETS = size_t{1} << PRECISION;
+  /// Every register holds one byte per bucket.
+  static constexpr size_t BUCKETS_PER_REGISTER = sizeof(int64_t);
+  /// Number of registers of the state.
+  static constexpr size_t STATE_SIZE = NUM_BUCKETS / BUCKETS_PER_REGISTER;
+
+  /// Initializes `state` to the empty sketch.
+  static void init(Register* state);
+
+  /// Adds the value with the given hash.
+  static void add(Register* state, uint64_t hash);
+
+  /// Merges the sketch `other` into `state`.
+  static void merge(Register* state, const Register* other);
+
+  /// Returns the estimated number of distinct values.
+  static uint64_t estimate(const Register* state);
+};
+
+/// Merging t-digest for approximate quantiles of `INT64` values. The state
+/// has room for `CAPACITY` centroids, i.e. clusters of values represented by
+/// their mean and count. When it is full, neighbouring centroids are merged,
+/// but only while they stay small near both ends of the distribution, which
+/// keeps extreme quantiles accurate. Like `HyperLogLog`, the state is a
+/// fixed number of `INT64` registers, and two sketches can be merged.
+class QuantileSketch {
+ public:
+  /// Maximum number of centroids of the state.
+  static constexpr size_t CAPACITY = 128;
+  /// Compression parameter of the t-digest: a full state is merged into at
+  /// most about this many centroids.
+  static constexpr double COMPRESSION = 100;
+  /// Number of registers of the state: the number of centroids, the minimum
+  /// and maximum value, and the mean and count of every centroid.
+  static constexpr size_t STATE_SIZE = 3 + 2 * CAPACITY;
+
+  /// Initializes `state` to the empty sketch.
+  static void init(Register* state);
+
+  /// Adds `value`.
+  static void add(Register* state, int64_t value);
+
+  /// Merges the sketch `other` into `state`.
+  static void merge(Register* state, const Register* other);
+
+  /// Returns whether no value was added.
+  static bool empty(const Register* state) {
+    return state[0].as_int() == 0;
+  }
+
+  /// Returns the estimated `q`-quantile of the values for `q` between 0 and
+  /// 1. The sketch must not be empty.
+  static double quantile(const Register* state, double q);
+};
+
+}  // namespace operators
+}  // namespace buzzdb
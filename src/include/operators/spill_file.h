@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+#include "operators/operators.h"
+
+namespace buzzdb {
+namespace operators {
+
+/// A temporary file to which operators write tuples that exceed their memory
+/// budget. Registers are stored in a compact binary format: one type byte
+/// followed by the 8 byte integer or the 16 characters, NULLs take only the
+/// type byte. The file is written sequentially, then read sequentially after
+/// `rewind()`, and deleted when the object is destroyed.
+class SpillFile {
+ public:
+  /// Size of the write and read buffers.
+  static constexpr size_t BUFFER_SIZE = 64 * 1024;
+
+  /// Creates an empty temporary file. Throws `std::runtime_error` when no
+  /// file can be created.
+  SpillFile();
+
+  ~SpillFile();
+
+  SpillFile(const SpillFile&) = delete;
+  SpillFile& operator=(const SpillFile&) = delete;
+
+  /// Appends the `width` registers starting at `tuple`.
+  void write_tuple(const Register* tuple, size_t width);
+
+  /// Appends the registers the pointers in `tuple` point to.
+  void write_tuple(const std::vector<Register*>& tuple);
+
+  /// Flushes all written tuples and starts reading at the beginning of the
+  /// file. The file can be read any number of times, but no tuples can be
+  /// written after the first call.
+  void rewind();
+
+  /// Reads the next `width` registers into `tuple`. Returns false when the
+  /// end of the file is reached.
+  bool read_tuple(Register* tuple, size_t width);
+
+  /// Returns the number of bytes written to the file.
+  uint64_t get_size() const { return this->size; }
+
+  /// Returns the number of tuples written to the file.
+  uint64_t get_num_tuples() const { return this->num_tuples; }
+
+ private:
+  std::FILE* file;
+  std::vector<char> buffer;
+  /// Position in `buffer`, and while reading the number of valid bytes in
+  /// it.
+  size_t buffer_pos = 0;
+  size_t buffer_end = 0;
+  bool writing = true;
+  uint64_t size = 0;
+  uint64_t num_tuples = 0;
+
+  void write_register(const Register& reg);
+  void write_bytes(const char* data, size_t count);
+  void flush();
+  bool read_bytes(char* data, size_t count);
+};
+
+}  // namespace operators
+}  // namespace buzzdb
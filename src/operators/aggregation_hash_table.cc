@@ -0,0 +1,82 @@
+#include "operators/aggregation_hash_table.h"
+
+#include <algorithm>
+#include <cassert>
+
+namespace buzzdb {
+namespace operators {
+
+void AggregationHashTable::reset(size_t key_size, size_t row_width) {
+  assert(key_size <= row_width);
+  this->key_size = key_size;
+  this->row_width = row_width;
+  this->rows.clear();
+  this->hashes.clear();
+  this->slots.assign(16, Slot{0, NONE});
+  this->shift = 64 - 4;
+}
+
+size_t AggregationHashTable::memory_per_group(size_t row_width) {
+  // The directory has up to four slots per group, since it is doubled when
+  // it gets half full.
+  return row_width * sizeof(Register) + sizeof(uint64_t) + 4 * sizeof(Slot);
+}
+
+void AggregationHashTable::clear() {
+  this->rows.clear();
+  this->hashes.clear();
+  std::fill(this->slots.begin(), this->slots.end(), Slot{0, NONE});
+}
+
+void AggregationHashTable::grow() {
+  std::vector<Slot> old_slots(2 * this->slots.size(), Slot{0, NONE});
+  old_slots.swap(this->slots);
+  this->shift--;
+  const size_t mask = this->slots.size() - 1;
+  for (const Slot& slot : old_slots) {
+    if (slot.group == NONE) continue;
+    size_t i = this->slot_index(slot.hash);
+    while (this->slots[i].group != NONE) i = (i + 1) & mask;
+    this->slots[i] = slot;
+  }
+}
+
+std::pair<Register*, bool> AggregationHashTable::insert(const Register* key,
+                                                        uint64_t hash) {
+  assert(!this->slots.empty());
+  const size_t mask = this->slots.size() - 1;
+  size_t i = this->slot_index(hash);
+  for (;; i = (i + 1) & mask) {
+    const Slot& slot = this->slots[i];
+    if (slot.group == NONE) break;
+    if (slot.hash == hash &&
+        CompositeKey::equal(this->get_row(slot.group), key, this->key_size))
+      return {this->get_row(slot.group), false};
+  }
+
+  const size_t group = this->get_num_groups();
+  assert(group < NONE);
+  this->rows.resize(this->rows.size() + this->row_width, Register::null());
+  Register* row = this->get_row(group);
+  std::copy(key, key + this->key_size, row);
+  this->hashes.push_back(hash);
+  this->slots[i] = Slot{hash, static_cast<uint32_t>(group)};
+  // Keep the directory at most half full.
+  if (2 * (group + 1) > this->slots.size()) this->grow();
+  return {row, true};
+}
+
+Register* AggregationHashTable::find(const Register* key, uint64_t hash) {
+  assert(!this->slots.empty());
+  const size_t mask = this->slots.size() - 1;
+  for (size_t i = this->slot_index(hash);; i = (i + 1) & mask) {
+    const Slot& slot = this->slots[i];
+    if (slot.group == NONE) return nullptr;
+    if (slot.hash == hash &&
+        CompositeKey::equal(this->get_row(slot.group), key, this->key_size))
+      return this->get_row(slot.group);
+  }
+}
+
+}  // namespace operators
+}  // namespace buzzdb
@@ -0,0 +1,26 @@
+#include "operators/bloom_filter.h"
+
+#include <algorithm>
+
+namespace buzzdb {
+namespace operators {
+
+BloomFilter::BloomFilter(size_t num_keys)
+    : blocks(std::max<size_t>(
+          1, (num_keys * BITS_PER_KEY + sizeof(Block) * 8 - 1) /
+                 (sizeof(Block) * 8))) {}
+
+double BloomFilter::estimate_false_positive_rate() const {
+  // A key which was not inserted is a false positive when its bit is set in
+  // every word of its block.
+  double rate = 0;
+  for (const auto& block : this->blocks) {
+    double block_rate = 1;
+    for (uint32_t word : block) block_rate *= __builtin_popcount(word) / 32.0;
+    rate += block_rate;
+  }
+  return rate / this->blocks.size();
+}
+
+}  // namespace operators
+}  // namespace buzzdb
@@ -0,0 +1,86 @@
+#include "operators/join_hash_table.h"
+
+#include <cassert>
+#include <utility>
+
+namespace buzzdb {
+namespace operators {
+
+void JoinHashTable::reset(size_t width, CompositeKey key) {
+  this->width = width;
+  this->key = std::move(key);
+  this->tuples.clear();
+  this->keys.clear();
+  this->next.clear();
+  this->slots.clear();
+  this->shift = 64;
+}
+
+size_t JoinHashTable::memory_per_tuple(size_t width, size_t key_size) {
+  // The directory has up to four slots per tuple and is at least half full.
+  return (width + key_size) * sizeof(Register) + sizeof(uint32_t) +
+         4 * sizeof(Slot);
+}
+
+Register* JoinHashTable::append_tuple() {
+  assert(this->get_num_tuples() < NONE);
+  this->tuples.resize(this->tuples.size() + this->width);
+  return &this->tuples[this->tuples.size() - this->width];
+}
+
+void JoinHashTable::build() {
+  // Keep the directory at most half full.
+  const size_t num_tuples = this->get_num_tuples();
+  unsigned bits = 4;
+  while ((size_t{1} << bits) < 2 * num_tuples) ++bits;
+  this->shift = 64 - bits;
+  this->slots.assign(size_t{1} << bits, Slot{0, NONE});
+  this->next.assign(num_tuples, NONE);
+  const size_t key_size = this->key.size();
+  this->keys.resize(num_tuples * key_size);
+  for (size_t t = 0; t < num_tuples; ++t)
+    this->key.gather(this->get_tuple(t), &this->keys[t * key_size]);
+
+  // Insert backwards and prepend to the chains, so every chain lists its
+  // tuples in insertion order. NULL keys never match, so their tuples are
+  // only kept in the arena.
+  const size_t mask = this->slots.size() - 1;
+  for (size_t t = num_tuples; t-- > 0;) {
+    const Register* key = &this->keys[t * key_size];
+    if (CompositeKey::has_null(key, key_size)) continue;
+    uint64_t hash = CompositeKey::hash(key, key_size);
+    size_t i = this->slot_index(hash);
+    while (true) {
+      Slot& slot = this->slots[i];
+      if (slot.first == NONE) {
+        slot = Slot{hash, static_cast<uint32_t>(t)};
+        break;
+      }
+      if (slot.hash == hash &&
+          CompositeKey::equal(&this->keys[slot.first * key_size], key,
+                              key_size)) {
+        this->next[t] = slot.first;
+        slot.first = static_cast<uint32_t>(t);
+        break;
+      }
+      i = (i + 1) & mask;
+    }
+  }
+}
+
+uint32_t JoinHashTable::find(const Register* key, uint64_t hash) const {
+  if (this->slots.empty()) return NONE;
+  const size_t key_size = this->key.size();
+  const size_t mask = this->slots.size() - 1;
+  for (size_t i = this->slot_index(hash);; i = (i + 1) & mask) {
+    const Slot& slot = this->slots[i];
+    if (slot.first == NONE) return NONE;
+    if (slot.hash == hash &&
+        CompositeKey::equal(&this->keys[slot.first * key_size], key,
+                            key_size))
+      return slot.first;
+  }
+}
+
+}  // namespace operators
+}  // namespace buzzdb
@@ -1,79 +1,195 @@
 
 #include "operators/operators.h"
 
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <iterator>
+#include <limits>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <tuple>
+
 #include "common/macros.h"
+#include "common/thread_pool.h"
+#include "operators/aggregation_hash_table.h"
+#include "operators/bloom_filter.h"
+#include "operators/join_hash_table.h"
+#include "operators/radix_join.h"
+#include "operators/select_kernels.h"
+#include "operators/sketches.h"
+#include "operators/spill_file.h"
 
 #define UNUSED(p) ((void)(p))
 namespace buzzdb {
 namespace operators {
 
+namespace {
+
+/// Compares the 16 characters of two string registers lexicographically as
+/// unsigned bytes, which is what `std::string::compare` does. Strings are
+/// zero padded, so shorter strings order before their extensions.
+int compare_chars(const char* c1, const char* c2) {
+  for (size_t offset = 0; offset < 16; offset += sizeof(uint64_t)) {
+    uint64_t w1, w2;
+    std::memcpy(&w1, c1 + offset, sizeof(w1));
+    std::memcpy(&w2, c2 + offset, sizeof(w2));
+    if (w1 != w2)
+      return __builtin_bswap64(w1) < __builtin_bswap64(w2) ? -1 : 1;
+  }
+  return 0;
+}
+
+}  // namespace
+
 Register Register::from_int(int64_t value) {
   Register r{};
-  r.intVal = value;
+  r.type = Type::INT64;
+  std::memcpy(r.payload, &value, sizeof(value));
   return r;
 }
 
-Register Register::from_string(const std::string& value) {
+Register Register::from_string(std::string_view value) {
+  // Longer strings would overwrite the type and the memory behind it.
+  if (value.size() >= REGISTER_SIZE)
+    throw std::invalid_argument("string exceeds 16 characters");
   Register r{};
-  r.strVal = value;
+  r.type = Type::CHAR16;
+  std::memcpy(r.payload, value.data(), value.size());
   return r;
 }
 
-Register::Type Register::get_type() const {
-  if (this->intVal) return Type::INT64;
-  return Type::CHAR16;
+Register Register::null() {
+  Register r{};
+  r.type = Type::NULL_VALUE;
+  return r;
 }
 
+Register::Type Register::get_type() const { return this->type; }
+
 int64_t Register::as_int() const {
-  if (this->intVal) return *this->intVal;
-  return 0;
+  int64_t value = 0;
+  if (this->type == Type::INT64)
+    std::memcpy(&value, this->payload, sizeof(value));
+  return value;
 }
 
 std::string Register::as_string() const {
-  if (this->strVal) return *this->strVal;
-  return std::string{};
+  return std::string{this->as_string_view()};
+}
+
+std::string_view Register::as_string_view() const {
+  if (this->type != Type::CHAR16) return {};
+  return {this->payload, strnlen(this->payload, REGISTER_SIZE - 1)};
 }
 
 uint64_t Register::get_hash() const {
   if (this->get_type() == Type::INT64)
-    return std::hash<int64_t>{}(*this->intVal);
-  return std::hash<std::string>{}(*this->strVal);
+    return std::hash<int64_t>{}(this->as_int());
+  // Hash all 16 characters: the padding is zero, so equal strings still
+  // hash equally and no length has to be computed.
+  return std::hash<std::string_view>{}({this->payload, REGISTER_SIZE - 1});
 }
 
-bool operator==(const Register& r1, const Register& r2) {
-  return r1.get_hash() == r2.get_hash();
+void Register::write_sort_key(char* key, bool desc) const {
+  key[0] = static_cast<char>(this->type);
+  if (this->type == Type::NULL_VALUE) {
+    std::memset(key + 1, 0, REGISTER_SIZE - 1);
+  } else if (this->type == Type::INT64) {
+    // Big endian with a flipped sign bit orders like a signed integer.
+    uint64_t value =
+        __builtin_bswap64(static_cast<uint64_t>(this->as_int()) ^ (1ull << 63));
+    std::memcpy(key + 1, &value, sizeof(value));
+    std::memset(key + 1 + sizeof(value), 0, REGISTER_SIZE - 1 - sizeof(value));
+  } else {
+    std::memcpy(key + 1, this->payload, REGISTER_SIZE - 1);
+  }
+
+  // The type is kept, so NULLs stay last.
+  if (desc)
+    for (size_t i = 1; i < SORT_KEY_SIZE; ++i)
+      key[i] = static_cast<char>(~key[i]);
 }
 
-bool operator!=(const Register& r1, const Register& r2) {
-  return r1.get_hash() != r2.get_hash();
+bool operator==(const Register& r1, const Register& r2) {
+  // Unused payload bytes are zero for both types, so a single comparison of
+  // the first 16 bytes covers integers as well as strings.
+  return r1.type == r2.type &&
+         std::memcmp(r1.payload, r2.payload, REGISTER_SIZE - 1) == 0;
 }
 
+bool operator!=(const Register& r1, const Register& r2) { return !(r1 == r2); }
+
 bool operator<(const Register& r1, const Register& r2) {
   assert(r1.get_type() == r2.get_type());
   return (r1.get_type() == Register::Type::INT64)
              ? r1.as_int() < r2.as_int()
-             : r1.as_string().compare(r2.as_string()) < 0;
+             : compare_chars(r1.payload, r2.payload) < 0;
 }
 
 bool operator<=(const Register& r1, const Register& r2) {
   assert(r1.get_type() == r2.get_type());
   return (r1.get_type() == Register::Type::INT64)
              ? r1.as_int() <= r2.as_int()
-             : r1.as_string().compare(r2.as_string()) <= 0;
+             : compare_chars(r1.payload, r2.payload) <= 0;
 }
 
 bool operator>(const Register& r1, const Register& r2) {
   assert(r1.get_type() == r2.get_type());
   return (r1.get_type() == Register::Type::INT64)
              ? r1.as_int() > r2.as_int()
-             : r1.as_string().compare(r2.as_string()) > 0;
+             : compare_chars(r1.payload, r2.payload) > 0;
 }
 
 bool operator>=(const Register& r1, const Register& r2) {
   assert(r1.get_type() == r2.get_type());
   return (r1.get_type() == Register::Type::INT64)
              ? r1.as_int() >= r2.as_int()
-             : r1.as_string().compare(r2.as_string()) >= 0;
+             : compare_chars(r1.payload, r2.payload) >= 0;
+}
+
+void Batch::reset(size_t num_columns) {
+  if (this->storage.size() < num_columns * CAPACITY)
+    this->storage.resize(num_columns * CAPACITY);
+  this->columns.resize(num_columns);
+  for (size_t i = 0; i < num_columns; ++i)
+    this->columns[i] = &this->storage[i * CAPACITY];
+  this->rows = 0;
+  this->num_selected = 0;
+  this->selected = false;
+}
+
+size_t Batch::append_row() {
+  assert(!this->selected && !this->full());
+  return this->rows++;
+}
+
+void Batch::set_selection(size_t count) {
+  assert(count <= this->rows);
+  this->num_selected = count;
+  this->selected = true;
+}
+
+void Batch::project(const std::vector<size_t>& attr_indexes) {
+  this->projected_columns.clear();
+  for (const auto& attr_index : attr_indexes)
+    this->projected_columns.emplace_back(this->columns[attr_index]);
+  this->columns.swap(this->projected_columns);
+}
+
+bool Operator::next_batch(Batch& batch) {
+  batch.reset(0);
+  while (!batch.full() && this->next()) {
+    const auto& regs = this->get_output();
+    if (batch.num_rows() == 0) batch.reset(regs.size());
+    size_t row = batch.append_row();
+    for (size_t i = 0; i < regs.size(); ++i) batch.column(i)[row] = *regs[i];
+  }
+  return batch.size() > 0;
 }
 
 Print::Print(Operator& input, std::ostream& stream)
@@ -83,20 +199,33 @@ Print::~Print() = default;
 
 void Print::open() { this->input->open(); }
 
-bool Print::next() {
-  if (this->input->next()) {
-    std::vector<Register*> regs = this->input->get_output();
-    std::string str;
+namespace {
+
+void print_register(std::ostream& stream, const Register& reg) {
+  switch (reg.get_type()) {
+    case Register::Type::INT64:
+      stream << reg.as_int();
+      break;
+    case Register::Type::CHAR16:
+      stream << reg.as_string_view();
+      break;
+    case Register::Type::NULL_VALUE:
+      stream << "NULL";
+      break;
+  }
+}
 
-    for (const auto& reg : regs)
-      str += (reg->get_type() == Register::Type::INT64)
-                 ? (std::to_string(reg->as_int()) + ",")
-                 : (reg->as_string() + ",");
+}  // namespace
 
-    if (regs.size()) {
-      str = str.substr(0, str.size() - 1) + '\n';
-      *this->stream << str;
+bool Print::next() {
+  if (this->input->next()) {
+    const auto& regs = this->input->get_output();
+    for (size_t attr = 0; attr < regs.size(); ++attr) {
+      if (attr) *this->stream << ',';
+      print_register(*this->stream, *regs[attr]);
     }
+
+    if (regs.size()) *this->stream << '\n';
     return true;
   }
 
@@ -105,9 +234,28 @@ bool Print::next() {
 
 void Print::close() { this->input->close(); }
 
-std::vector<Register*> Print::get_output() {
+const std::vector<Register*>& Print::get_output() {
+  // Print has no output
+  return this->output;
+}
+
+bool Print::next_batch(Batch& batch) {
+  if (!this->input->next_batch(batch)) return false;
+
+  if (batch.num_columns()) {
+    for (size_t i = 0; i < batch.size(); ++i) {
+      size_t row = batch.row(i);
+      for (size_t attr = 0; attr < batch.num_columns(); ++attr) {
+        if (attr) *this->stream << ',';
+        print_register(*this->stream, batch.column(attr)[row]);
+      }
+      *this->stream << '\n';
+    }
+  }
+
   // Print has no output
-  return {};
+  batch.reset(0);
+  return true;
 }
 
 Projection::Projection(Operator& input, std::vector<size_t> attr_indexes)
@@ -115,13 +263,16 @@ Projection::Projection(Operator& input, std::vector<size_t> attr_indexes)
 
 Projection::~Projection() = default;
 
-void Projection::open() { this->input->open(); }
+void Projection::open() {
+  this->input->open();
+  this->output.resize(this->attr_indexes.size());
+}
 
 bool Projection::next() {
   if (this->input->next()) {
-    std::vector<Register*> regs = this->input->get_output();
-    for (const auto& attr_index : this->attr_indexes)
-      this->output_regs.emplace_back(*regs[attr_index]);
+    const auto& regs = this->input->get_output();
+    for (size_t i = 0; i < this->attr_indexes.size(); ++i)
+      this->output[i] = regs[this->attr_indexes[i]];
     return true;
   }
 
@@ -130,704 +281,2751 @@ bool Projection::next() {
 
 void Projection::close() { this->input->close(); }
 
-std::vector<Register*> Projection::get_output() {
-  std::vector<Register*> output;
-  for (auto& reg : this->output_regs) output.emplace_back(&reg);
-  this->output_regs.clear();
-  return output;
+const std::vector<Register*>& Projection::get_output() {
+  return this->output;
 }
 
-Select::Select(Operator& input, PredicateAttributeInt64 predicate)
-    : UnaryOperator(input),
-      intPredicate(predicate),
-      predicateAttribute(PrecidateAttribute::INT) {}
+bool Projection::next_batch(Batch& batch) {
+  if (!this->input->next_batch(batch)) return false;
+  batch.project(this->attr_indexes);
+  return true;
+}
 
-Select::Select(Operator& input, PredicateAttributeChar16 predicate)
-    : UnaryOperator(input),
-      charPredicate(std::move(predicate)),
-      predicateAttribute(Select::PrecidateAttribute::CHAR) {}
+Select::Predicate Select::Predicate::from_int(
+    PredicateAttributeInt64 predicate) {
+  Predicate p{Kind::INT};
+  p.predicate_type = predicate.predicate_type;
+  p.attr_left_index = predicate.attr_index;
+  p.constant = Register::from_int(predicate.constant);
+  return p;
+}
 
-Select::Select(Operator& input, PredicateAttributeAttribute predicate)
-    : UnaryOperator(input),
-      attributePredicate(predicate),
-      predicateAttribute(Select::PrecidateAttribute::ATTRIBUTE) {}
+Select::Predicate Select::Predicate::from_string(
+    PredicateAttributeChar16 predicate) {
+  Predicate p{Kind::CHAR};
+  p.predicate_type = predicate.predicate_type;
+  p.attr_left_index = predicate.attr_index;
+  p.constant = Register::from_string(predicate.constant);
+  return p;
+}
 
-Select::~Select() = default;
+Select::Predicate Select::Predicate::from_attributes(
+    PredicateAttributeAttribute predicate) {
+  Predicate p{Kind::ATTRIBUTE};
+  p.predicate_type = predicate.predicate_type;
+  p.attr_left_index = predicate.attr_left_index;
+  p.attr_right_index = predicate.attr_right_index;
+  return p;
+}
 
-void Select::open() { this->input->open(); }
+Select::Predicate Select::Predicate::conjunction(
+    std::vector<Predicate> children) {
+  Predicate p{Kind::AND};
+  p.children = std::move(children);
+  return p;
+}
 
-bool Select::next() {
-  if (this->input->next()) {
-    this->output_regs.clear();
-    std::vector<Register*> regs = this->input->get_output();
-
-    switch (this->predicateAttribute) {
-      case PrecidateAttribute::INT: {
-        auto& intReg = regs[this->intPredicate.attr_index];
-        Register int_reg = Register::from_int(this->intPredicate.constant);
-
-        switch (this->intPredicate.predicate_type) {
-          case Select::PredicateType::EQ:
-            if (*intReg == int_reg)
-              for (const auto& reg : regs) this->output_regs.emplace_back(*reg);
-            return true;
+Select::Predicate Select::Predicate::disjunction(
+    std::vector<Predicate> children) {
+  Predicate p{Kind::OR};
+  p.children = std::move(children);
+  return p;
+}
 
-          case Select::PredicateType::NE:
-            if (*intReg != int_reg)
-              for (const auto& reg : regs) this->output_regs.emplace_back(*reg);
-            return true;
+Select::Predicate Select::Predicate::negation(Predicate child) {
+  Predicate p{Kind::NOT};
+  p.children.emplace_back(std::move(child));
+  return p;
+}
 
-          case Select::PredicateType::LT:
-            if (*intReg < int_reg)
-              for (const auto& reg : regs) this->output_regs.emplace_back(*reg);
-            return true;
+namespace {
+
+/// Returns the comparison which is true when `type` is false.
+Select::PredicateType negate(Select::PredicateType type) {
+  switch (type) {
+    case Select::PredicateType::EQ:
+      return Select::PredicateType::NE;
+    case Select::PredicateType::NE:
+      return Select::PredicateType::EQ;
+    case Select::PredicateType::LT:
+      return Select::PredicateType::GE;
+    case Select::PredicateType::LE:
+      return Select::PredicateType::GT;
+    case Select::PredicateType::GT:
+      return Select::PredicateType::LE;
+    case Select::PredicateType::GE:
+      return Select::PredicateType::LT;
+  }
+  return type;
+}
 
-          case Select::PredicateType::LE:
-            if (*intReg <= int_reg)
-              for (const auto& reg : regs) this->output_regs.emplace_back(*reg);
-            return true;
+}  // namespace
+
+bool Select::Predicate::compare(const Register& left, const Register& right,
+                                bool negated) const {
+  // Comparisons with NULL are unknown, so neither they nor their negation
+  // are true.
+  if (left.is_null() || right.is_null()) return false;
+
+  switch (negated ? negate(this->predicate_type) : this->predicate_type) {
+    case Select::PredicateType::EQ:
+      return left == right;
+    case Select::PredicateType::NE:
+      return left != right;
+    case Select::PredicateType::LT:
+      return left < right;
+    case Select::PredicateType::LE:
+      return left <= right;
+    case Select::PredicateType::GT:
+      return left > right;
+    case Select::PredicateType::GE:
+      return left >= right;
+  }
 
-          case Select::PredicateType::GT:
-            if (*intReg > int_reg)
-              for (const auto& reg : regs) this->output_regs.emplace_back(*reg);
-            return true;
+  return false;
+}
 
-          case Select::PredicateType::GE:
-            if (*intReg >= int_reg)
-              for (const auto& reg : regs) this->output_regs.emplace_back(*reg);
-            return true;
-        }
+bool Select::Predicate::evaluate(const std::vector<Register*>& regs) const {
+  return this->evaluate(regs, false);
+}
 
-        break;
-      }
+bool Select::Predicate::evaluate(const std::vector<Register*>& regs,
+                                 bool negated) const {
+  switch (this->kind) {
+    case Kind::INT:
+    case Kind::CHAR:
+      return this->compare(*regs[this->attr_left_index], this->constant,
+                           negated);
+    case Kind::ATTRIBUTE:
+      return this->compare(*regs[this->attr_left_index],
+                           *regs[this->attr_right_index], negated);
+    case Kind::AND:
+    case Kind::OR: {
+      // A negated conjunction is false when one child is false, a negated
+      // disjunction when all children are false.
+      const bool conjunction = (this->kind == Kind::AND) != negated;
+      for (const auto& child : this->children)
+        if (child.evaluate(regs, negated) != conjunction) return !conjunction;
+      return conjunction;
+    }
+    case Kind::NOT:
+      return this->children[0].evaluate(regs, !negated);
+  }
 
-      case PrecidateAttribute::CHAR: {
-        auto& stringReg = regs[this->charPredicate.attr_index];
-        Register str_reg = Register::from_string(this->charPredicate.constant);
+  return false;
+}
 
-        switch (this->charPredicate.predicate_type) {
-          case Select::PredicateType::EQ:
-            if (*stringReg == str_reg)
-              for (const auto& reg : regs) this->output_regs.emplace_back(*reg);
-            return true;
+namespace {
+
+/// Removes the rows in `subset` from `rows`. Both must be ascending and
+/// `subset` must be contained in `rows`. Returns the new number of rows.
+size_t remove_rows(uint16_t* rows, size_t count, const uint16_t* subset,
+                   size_t subset_count) {
+  size_t kept = 0, j = 0;
+  for (size_t i = 0; i < count; ++i) {
+    if (j < subset_count && subset[j] == rows[i])
+      ++j;
+    else
+      rows[kept++] = rows[i];
+  }
+  return kept;
+}
 
-          case Select::PredicateType::NE:
-            if (*stringReg != str_reg)
-              for (const auto& reg : regs) this->output_regs.emplace_back(*reg);
-            return true;
+/// Removes the rows whose register in `column` is NULL from `rows`. The
+/// kernels compare NULLs like zeros, but comparisons with NULL are never
+/// true. Returns the new number of rows.
+size_t remove_nulls(const Register* column, uint16_t* rows, size_t count) {
+  size_t kept = 0;
+  for (size_t i = 0; i < count; ++i) {
+    rows[kept] = rows[i];
+    kept += !column[rows[i]].is_null();
+  }
+  return kept;
+}
 
-          case Select::PredicateType::LT:
-            if (*stringReg < str_reg)
-              for (const auto& reg : regs) this->output_regs.emplace_back(*reg);
-            return true;
+}  // namespace
 
-          case Select::PredicateType::LE:
-            if (*stringReg <= str_reg)
-              for (const auto& reg : regs) this->output_regs.emplace_back(*reg);
-            return true;
+size_t Select::Predicate::select(const Batch& batch, uint16_t* rows,
+                                 size_t count, std::vector<int64_t>& values) {
+  return this->select(batch, rows, count, values, false);
+}
 
-          case Select::PredicateType::GT:
-            if (*stringReg > str_reg)
-              for (const auto& reg : regs) this->output_regs.emplace_back(*reg);
-            return true;
+size_t Select::Predicate::select(const Batch& batch, uint16_t* rows,
+                                 size_t count, std::vector<int64_t>& values,
+                                 bool negated) {
+  const kernels::InstructionSet isa = kernels::detect_instruction_set();
+  const Register* left =
+      (this->kind <= Kind::ATTRIBUTE) ? batch.column(this->attr_left_index)
+                                      : nullptr;
+  const PredicateType predicate_type =
+      negated ? negate(this->predicate_type) : this->predicate_type;
+  // A negated conjunction selects like a disjunction of the negated
+  // children, and vice versa.
+  const bool conjunction = (this->kind == Kind::AND) != negated;
+
+  switch (this->kind) {
+    case Kind::INT: {
+      bool nulls = false;
+      for (size_t i = 0; i < count; ++i) {
+        std::memcpy(&values[i], left[rows[i]].payload_data(),
+                    sizeof(int64_t));
+        nulls |= left[rows[i]].is_null();
+      }
+      count = kernels::select_int64(isa, predicate_type, values.data(),
+                                    count, this->constant.as_int(), rows, rows);
+      return nulls ? remove_nulls(left, rows, count) : count;
+    }
 
-          case Select::PredicateType::GE:
-            if (*stringReg >= str_reg)
-              for (const auto& reg : regs) this->output_regs.emplace_back(*reg);
-            return true;
-        }
+    case Kind::CHAR: {
+      bool nulls = false;
+      for (size_t i = 0; i < count; ++i) nulls |= left[rows[i]].is_null();
+      count = kernels::select_char16(
+          isa, predicate_type, left->payload_data(), sizeof(Register),
+          count, this->constant.payload_data(), rows, rows);
+      return nulls ? remove_nulls(left, rows, count) : count;
+    }
 
-        break;
+    case Kind::ATTRIBUTE: {
+      const Register* right = batch.column(this->attr_right_index);
+      size_t num_selected = 0;
+      for (size_t i = 0; i < count; ++i) {
+        uint16_t row = rows[i];
+        rows[num_selected] = row;
+        num_selected += this->compare(left[row], right[row], negated);
       }
+      return num_selected;
+    }
 
-      case PrecidateAttribute::ATTRIBUTE: {
-        Register *leftReg = regs[this->attributePredicate.attr_left_index],
-                 *rightReg = regs[this->attributePredicate.attr_right_index];
-
-        switch (this->attributePredicate.predicate_type) {
-          case Select::PredicateType::EQ:
-            if (*leftReg == *rightReg)
-              for (const auto& reg : regs) this->output_regs.emplace_back(*reg);
-            return true;
+    case Kind::AND:
+    case Kind::OR:
+      if (conjunction) {
+        // Each child only sees the rows which passed the previous ones.
+        for (auto& child : this->children) {
+          if (!count) break;
+          count =
+              this->select_child(child, batch, rows, count, values, negated);
+        }
+        break;
+      }
 
-          case Select::PredicateType::NE:
-            if (*leftReg != *rightReg)
-              for (const auto& reg : regs) this->output_regs.emplace_back(*reg);
-            return true;
+      // Each child only sees the rows which failed the previous ones.
+      this->remaining.assign(rows, rows + count);
+      this->result.clear();
+      for (auto& child : this->children) {
+        if (this->remaining.empty()) break;
+        this->candidates = this->remaining;
+        size_t passed = this->select_child(child, batch,
+                                           this->candidates.data(),
+                                           this->candidates.size(), values,
+                                           negated);
+        this->merged.clear();
+        std::merge(this->result.begin(), this->result.end(),
+                   this->candidates.begin(),
+                   this->candidates.begin() + passed,
+                   std::back_inserter(this->merged));
+        this->result.swap(this->merged);
+        this->remaining.resize(
+            remove_rows(this->remaining.data(), this->remaining.size(),
+                        this->candidates.data(), passed));
+      }
+      count = this->result.size();
+      std::copy(this->result.begin(), this->result.end(), rows);
+      break;
 
-          case Select::PredicateType::LT:
-            if (*leftReg < *rightReg)
-              for (const auto& reg : regs) this->output_regs.emplace_back(*reg);
-            return true;
+    case Kind::NOT:
+      return this->children[0].select(batch, rows, count, values, !negated);
+  }
 
-          case Select::PredicateType::LE:
-            if (*leftReg <= *rightReg)
-              for (auto& r : regs) this->output_regs.emplace_back(*r);
-            return true;
+  if (++this->num_batches % REORDER_INTERVAL == 0)
+    this->reorder_children(conjunction);
+  return count;
+}
 
-          case Select::PredicateType::GT:
-            if (*leftReg > *rightReg)
-              for (const auto& reg : regs) this->output_regs.emplace_back(*reg);
-            return true;
+size_t Select::Predicate::select_child(Predicate& child, const Batch& batch,
+                                       uint16_t* rows, size_t count,
+                                       std::vector<int64_t>& values,
+                                       bool negated) {
+  auto start = std::chrono::steady_clock::now();
+  size_t passed = child.select(batch, rows, count, values, negated);
+  auto end = std::chrono::steady_clock::now();
+
+  child.rows_in += count;
+  child.rows_out += passed;
+  child.nanoseconds += static_cast<uint64_t>(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(end - start)
+          .count());
+  return passed;
+}
 
-          case Select::PredicateType::GE:
-            if (*leftReg >= *rightReg)
-              for (const auto& reg : regs) this->output_regs.emplace_back(*reg);
-            return true;
-        }
-      }
-    }
+void Select::Predicate::reorder_children(bool conjunction) {
+  // A conjunction is decided by a child that fails, a disjunction by one
+  // that passes. Children that were never reached keep their position
+  // behind the measured ones.
+  auto rank = [conjunction](const Predicate& child) {
+    if (!child.rows_in) return std::numeric_limits<double>::infinity();
+    double cost = static_cast<double>(child.nanoseconds + 1) /
+                  static_cast<double>(child.rows_in);
+    double passed = static_cast<double>(child.rows_out) /
+                    static_cast<double>(child.rows_in);
+    double decided = conjunction ? 1.0 - passed : passed;
+    return decided > 0 ? cost / decided
+                       : std::numeric_limits<double>::max();
+  };
+
+  std::stable_sort(this->children.begin(), this->children.end(),
+                   [&](const Predicate& a, const Predicate& b) {
+                     return rank(a) < rank(b);
+                   });
+
+  for (auto& child : this->children) {
+    child.rows_in /= 2;
+    child.rows_out /= 2;
+    child.nanoseconds /= 2;
   }
-
-  return false;
 }
 
-void Select::close() { this->input->close(); }
+Select::Select(Operator& input, PredicateAttributeInt64 predicate)
+    : UnaryOperator(input), predicate(Predicate::from_int(predicate)) {}
 
-std::vector<Register*> Select::get_output() {
-  std::vector<Register*> output;
-  for (auto& reg : this->output_regs) output.emplace_back(&reg);
-  return output;
-}
+Select::Select(Operator& input, PredicateAttributeChar16 predicate)
+    : UnaryOperator(input),
+      predicate(Predicate::from_string(std::move(predicate))) {}
 
-Sort::Sort(Operator& input, std::vector<Criterion> criteria)
-    : UnaryOperator(input), criteria(std::move(criteria)) {}
+Select::Select(Operator& input, PredicateAttributeAttribute predicate)
+    : UnaryOperator(input), predicate(Predicate::from_attributes(predicate)) {}
 
-Sort::~Sort() = default;
+Select::Select(Operator& input, Predicate predicate)
+    : UnaryOperator(input), predicate(std::move(predicate)) {}
 
-void Sort::open() { this->input->open(); }
+Select::~Select() = default;
 
-bool Sort::next() {
-  this->output_regs.clear();
+void Select::open() { this->input->open(); }
 
-  if (!this->isFinished) {
-    while (this->input->next()) {
-      std::vector<Register> output_regs;
-      std::vector<Register*> regs = this->input->get_output();
-      for (const auto& reg : regs) output_regs.emplace_back(*reg);
-      this->registers.emplace_back(output_regs);
+bool Select::next() {
+  while (this->input->next()) {
+    const auto& regs = this->input->get_output();
+    if (this->predicate.evaluate(regs)) {
+      this->output.assign(regs.begin(), regs.end());
+      return true;
     }
+  }
 
-    for (const auto& c : this->criteria) {
-      if (c.desc)
-        std::sort(this->registers.begin(), this->registers.end(),
-                  [&](const std::vector<Register>& regs1,
-                      const std::vector<Register>& regs2) {
-                    return regs1[c.attr_index] > regs2[c.attr_index];
-                  });
-    }
+  return false;
+}
 
-    this->isFinished = true;
-  }
+bool Select::next_batch(Batch& batch) {
+  this->values.resize(Batch::CAPACITY);
 
-  if (this->current_index < this->registers.size()) {
-    auto regs = this->registers[this->current_index];
-    for (const auto& r : regs) this->output_regs.emplace_back(r);
-    this->current_index++;
-    return true;
+  while (this->input->next_batch(batch)) {
+    uint16_t* rows = batch.selection_vector();
+    size_t count = batch.size();
+    if (!batch.has_selection())
+      for (size_t i = 0; i < count; ++i) rows[i] = static_cast<uint16_t>(i);
+
+    count = this->predicate.select(batch, rows, count, this->values);
+    batch.set_selection(count);
+    if (count) return true;
   }
 
   return false;
 }
 
-std::vector<Register*> Sort::get_output() {
-  std::vector<Register*> output;
-  for (auto& reg : this->output_regs) output.emplace_back(&reg);
-  return output;
-}
+void Select::close() { this->input->close(); }
 
-void Sort::close() { this->input->close(); }
+const std::vector<Register*>& Select::get_output() { return this->output; }
 
-HashJoin::HashJoin(Operator& input_left, Operator& input_right,
-                   size_t attr_index_left, size_t attr_index_right)
-    : BinaryOperator(input_left, input_right),
-      attr_index_left(attr_index_left),
-      attr_index_right(attr_index_right) {
-  this->input_left = &input_left;
-  this->input_right = &input_right;
-}
+RuntimeFilter::RuntimeFilter(Operator& input, size_t attr_index)
+    : RuntimeFilter(input, std::vector<size_t>{attr_index}) {}
 
-HashJoin::~HashJoin() = default;
+RuntimeFilter::RuntimeFilter(Operator& input,
+                             std::vector<size_t> attr_indexes)
+    : UnaryOperator(input),
+      key(std::move(attr_indexes)),
+      key_buffer(this->key.size()) {}
 
-void HashJoin::open() {
-  input_left->open();
-  input_right->open();
+RuntimeFilter::~RuntimeFilter() = default;
+
+void RuntimeFilter::set_filter(Filter filter) {
+  this->filter = std::move(filter);
+}
 
-  while (input_left->next()) {
-    std::vector<Register*> inputs = input_left->get_output();
-    std::vector<Register> registers;
-    for (const auto* reg : inputs) registers.emplace_back(*reg);
-    std::pair<Register, std::vector<Register>> pair =
-        std::make_pair(registers.at(attr_index_left), registers);
+void RuntimeFilter::open() {
+  this->statistics = Statistics{};
+  this->input->open();
+}
 
-    regs_map[registers.at(attr_index_left)] = registers;
+bool RuntimeFilter::test() {
+  if (!this->filter.bloom) return true;
+
+  const Register* key = this->key_buffer.data();
+  this->statistics.num_tuples++;
+  if (this->filter.has_range &&
+      (key[0].get_type() != Register::Type::INT64 ||
+       key[0].as_int() < this->filter.min ||
+       key[0].as_int() > this->filter.max)) {
+    this->statistics.num_pruned_by_range++;
+    return false;
+  }
+  if (!this->filter.bloom->may_contain(
+          CompositeKey::hash(key, this->key.size()))) {
+    this->statistics.num_pruned_by_bloom++;
+    return false;
   }
+  return true;
 }
 
-bool HashJoin::next() {
-  while (input_right->next()) {
-    std::vector<Register> inputs;
-    for (Register* reg : input_right->get_output()) inputs.emplace_back(*reg);
+bool RuntimeFilter::next() {
+  while (this->input->next()) {
+    const auto& regs = this->input->get_output();
+    this->key.gather(regs, this->key_buffer.data());
+    if (this->test()) {
+      this->output.assign(regs.begin(), regs.end());
+      return true;
+    }
+  }
+
+  return false;
+}
 
-    if (regs_map.count(inputs.at(attr_index_right))) {
-      std::vector<Register> leftTuple = (regs_map[inputs.at(attr_index_right)]);
-      for (size_t i = 0; i < inputs.size(); i++)
-        leftTuple.emplace_back(inputs.at(i));
+bool RuntimeFilter::next_batch(Batch& batch) {
+  while (this->input->next_batch(batch)) {
+    if (!this->filter.bloom) return true;
 
-      output_regs = leftTuple;
-      return true;
+    uint16_t* rows = batch.selection_vector();
+    size_t count = batch.size();
+    if (!batch.has_selection())
+      for (size_t i = 0; i < count; ++i) rows[i] = static_cast<uint16_t>(i);
+
+    size_t selected = 0;
+    for (size_t i = 0; i < count; ++i) {
+      rows[selected] = rows[i];
+      this->key.gather(batch, rows[i], this->key_buffer.data());
+      selected += this->test();
     }
+    batch.set_selection(selected);
+    if (selected) return true;
   }
 
   return false;
 }
 
-void HashJoin::close() {
-  this->input_left->close();
-  this->input_right->close();
+void RuntimeFilter::close() { this->input->close(); }
+
+const std::vector<Register*>& RuntimeFilter::get_output() {
+  return this->output;
 }
 
-std::vector<Register*> HashJoin::get_output() {
-  std::vector<Register*> output;
-  for (auto& reg : this->output_regs) output.emplace_back(&reg);
-  return output;
+namespace {
+
+/// Returns how many of the first `diagonal` elements of the merge of the
+/// sorted ranges `a` and `b` come from `a`, i.e. where the merge path
+/// crosses the diagonal. Equal elements are taken from `a` first, like
+/// `std::merge` does.
+template <typename Less>
+size_t merge_path(const uint32_t* a, size_t a_size, const uint32_t* b,
+                  size_t b_size, size_t diagonal, Less less) {
+  size_t lo = diagonal > b_size ? diagonal - b_size : 0;
+  size_t hi = std::min(diagonal, a_size);
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (less(b[diagonal - mid - 1], a[mid]))
+      hi = mid;
+    else
+      lo = mid + 1;
+  }
+  return lo;
 }
 
-HashAggregation::HashAggregation(Operator& input,
-                                 std::vector<size_t> group_by_attrs,
-                                 std::vector<AggrFunc> aggr_funcs)
+}  // namespace
+
+Sort::Sort(Operator& input, std::vector<Criterion> criteria)
+    : Sort(input, std::move(criteria), Options{}) {}
+
+Sort::Sort(Operator& input, std::vector<Criterion> criteria, Options options)
     : UnaryOperator(input),
-      group_by_attrs(std::move(group_by_attrs)),
-      aggr_funcs(std::move(aggr_funcs)) {}
+      criteria(std::move(criteria)),
+      options(options) {}
 
-HashAggregation::~HashAggregation() = default;
+Sort::~Sort() = default;
 
-void HashAggregation::open() { this->input->open(); }
+void Sort::open() {
+  this->input->open();
+  this->pool = std::make_unique<ThreadPool>(this->options.num_threads);
+}
 
-bool HashAggregation::next() {
-  this->output_regs.clear();
-  std::unordered_map<Register, int, RegisterHasher> countMap, sumMap;
-  std::experimental::optional<Register> minRegister, maxRegister;
+void Sort::write_key(const Register* tuple, char* key) const {
+  for (const auto& c : this->criteria) {
+    tuple[c.attr_index].write_sort_key(key, c.desc);
+    key += Register::SORT_KEY_SIZE;
+  }
+}
 
-  if (!this->isFinished) {
-    while (this->input->next()) {
-      std::vector<Register*> regs = this->input->get_output();
-      for (const auto& aggr_func : this->aggr_funcs) {
-        switch (aggr_func.func) {
-          case AggrFunc::MAX:
-            if (!maxRegister || *regs[aggr_func.attr_index] > *maxRegister)
-              maxRegister = *regs[aggr_func.attr_index];
-            break;
-
-          case AggrFunc::MIN:
-            if (!minRegister || *regs[aggr_func.attr_index] < *minRegister)
-              minRegister = *regs[aggr_func.attr_index];
-            break;
-
-          case AggrFunc::SUM:
-            for (const auto& attr : this->group_by_attrs) {
-              Register r = *regs[aggr_func.attr_index], myreg = *regs[attr];
-              if (sumMap.find(myreg) != sumMap.end())
-                sumMap[myreg] += static_cast<int>(r.as_int());
-              else
-                sumMap.insert({myreg, static_cast<int>(r.as_int())});
-            }
-            break;
+void Sort::sort_tuples() {
+  const size_t key_size = this->key_size();
+  size_t num_tuples = this->width ? this->tuples.size() / this->width : 0;
+  this->order.resize(num_tuples);
+  for (size_t i = 0; i < num_tuples; ++i)
+    this->order[i] = static_cast<uint32_t>(i);
+
+  size_t num_threads = std::min(this->options.num_threads,
+                                num_tuples / MIN_TUPLES_PER_THREAD);
+  if (num_threads > 1) {
+    this->sort_tuples_parallel(num_threads);
+    return;
+  }
 
-          case AggrFunc::COUNT:
-            for (const auto& attr : this->group_by_attrs)
-              countMap[*regs[attr]]++;
-        }
-      }
-    }
+  const char* keys = this->keys.data();
+  auto less = [keys, key_size](uint32_t t1, uint32_t t2) {
+    return std::memcmp(keys + t1 * key_size, keys + t2 * key_size,
+                       key_size) < 0;
+  };
+  if (this->options.stable)
+    std::stable_sort(this->order.begin(), this->order.end(), less);
+  else
+    std::sort(this->order.begin(), this->order.end(), less);
+}
 
-    if (sumMap.size()) {
-      std::vector<Register> keys;
-      for (const auto& it : sumMap) keys.emplace_back(it.first);
-      this->numberOfKeys = static_cast<int>(keys.size());
-      std::sort(keys.begin(), keys.end());
-
-      for (const auto& key : keys) {
-        std::vector<Register> reg_vector;
-        reg_vector.emplace_back(key);
-        auto sumRegister = Register::from_int(sumMap[key]);
-        reg_vector.emplace_back(sumRegister);
-        auto countRegister = Register::from_int(countMap[key]);
-        reg_vector.emplace_back(countRegister);
-        this->temp_sumcount_registers.emplace_back(reg_vector);
+void Sort::sort_tuples_parallel(size_t num_threads) {
+  // Ties are broken by the tuple index. This makes the order total, so every
+  // partitioning yields the output of a stable serial sort.
+  const size_t key_size = this->key_size();
+  const char* keys = this->keys.data();
+  auto less = [keys, key_size](uint32_t t1, uint32_t t2) {
+    int cmp = std::memcmp(keys + t1 * key_size, keys + t2 * key_size,
+                          key_size);
+    return cmp < 0 || (cmp == 0 && t1 < t2);
+  };
+
+  ThreadPool& pool = *this->pool;
+  const size_t num_tuples = this->order.size();
+  std::vector<size_t> bounds(num_threads + 1);
+  for (size_t p = 0; p <= num_threads; ++p)
+    bounds[p] = num_tuples * p / num_threads;
+
+  uint32_t* order = this->order.data();
+  pool.parallel_for(num_threads, [&](size_t p) {
+    std::sort(order + bounds[p], order + bounds[p + 1], less);
+  });
+
+  std::vector<uint32_t> merged(num_tuples);
+  while (bounds.size() > 2) {
+    // Merge the partitions pairwise into `merged`. Each merge is split into
+    // `num_threads` parts, a partition without partner is copied.
+    const uint32_t* in = this->order.data();
+    uint32_t* out = merged.data();
+    size_t num_pairs = (bounds.size() - 1) / 2;
+    pool.parallel_for((num_pairs + 1) * num_threads, [&](size_t task) {
+      size_t pair = task / num_threads, part = task % num_threads;
+      size_t begin = bounds[2 * pair];
+      if (pair == num_pairs) {
+        if (bounds.size() % 2 == 0 && part == 0)
+          std::copy(in + begin, in + bounds.back(), out + begin);
+        return;
       }
-    }
 
-    this->isFinished = true;
+      size_t mid = bounds[2 * pair + 1], end = bounds[2 * pair + 2];
+      const uint32_t* a = in + begin;
+      const uint32_t* b = in + mid;
+      size_t a_size = mid - begin, b_size = end - mid;
+      size_t d1 = (a_size + b_size) * part / num_threads;
+      size_t d2 = (a_size + b_size) * (part + 1) / num_threads;
+      size_t i1 = merge_path(a, a_size, b, b_size, d1, less);
+      size_t i2 = merge_path(a, a_size, b, b_size, d2, less);
+      std::merge(a + i1, a + i2, b + (d1 - i1), b + (d2 - i2),
+                 out + begin + d1, less);
+    });
+
+    std::vector<size_t> merged_bounds;
+    for (size_t p = 0; p < bounds.size(); p += 2)
+      merged_bounds.push_back(bounds[p]);
+    if (merged_bounds.back() != bounds.back())
+      merged_bounds.push_back(bounds.back());
+    bounds = std::move(merged_bounds);
+    this->order.swap(merged);
   }
+}
 
-  if (minRegister) {
-    this->output_regs.emplace_back(*minRegister);
-    if (maxRegister) this->output_regs.emplace_back(*maxRegister);
-    return true;
-  }
+void Sort::spill_tuples(std::vector<std::unique_ptr<SpillFile>>& files) {
+  this->sort_tuples();
+  auto file = std::make_unique<SpillFile>();
+  for (uint32_t t : this->order)
+    file->write_tuple(&this->tuples[t * this->width], this->width);
+  file->rewind();
+
+  this->statistics.spilled_bytes += file->get_size();
+  this->statistics.num_runs++;
+  files.push_back(std::move(file));
+  this->tuples.clear();
+  this->keys.clear();
+  this->order.clear();
+}
 
-  if (this->counter < this->numberOfKeys) {
-    this->output_regs = this->temp_sumcount_registers[this->counter];
-    this->counter++;
-    return true;
+void Sort::read_run(Run& run) {
+  if (run.file->read_tuple(run.tuple.data(), this->width))
+    this->write_key(run.tuple.data(), run.key.data());
+  else
+    run.exhausted = true;
+}
+
+std::vector<Sort::Run> Sort::open_runs(
+    std::vector<std::unique_ptr<SpillFile>> files) {
+  std::vector<Run> runs(files.size());
+  for (size_t i = 0; i < files.size(); ++i) {
+    runs[i].file = std::move(files[i]);
+    runs[i].tuple.resize(this->width);
+    runs[i].key.resize(this->key_size());
+    this->read_run(runs[i]);
   }
+  return runs;
+}
 
-  return false;
-};
+bool Sort::run_less(const std::vector<Run>& runs, size_t a, size_t b,
+                    size_t key_size) {
+  if (runs[a].exhausted || runs[b].exhausted)
+    return !runs[a].exhausted || (runs[b].exhausted && a < b);
+  int cmp = std::memcmp(runs[a].key.data(), runs[b].key.data(), key_size);
+  return cmp < 0 || (cmp == 0 && a < b);
+}
 
-void HashAggregation::close() { this->input->close(); }
+std::unique_ptr<SpillFile> Sort::merge_files(
+    std::vector<std::unique_ptr<SpillFile>> files) {
+  std::vector<Run> runs = this->open_runs(std::move(files));
+  const size_t key_size = this->key_size();
+  auto less = [&runs, key_size](size_t a, size_t b) {
+    return run_less(runs, a, b, key_size);
+  };
+
+  auto file = std::make_unique<SpillFile>();
+  LoserTree tree;
+  tree.init(runs.size(), less);
+  while (!runs[tree.winner()].exhausted) {
+    Run& run = runs[tree.winner()];
+    file->write_tuple(run.tuple.data(), this->width);
+    this->read_run(run);
+    tree.replay(less);
+  }
+  file->rewind();
 
-std::vector<Register*> HashAggregation::get_output() {
-  std::vector<Register*> output;
-  for (auto& reg : this->output_regs) output.emplace_back(&reg);
-  return output;
+  this->statistics.spilled_bytes += file->get_size();
+  return file;
 }
 
-Union::Union(Operator& input_left, Operator& input_right)
-    : BinaryOperator(input_left, input_right) {}
+void Sort::sort_input() {
+  const size_t key_size = this->key_size();
+  std::vector<std::unique_ptr<SpillFile>> files;
+  Batch batch;
+  while (this->input->next_batch(batch)) {
+    this->width = batch.num_columns();
+    const size_t tuple_size =
+        this->width * sizeof(Register) + key_size + sizeof(uint32_t);
+    for (size_t i = 0; i < batch.size(); ++i) {
+      size_t row = batch.row(i);
+      for (size_t attr = 0; attr < this->width; ++attr)
+        this->tuples.emplace_back(batch.column(attr)[row]);
+
+      size_t offset = this->keys.size();
+      this->keys.resize(offset + key_size);
+      for (const auto& c : this->criteria) {
+        batch.column(c.attr_index)[row].write_sort_key(&this->keys[offset],
+                                                       c.desc);
+        offset += Register::SORT_KEY_SIZE;
+      }
 
-Union::~Union() = default;
+      size_t num_tuples = this->tuples.size() / this->width;
+      if (num_tuples * tuple_size >= this->options.memory_budget)
+        this->spill_tuples(files);
+    }
+  }
 
-void Union::open() {
-  this->input_left->open();
-  this->input_right->open();
+  if (files.empty()) {
+    this->sort_tuples();
+  } else {
+    if (!this->tuples.empty()) this->spill_tuples(files);
+
+    // Merge runs until one merge pass over all of them remains. The runs
+    // are merged in their input order, which keeps a stable sort stable.
+    while (files.size() > MERGE_FAN_IN) {
+      std::vector<std::unique_ptr<SpillFile>> merged;
+      for (size_t begin = 0; begin < files.size(); begin += MERGE_FAN_IN) {
+        size_t end = std::min(begin + MERGE_FAN_IN, files.size());
+        std::vector<std::unique_ptr<SpillFile>> group(
+            std::make_move_iterator(files.begin() + begin),
+            std::make_move_iterator(files.begin() + end));
+        if (group.size() == 1)
+          merged.push_back(std::move(group[0]));
+        else
+          merged.push_back(this->merge_files(std::move(group)));
+      }
+      files = std::move(merged);
+      this->statistics.num_merge_passes++;
+    }
+
+    this->runs = this->open_runs(std::move(files));
+    const auto& runs = this->runs;
+    this->merge_tree.init(runs.size(), [&runs, key_size](size_t a, size_t b) {
+      return run_less(runs, a, b, key_size);
+    });
+    this->statistics.num_merge_passes++;
+  }
 }
 
-bool Union::next() {
-  std::unordered_map<Register, int, RegisterHasher> registers_map;
+void Sort::collect_top_tuples(size_t k) {
+  // `order` is a max-heap of the best `k` tuples seen so far. Equal keys are
+  // ordered by the input position, so later tuples never replace earlier
+  // ones and the output is the one of a stable sort.
+  const size_t key_size = this->key_size();
+  std::vector<uint64_t> positions;
+  auto less = [this, key_size, &positions](uint32_t t1, uint32_t t2) {
+    int cmp = std::memcmp(&this->keys[t1 * key_size],
+                          &this->keys[t2 * key_size], key_size);
+    return cmp < 0 || (cmp == 0 && positions[t1] < positions[t2]);
+  };
+
+  std::vector<char> key(key_size);
+  uint64_t position = 0;
+  Batch batch;
+  while (k > 0 && this->input->next_batch(batch)) {
+    this->width = batch.num_columns();
+    for (size_t i = 0; i < batch.size(); ++i, ++position) {
+      size_t row = batch.row(i);
+      char* key_data = key.data();
+      for (const auto& c : this->criteria) {
+        batch.column(c.attr_index)[row].write_sort_key(key_data, c.desc);
+        key_data += Register::SORT_KEY_SIZE;
+      }
 
-  if (!this->isFinished) {
-    while (this->input_left->next()) {
-      std::vector<Register*> regs = this->input_left->get_output();
-      for (const auto& reg : regs) registers_map[*reg]++;
-    }
+      uint32_t slot;
+      if (this->order.size() < k) {
+        slot = static_cast<uint32_t>(this->order.size());
+        this->tuples.resize(this->tuples.size() + this->width);
+        this->keys.resize(this->keys.size() + key_size);
+        positions.push_back(0);
+      } else {
+        // The tuple is later than all tuples in the heap, so it only
+        // replaces the largest one when its key is smaller.
+        slot = this->order.front();
+        if (std::memcmp(key.data(), &this->keys[slot * key_size], key_size) >=
+            0)
+          continue;
+        std::pop_heap(this->order.begin(), this->order.end(), less);
+        this->order.pop_back();
+      }
 
-    while (this->input_right->next()) {
-      std::vector<Register*> regs = this->input_right->get_output();
-      for (const auto& reg : regs) registers_map[*reg]++;
+      for (size_t attr = 0; attr < this->width; ++attr)
+        this->tuples[slot * this->width + attr] = batch.column(attr)[row];
+      std::memcpy(&this->keys[slot * key_size], key.data(), key_size);
+      positions[slot] = position;
+      this->order.push_back(slot);
+      std::push_heap(this->order.begin(), this->order.end(), less);
     }
+  }
 
-    for (const auto& reg : registers_map)
-      this->registers.emplace_back(reg.first);
+  std::sort_heap(this->order.begin(), this->order.end(), less);
+}
 
-    std::sort(this->registers.begin(), this->registers.end(),
-              [&](const Register& a, const Register& b) { return a < b; });
-    this->isFinished = true;
+bool Sort::next_tuple() {
+  if (!this->runs.empty()) {
+    // The output points into the winning run, so it is only advanced when
+    // the next tuple is requested.
+    const size_t key_size = this->key_size();
+    const auto& runs = this->runs;
+    if (this->advance_winner) {
+      this->read_run(this->runs[this->merge_tree.winner()]);
+      this->merge_tree.replay([&runs, key_size](size_t a, size_t b) {
+        return run_less(runs, a, b, key_size);
+      });
+    }
+
+    Run& run = this->runs[this->merge_tree.winner()];
+    if (run.exhausted) return false;
+    for (size_t attr = 0; attr < this->width; ++attr)
+      this->output[attr] = &run.tuple[attr];
+    this->advance_winner = true;
+    return true;
   }
 
-  if (this->counter < static_cast<int>(this->registers.size())) {
-    this->output_regs.emplace_back(this->registers[this->counter]);
-    this->counter++;
+  if (this->current_index < this->order.size()) {
+    Register* tuple =
+        &this->tuples[this->order[this->current_index] * this->width];
+    for (size_t attr = 0; attr < this->width; ++attr)
+      this->output[attr] = &tuple[attr];
+    this->current_index++;
     return true;
   }
 
   return false;
 }
 
-std::vector<Register*> Union::get_output() {
-  std::vector<Register*> output;
-  for (auto& reg : this->output_regs) output.emplace_back(&reg);
-  this->output_regs.clear();
-  return output;
+bool Sort::next() {
+  if (!this->isFinished) {
+    // Only the first `offset + limit` tuples of the sorted input are needed.
+    const size_t limit = this->options.limit, offset = this->options.offset;
+    if (limit != NO_LIMIT && offset <= NO_LIMIT - limit)
+      this->collect_top_tuples(offset + limit);
+    else
+      this->sort_input();
+    this->output.resize(this->width);
+    this->isFinished = true;
+  }
+
+  for (; this->num_skipped < this->options.offset; ++this->num_skipped)
+    if (!this->next_tuple()) return false;
+  if (this->num_returned == this->options.limit || !this->next_tuple())
+    return false;
+  this->num_returned++;
+  return true;
 }
 
-void Union::close() {
-  this->input_left->close();
-  this->input_right->close();
+const std::vector<Register*>& Sort::get_output() { return this->output; }
+
+void Sort::close() {
+  this->runs.clear();
+  this->input->close();
+  this->pool.reset();
 }
 
-UnionAll::UnionAll(Operator& input_left, Operator& input_right)
-    : BinaryOperator(input_left, input_right) {}
+HashJoin::HashJoin(Operator& input_left, Operator& input_right,
+                   size_t attr_index_left, size_t attr_index_right)
+    : HashJoin(input_left, input_right, attr_index_left, attr_index_right,
+               Options{}) {}
 
-UnionAll::~UnionAll() = default;
+HashJoin::HashJoin(Operator& input_left, Operator& input_right,
+                   size_t attr_index_left, size_t attr_index_right,
+                   Options options)
+    : HashJoin(input_left, input_right, std::vector<size_t>{attr_index_left},
+               std::vector<size_t>{attr_index_right}, options) {}
 
-void UnionAll::open() {
-  this->input_left->open();
-  this->input_right->open();
+HashJoin::HashJoin(Operator& input_left, Operator& input_right,
+                   std::vector<size_t> attr_indexes_left,
+                   std::vector<size_t> attr_indexes_right)
+    : HashJoin(input_left, input_right, std::move(attr_indexes_left),
+               std::move(attr_indexes_right), Options{}) {}
+
+HashJoin::HashJoin(Operator& input_left, Operator& input_right,
+                   std::vector<size_t> attr_indexes_left,
+                   std::vector<size_t> attr_indexes_right, Options options)
+    : BinaryOperator(input_left, input_right),
+      key_left(std::move(attr_indexes_left)),
+      key_right(std::move(attr_indexes_right)),
+      options(options),
+      table(std::make_unique<JoinHashTable>()),
+      match(JoinHashTable::NONE),
+      left_key(key_left.size()),
+      right_key(key_right.size()) {
+  assert(this->key_left.size() == this->key_right.size());
 }
 
-bool UnionAll::next() {
-  std::unordered_map<Register, int, RegisterHasher> registers_map;
+HashJoin::~HashJoin() = default;
 
-  if (!this->isFinished) {
-    while (this->input_left->next()) {
-      std::vector<Register*> regs = this->input_left->get_output();
-      for (const auto& reg : regs) registers_map[*reg]++;
-    }
+size_t HashJoin::partition_of(uint64_t hash, size_t depth) {
+  // Mix the hash first (the finalizer of MurmurHash3), since integers hash
+  // to themselves.
+  hash ^= hash >> 33;
+  hash *= 0xff51afd7ed558ccdull;
+  hash ^= hash >> 33;
+  hash *= 0xc4ceb9fe1a85ec53ull;
+  hash ^= hash >> 33;
+  return (hash >> (depth * PARTITION_BITS)) & (NUM_PARTITIONS - 1);
+}
 
-    while (this->input_right->next()) {
-      std::vector<Register*> regs = this->input_right->get_output();
-      for (const auto& reg : regs) registers_map[*reg]++;
-    }
+uint64_t HashJoin::hash_left(const Register* tuple) {
+  this->key_left.gather(tuple, this->left_key.data());
+  return CompositeKey::hash(this->left_key.data(), this->left_key.size());
+}
 
-    for (const auto& reg : registers_map)
-      for (int i = 0; i < reg.second; i++)
-        this->registers.emplace_back(reg.first);
+uint64_t HashJoin::hash_right(const Register* tuple) {
+  this->key_right.gather(tuple, this->right_key.data());
+  return CompositeKey::hash(this->right_key.data(), this->right_key.size());
+}
 
-    std::sort(this->registers.begin(), this->registers.end(),
-              [&](const Register& a, const Register& b) { return a < b; });
-    this->isFinished = true;
+void HashJoin::add_left_tuple(const Register* tuple) {
+  const size_t tuple_memory =
+      JoinHashTable::memory_per_tuple(this->left_width, this->key_left.size());
+  if (this->partitioned) {
+    size_t partition = partition_of(this->hash_left(tuple), 0);
+    if (partition != 0 || !this->memory_partition) {
+      auto& file = this->left_files[partition];
+      if (!file) file = std::make_unique<SpillFile>();
+      file->write_tuple(tuple, this->left_width);
+      return;
+    }
   }
 
-  if (this->counter < static_cast<int>(this->registers.size())) {
-    this->output_regs.emplace_back(this->registers[this->counter]);
-    this->counter++;
-    return true;
-  }
+  std::copy(tuple, tuple + this->left_width, this->table->append_tuple());
+  if (this->table->get_num_tuples() * tuple_memory <=
+      this->options.memory_budget)
+    return;
 
-  return false;
+  if (!this->partitioned)
+    this->start_partitioning();
+  else
+    this->spill_memory_partition();
 }
 
-std::vector<Register*> UnionAll::get_output() {
-  std::vector<Register*> output;
-  for (auto& reg : this->output_regs) output.emplace_back(&reg);
-  this->output_regs.clear();
-  return output;
+void HashJoin::start_partitioning() {
+  this->partitioned = true;
+  this->memory_partition = true;
+  this->left_files.clear();
+  this->left_files.resize(NUM_PARTITIONS);
+  this->right_files.clear();
+  this->right_files.resize(NUM_PARTITIONS);
+
+  auto table = std::move(this->table);
+  this->table = std::make_unique<JoinHashTable>();
+  this->table->reset(this->left_width, this->key_left);
+  for (size_t t = 0; t < table->get_num_tuples(); ++t)
+    this->add_left_tuple(table->get_tuple(static_cast<uint32_t>(t)));
 }
 
-void UnionAll::close() {
-  this->input_left->close();
-  this->input_right->close();
+void HashJoin::spill_memory_partition() {
+  this->memory_partition = false;
+  auto table = std::move(this->table);
+  this->table = std::make_unique<JoinHashTable>();
+  this->table->reset(this->left_width, this->key_left);
+  for (size_t t = 0; t < table->get_num_tuples(); ++t)
+    this->add_left_tuple(table->get_tuple(static_cast<uint32_t>(t)));
 }
 
-Intersect::Intersect(Operator& input_left, Operator& input_right)
-    : BinaryOperator(input_left, input_right) {}
+bool HashJoin::preserves_left() const {
+  return this->options.join_type == JoinType::LEFT_OUTER ||
+         this->options.join_type == JoinType::FULL_OUTER ||
+         this->options.join_type == JoinType::LEFT_ANTI;
+}
 
-Intersect::~Intersect() = default;
+bool HashJoin::preserves_right() const {
+  return this->options.join_type == JoinType::RIGHT_OUTER ||
+         this->options.join_type == JoinType::FULL_OUTER;
+}
 
-void Intersect::open() {
-  this->input_left->open();
-  this->input_right->open();
+void HashJoin::collect_partitions(
+    std::vector<std::unique_ptr<SpillFile>>& left,
+    std::vector<std::unique_ptr<SpillFile>>& right, size_t depth) {
+  for (size_t p = 0; p < NUM_PARTITIONS; ++p) {
+    for (auto* file : {left[p].get(), right[p].get()}) {
+      if (!file) continue;
+      file->rewind();
+      this->statistics.spilled_bytes += file->get_size();
+    }
+    // Partitions without tuples on one side only have results when the
+    // tuples without partner of the other side are output.
+    if ((left[p] && (right[p] || this->preserves_left())) ||
+        (right[p] && this->preserves_right()))
+      this->partitions.push_back(
+          Partition{std::move(left[p]), std::move(right[p]), depth});
+  }
+  left.clear();
+  right.clear();
 }
 
-bool Intersect::next() {
-  std::unordered_map<Register, int, RegisterHasher> left_registers,
-      right_registers;
+void HashJoin::join_partition(Partition partition) {
+  const size_t tuple_memory =
+      JoinHashTable::memory_per_tuple(this->left_width, this->key_left.size());
+  std::vector<Register> tuple(std::max(this->left_width, this->right_width));
+
+  if (partition.left &&
+      partition.left->get_num_tuples() * tuple_memory >
+          this->options.memory_budget &&
+      partition.depth < MAX_PARTITIONING_DEPTH) {
+    // Partition both sides again with the next bits of the hash.
+    std::vector<std::unique_ptr<SpillFile>> left(NUM_PARTITIONS),
+        right(NUM_PARTITIONS);
+    auto repartition = [&](SpillFile& input, size_t width, bool left_side,
+                           std::vector<std::unique_ptr<SpillFile>>& files) {
+      while (input.read_tuple(tuple.data(), width)) {
+        uint64_t hash = left_side ? this->hash_left(tuple.data())
+                                  : this->hash_right(tuple.data());
+        auto& file = files[partition_of(hash, partition.depth)];
+        if (!file) file = std::make_unique<SpillFile>();
+        file->write_tuple(tuple.data(), width);
+      }
+    };
+    repartition(*partition.left, this->left_width, true, left);
+    if (partition.right)
+      repartition(*partition.right, this->right_width, false, right);
+    this->statistics.max_partitioning_depth = std::max(
+        this->statistics.max_partitioning_depth, partition.depth + 1);
+    this->collect_partitions(left, right, partition.depth + 1);
+    return;
+  }
 
-  if (!this->isFinished) {
-    while (this->input_left->next()) {
-      std::vector<Register*> regs = this->input_left->get_output();
-      for (const auto& reg : regs) left_registers[*reg]++;
+  this->table->reset(this->left_width, this->key_left);
+  while (partition.left &&
+         partition.left->read_tuple(tuple.data(), this->left_width))
+    std::copy(tuple.begin(), tuple.begin() + this->left_width,
+              this->table->append_tuple());
+  this->table->build();
+  this->matched.assign(this->table->get_num_tuples(), 0);
+  this->probing_partition = true;
+  this->probe_file = std::move(partition.right);
+  this->statistics.num_spilled_partitions++;
+}
+
+void HashJoin::open() {
+  input_left->open();
+  input_right->open();
+
+  this->partitioned = false;
+  this->right_exhausted = false;
+  this->draining = false;
+  this->probing_partition = false;
+  this->partitions.clear();
+  this->probe_file.reset();
+  // A join closed in the middle of a probe batch must not resume it.
+  this->probe_batch.reset(0);
+  this->probe_index = 0;
+  this->statistics = Statistics{};
+
+  Batch batch;
+  std::vector<Register> tuple;
+  while (input_left->next_batch(batch)) {
+    if (this->table->get_width() != batch.num_columns()) {
+      this->left_width = batch.num_columns();
+      this->table->reset(this->left_width, this->key_left);
+      tuple.resize(this->left_width);
     }
+    for (size_t i = 0; i < batch.size(); ++i) {
+      size_t row = batch.row(i);
+      for (size_t attr = 0; attr < this->left_width; ++attr)
+        tuple[attr] = batch.column(attr)[row];
+      this->add_left_tuple(tuple.data());
+    }
+  }
+  // Right tuples without partner must not be filtered when they are output.
+  if (!this->runtime_filters.empty() && !this->preserves_right())
+    this->publish_runtime_filters();
+
+  this->match = JoinHashTable::NONE;
+  this->parallel = !this->partitioned && this->options.num_threads > 1 &&
+                   this->options.join_type == JoinType::INNER;
+  if (this->parallel) {
+    this->join_parallel();
+    return;
+  }
+  this->table->build();
+  this->matched.assign(this->table->get_num_tuples(), 0);
+  if (this->partitioned) this->statistics.max_partitioning_depth = 1;
+}
 
-    while (this->input_right->next()) {
-      std::vector<Register*> regs = this->input_right->get_output();
-      for (const auto& reg : regs) right_registers[*reg]++;
+void HashJoin::add_runtime_filter(RuntimeFilter& filter) {
+  this->runtime_filters.push_back(&filter);
+}
+
+void HashJoin::publish_runtime_filters() {
+  size_t num_keys = this->table->get_num_tuples();
+  for (const auto& file : this->left_files)
+    if (file) num_keys += file->get_num_tuples();
+
+  auto bloom = std::make_shared<BloomFilter>(num_keys);
+  RuntimeFilter::Filter filter;
+  // Ranges are only kept for keys of a single attribute.
+  bool all_ints = this->key_left.size() == 1;
+  int64_t min = std::numeric_limits<int64_t>::max();
+  int64_t max = std::numeric_limits<int64_t>::min();
+  auto insert = [&](const Register* tuple) {
+    bloom->insert(this->hash_left(tuple));
+    const Register& key = this->left_key[0];
+    if (!all_ints || key.get_type() != Register::Type::INT64) {
+      all_ints = false;
+      return;
     }
+    min = std::min(min, key.as_int());
+    max = std::max(max, key.as_int());
+  };
+
+  for (size_t t = 0; t < this->table->get_num_tuples(); ++t)
+    insert(this->table->get_tuple(static_cast<uint32_t>(t)));
+  std::vector<Register> tuple(this->left_width);
+  for (const auto& file : this->left_files) {
+    if (!file) continue;
+    file->rewind();
+    while (file->read_tuple(tuple.data(), this->left_width))
+      insert(tuple.data());
+  }
+
+  filter.bloom = std::move(bloom);
+  filter.has_range = all_ints && num_keys > 0;
+  filter.min = min;
+  filter.max = max;
+  for (auto* runtime_filter : this->runtime_filters)
+    runtime_filter->set_filter(filter);
+}
 
-    for (const auto& reg : left_registers)
-      if (right_registers.find(reg.first) != right_registers.end())
-        this->registers.emplace_back(reg.first);
+/// The state of a parallel join: the partitioned left tuples in `table`,
+/// the partitioned chunk of right tuples which is currently joined, and the
+/// matches of the partitions which were joined last.
+struct HashJoin::ParallelJoin {
+  unsigned bits = 0;
+  radix::Partitions left_partitions;
+  /// Number of bytes of the budget left for a chunk of right tuples.
+  size_t chunk_budget = 0;
+  std::vector<Register> right_tuples;
+  radix::Partitions right_partitions;
+  /// The next partition of the chunk to join.
+  size_t next_partition = 0;
+  /// The matches of the partitions which were joined last, and the next
+  /// one to return.
+  std::vector<std::vector<radix::Match>> matches;
+  size_t match_partition = 0;
+  size_t match_index = 0;
+};
 
-    std::sort(this->registers.begin(), this->registers.end(),
-              [&](const Register& a, const Register& b) { return a < b; });
-    this->isFinished = true;
+void HashJoin::join_parallel() {
+  if (!this->pool)
+    this->pool = std::make_unique<ThreadPool>(this->options.num_threads);
+  this->parallel_join = std::make_unique<ParallelJoin>();
+  ParallelJoin& join = *this->parallel_join;
+
+  size_t num_left = this->table->get_num_tuples();
+  join.bits = radix::choose_radix_bits(num_left, this->left_width,
+                                       this->options.num_threads);
+  const Register* left = num_left ? this->table->get_tuple(0) : nullptr;
+  join.left_partitions = radix::partition(*this->pool, left, this->left_width,
+                                          num_left, this->key_left, join.bits);
+
+  size_t left_memory =
+      num_left * (JoinHashTable::memory_per_tuple(this->left_width,
+                                                  this->key_left.size()) +
+                  sizeof(radix::Entry));
+  join.chunk_budget = this->options.memory_budget > left_memory
+                          ? this->options.memory_budget - left_memory
+                          : 0;
+  // The first chunk tells the width of the right tuples. Without right
+  // tuples, no partition is left to join.
+  join.next_partition = size_t{1} << join.bits;
+  this->read_right_chunk();
+}
+
+bool HashJoin::read_right_chunk() {
+  ParallelJoin& join = *this->parallel_join;
+  join.right_tuples.clear();
+  // A chunk has at least one batch, even when the budget is used up.
+  while (!this->right_exhausted) {
+    if (!input_right->next_batch(this->probe_batch)) {
+      this->right_exhausted = true;
+      break;
+    }
+    this->right_width = this->probe_batch.num_columns();
+    for (size_t i = 0; i < this->probe_batch.size(); ++i) {
+      size_t row = this->probe_batch.row(i);
+      for (size_t attr = 0; attr < this->right_width; ++attr)
+        join.right_tuples.push_back(this->probe_batch.column(attr)[row]);
+    }
+    size_t num_right =
+        this->right_width ? join.right_tuples.size() / this->right_width : 0;
+    if (num_right * (this->right_width * sizeof(Register) +
+                     sizeof(radix::Entry)) >=
+        join.chunk_budget)
+      break;
   }
+  if (join.right_tuples.empty()) return false;
+
+  size_t num_right = join.right_tuples.size() / this->right_width;
+  join.right_partitions =
+      radix::partition(*this->pool, join.right_tuples.data(),
+                       this->right_width, num_right, this->key_right,
+                       join.bits);
+  join.next_partition = 0;
+  return true;
+}
 
-  if (this->counter < static_cast<int>(this->registers.size())) {
-    this->output_regs.emplace_back(this->registers[this->counter]);
-    this->counter++;
-    return true;
+const std::pair<uint32_t, uint32_t>* HashJoin::next_parallel_match() {
+  ParallelJoin& join = *this->parallel_join;
+  while (true) {
+    while (join.match_partition < join.matches.size()) {
+      const auto& partition = join.matches[join.match_partition];
+      if (join.match_index < partition.size())
+        return &partition[join.match_index++];
+      join.match_partition++;
+      join.match_index = 0;
+    }
+
+    const size_t num_partitions = size_t{1} << join.bits;
+    if (join.next_partition == num_partitions && !this->read_right_chunk())
+      return nullptr;
+
+    // Only the matches of the partitions joined at a time are kept.
+    size_t count = std::min(num_partitions - join.next_partition,
+                            radix::PARTITIONS_PER_THREAD *
+                                this->options.num_threads);
+    const Register* left =
+        this->table->get_num_tuples() ? this->table->get_tuple(0) : nullptr;
+    radix::join(*this->pool, left, this->left_width, this->key_left,
+                join.left_partitions, join.right_tuples.data(),
+                this->right_width, this->key_right, join.right_partitions,
+                join.next_partition, count, join.matches);
+    join.next_partition += count;
+    join.match_partition = 0;
+    join.match_index = 0;
   }
+}
 
-  return false;
+Register* HashJoin::parallel_right_tuple(uint32_t tuple) {
+  return &this->parallel_join->right_tuples[tuple * this->right_width];
 }
 
-std::vector<Register*> Intersect::get_output() {
-  std::vector<Register*> output;
-  for (auto& reg : this->output_regs) output.emplace_back(&reg);
-  this->output_regs.clear();
-  return output;
+HashJoin::Probe HashJoin::probe_next() {
+  while (true) {
+    if (this->probing_partition) {
+      if (this->probe_file &&
+          this->probe_file->read_tuple(this->right_tuple.data(),
+                                       this->right_width)) {
+        this->probe_tuple = &this->right_tuple_output;
+        uint64_t hash = this->hash_right(this->right_tuple.data());
+        this->match = this->table->find(this->right_key.data(), hash);
+        return Probe::TUPLE;
+      }
+      this->probe_file.reset();
+      this->probing_partition = false;
+      return Probe::TABLE_DONE;
+    }
+
+    if (!this->right_exhausted) {
+      if (!input_right->next()) {
+        this->right_exhausted = true;
+        if (this->partitioned)
+          this->collect_partitions(this->left_files, this->right_files, 1);
+        return Probe::TABLE_DONE;
+      }
+
+      const auto& inputs = input_right->get_output();
+      this->key_right.gather(inputs, this->right_key.data());
+      uint64_t hash =
+          CompositeKey::hash(this->right_key.data(), this->right_key.size());
+      this->right_width = inputs.size();
+      if (this->partitioned) {
+        size_t partition = partition_of(hash, 0);
+        if (partition != 0 || !this->memory_partition) {
+          // Right tuples are only spilled when they can have results.
+          if (this->left_files[partition] || this->preserves_right()) {
+            auto& file = this->right_files[partition];
+            if (!file) file = std::make_unique<SpillFile>();
+            file->write_tuple(inputs);
+          }
+          continue;
+        }
+      }
+
+      this->probe_tuple = &inputs;
+      this->match = this->table->find(this->right_key.data(), hash);
+      return Probe::TUPLE;
+    }
+
+    if (this->partitions.empty()) return Probe::DONE;
+    Partition partition = std::move(this->partitions.back());
+    this->partitions.pop_back();
+    this->right_tuple.resize(this->right_width);
+    this->right_tuple_output.resize(this->right_width);
+    for (size_t attr = 0; attr < this->right_width; ++attr)
+      this->right_tuple_output[attr] = &this->right_tuple[attr];
+    this->join_partition(std::move(partition));
+  }
+}
+
+void HashJoin::output_match() {
+  // The right registers stay valid while the matches of the current right
+  // tuple are output, since the right input is not advanced meanwhile.
+  const auto& inputs = *this->probe_tuple;
+  const bool semi = this->options.join_type == JoinType::LEFT_SEMI;
+  Register* left_tuple = this->table->get_tuple(this->match);
+  this->output.resize(this->left_width + (semi ? 0 : inputs.size()));
+  for (size_t i = 0; i < this->left_width; i++)
+    this->output[i] = &left_tuple[i];
+  if (!semi)
+    std::copy(inputs.begin(), inputs.end(),
+              this->output.begin() + this->left_width);
+  this->matched[this->match] = 1;
+  this->match = this->table->next_match(this->match);
+}
+
+bool HashJoin::output_unmatched_left() {
+  const size_t num_tuples = this->table->get_num_tuples();
+  while (this->unmatched_index < num_tuples &&
+         this->matched[this->unmatched_index])
+    this->unmatched_index++;
+  if (this->unmatched_index == num_tuples) return false;
+
+  const size_t right_width =
+      this->options.join_type == JoinType::LEFT_ANTI ? 0 : this->right_width;
+  this->null_tuple.resize(std::max(this->null_tuple.size(), right_width),
+                          Register::null());
+  Register* left_tuple =
+      this->table->get_tuple(static_cast<uint32_t>(this->unmatched_index++));
+  this->output.resize(this->left_width + right_width);
+  for (size_t i = 0; i < this->left_width; i++)
+    this->output[i] = &left_tuple[i];
+  for (size_t i = 0; i < right_width; i++)
+    this->output[this->left_width + i] = &this->null_tuple[i];
+  return true;
+}
+
+void HashJoin::output_unmatched_right() {
+  const auto& inputs = *this->probe_tuple;
+  this->null_tuple.resize(std::max(this->null_tuple.size(), this->left_width),
+                          Register::null());
+  this->output.resize(this->left_width + inputs.size());
+  for (size_t i = 0; i < this->left_width; i++)
+    this->output[i] = &this->null_tuple[i];
+  std::copy(inputs.begin(), inputs.end(),
+            this->output.begin() + this->left_width);
+}
+
+bool HashJoin::next() {
+  if (this->parallel) {
+    const auto* match = this->next_parallel_match();
+    if (!match) return false;
+    Register* left_tuple = this->table->get_tuple(match->first);
+    Register* right_tuple = this->parallel_right_tuple(match->second);
+    this->output.resize(this->left_width + this->right_width);
+    for (size_t i = 0; i < this->left_width; i++)
+      this->output[i] = &left_tuple[i];
+    for (size_t i = 0; i < this->right_width; i++)
+      this->output[this->left_width + i] = &right_tuple[i];
+    return true;
+  }
+
+  while (true) {
+    if (this->draining) {
+      if (this->output_unmatched_left()) return true;
+      this->draining = false;
+    }
+
+    if (this->match != JoinHashTable::NONE) {
+      this->output_match();
+      return true;
+    }
+
+    switch (this->probe_next()) {
+      case Probe::DONE:
+        return false;
+
+      case Probe::TABLE_DONE:
+        // All right tuples which can match the current hash table are
+        // probed, so the unmarked left tuples have no partner.
+        if (this->preserves_left()) {
+          this->draining = true;
+          this->unmatched_index = 0;
+        }
+        break;
+
+      case Probe::TUPLE:
+        if (this->match == JoinHashTable::NONE) {
+          if (this->preserves_right()) {
+            this->output_unmatched_right();
+            return true;
+          }
+          break;
+        }
+
+        if (this->options.join_type == JoinType::LEFT_SEMI ||
+            this->options.join_type == JoinType::LEFT_ANTI) {
+          // All tuples of a key are marked on its first match, so later
+          // matches of the key are skipped right away.
+          if (this->matched[this->match]) {
+            this->match = JoinHashTable::NONE;
+          } else if (this->options.join_type == JoinType::LEFT_ANTI) {
+            for (; this->match != JoinHashTable::NONE;
+                 this->match = this->table->next_match(this->match))
+              this->matched[this->match] = 1;
+          }
+        }
+        break;
+    }
+  }
 }
 
-void Intersect::close() {
+void HashJoin::close() {
   this->input_left->close();
   this->input_right->close();
+  this->table->reset(0, CompositeKey{});
+  this->left_files.clear();
+  this->right_files.clear();
+  this->partitions.clear();
+  this->probe_file.reset();
+  this->parallel_join.reset();
 }
 
-IntersectAll::IntersectAll(Operator& input_left, Operator& input_right)
-    : BinaryOperator(input_left, input_right) {}
+const std::vector<Register*>& HashJoin::get_output() { return this->output; }
+
+bool HashJoin::next_batch(Batch& batch) {
+  // Partitioned joins read their spilled tuples one at a time, and only
+  // inner joins are vectorized.
+  if (this->partitioned ||
+      (!this->parallel && this->options.join_type != JoinType::INNER))
+    return Operator::next_batch(batch);
+
+  if (this->parallel) {
+    batch.reset(this->left_width + this->right_width);
+    const std::pair<uint32_t, uint32_t>* match;
+    while (!batch.full() && (match = this->next_parallel_match())) {
+      size_t row = batch.append_row();
+      const Register* left_tuple = this->table->get_tuple(match->first);
+      const Register* right_tuple = this->parallel_right_tuple(match->second);
+      for (size_t attr = 0; attr < this->left_width; ++attr)
+        batch.column(attr)[row] = left_tuple[attr];
+      for (size_t attr = 0; attr < this->right_width; ++attr)
+        batch.column(this->left_width + attr)[row] = right_tuple[attr];
+    }
+    return batch.size() > 0;
+  }
 
-IntersectAll::~IntersectAll() = default;
+  batch.reset(0);
+
+  while (!batch.full()) {
+    if (this->match == JoinHashTable::NONE &&
+        this->probe_index == this->probe_batch.size()) {
+      this->probe_index = 0;
+      if (!input_right->next_batch(this->probe_batch)) break;
+
+      // Gather and hash all keys first and prefetch their directory slots,
+      // so the cache misses of the probes below overlap.
+      const size_t key_size = this->key_right.size();
+      this->probe_keys.resize(this->probe_batch.size() * key_size);
+      this->probe_hashes.resize(this->probe_batch.size());
+      for (size_t i = 0; i < this->probe_batch.size(); ++i) {
+        Register* key = &this->probe_keys[i * key_size];
+        this->key_right.gather(this->probe_batch, this->probe_batch.row(i),
+                               key);
+        this->probe_hashes[i] = CompositeKey::hash(key, key_size);
+        this->table->prefetch(this->probe_hashes[i]);
+      }
+    }
 
-void IntersectAll::open() {
-  this->input_left->open();
-  this->input_right->open();
+    size_t right_width = this->probe_batch.num_columns();
+    if (batch.num_rows() == 0) batch.reset(this->left_width + right_width);
+
+    while (!batch.full()) {
+      if (this->match == JoinHashTable::NONE) {
+        if (this->probe_index == this->probe_batch.size()) break;
+        this->probe_row = this->probe_batch.row(this->probe_index);
+        this->match = this->table->find(
+            &this->probe_keys[this->probe_index * this->key_right.size()],
+            this->probe_hashes[this->probe_index]);
+        this->probe_index++;
+        continue;
+      }
+
+      size_t row = batch.append_row();
+      const Register* left_tuple = this->table->get_tuple(this->match);
+      for (size_t attr = 0; attr < this->left_width; ++attr)
+        batch.column(attr)[row] = left_tuple[attr];
+      for (size_t attr = 0; attr < right_width; ++attr)
+        batch.column(this->left_width + attr)[row] =
+            this->probe_batch.column(attr)[this->probe_row];
+      this->match = this->table->next_match(this->match);
+    }
+  }
+
+  return batch.size() > 0;
 }
 
-bool IntersectAll::next() {
-  std::unordered_map<Register, int, RegisterHasher> left_registers,
-      right_registers;
+HashAggregation::HashAggregation(Operator& input,
+                                 std::vector<size_t> group_by_attrs,
+                                 std::vector<AggrFunc> aggr_funcs)
+    : HashAggregation(input, std::move(group_by_attrs), std::move(aggr_funcs),
+                      Options{}) {}
 
-  if (!this->isFinished) {
-    while (this->input_left->next()) {
-      std::vector<Register*> regs = this->input_left->get_output();
-      for (const auto& reg : regs) left_registers[*reg]++;
+HashAggregation::HashAggregation(Operator& input,
+                                 std::vector<size_t> group_by_attrs,
+                                 std::vector<AggrFunc> aggr_funcs,
+                                 Options options)
+    : UnaryOperator(input),
+      group_key(std::move(group_by_attrs)),
+      aggr_funcs(std::move(aggr_funcs)),
+      options(options),
+      partial_input(this->aggr_funcs.size(), false) {
+  auto distinct = std::find_if(
+      this->aggr_funcs.begin(), this->aggr_funcs.end(),
+      [](const AggrFunc& f) { return f.func == AggrFunc::COUNT_DISTINCT; });
+  if (distinct != this->aggr_funcs.end()) {
+    // The input is grouped by the group by attributes and the counted
+    // attribute, with the other aggregates computed as partial states.
+    // The output of that aggregation has the group by attributes first, so
+    // this one groups on them, counts the non-NULL values of the counted
+    // attribute, and merges the partial states.
+    const size_t distinct_attr = distinct->attr_index;
+    const size_t key_size = this->group_key.size();
+    std::vector<size_t> distinct_group_by = this->group_key.get_attrs();
+    distinct_group_by.push_back(distinct_attr);
+    std::vector<AggrFunc> partial_funcs;
+    for (const auto& aggr_func : this->aggr_funcs) {
+      if (aggr_func.func != AggrFunc::COUNT_DISTINCT)
+        partial_funcs.push_back(aggr_func);
+      else if (aggr_func.attr_index != distinct_attr)
+        throw std::runtime_error(
+            "COUNT_DISTINCT aggregates must be on the same attribute");
     }
 
-    while (this->input_right->next()) {
-      std::vector<Register*> regs = this->input_right->get_output();
-      for (const auto& reg : regs) right_registers[*reg]++;
+    // Both aggregations hold their groups at the same time, and the groups
+    // of the other one are not ordered.
+    this->options.memory_budget /= 2;
+    this->options.ordered_input = false;
+    this->distinct_groups = std::make_unique<HashAggregation>(
+        input, std::move(distinct_group_by), std::move(partial_funcs),
+        this->options);
+    this->distinct_groups->partial_output = true;
+    this->input = this->distinct_groups.get();
+
+    std::vector<size_t> attrs;
+    for (size_t attr = 0; attr < key_size; ++attr) attrs.push_back(attr);
+    this->group_key = CompositeKey{std::move(attrs)};
+    size_t partial_aggr = 0;
+    for (size_t aggr = 0; aggr < this->aggr_funcs.size(); ++aggr) {
+      if (this->aggr_funcs[aggr].func == AggrFunc::COUNT_DISTINCT) {
+        this->aggr_funcs[aggr].attr_index = key_size;
+      } else {
+        this->aggr_funcs[aggr].attr_index =
+            this->distinct_groups->state_offsets[partial_aggr++];
+        this->partial_input[aggr] = true;
+      }
     }
+  }
 
-    for (const auto& reg : left_registers) {
-      auto find = right_registers.find(reg.first);
-      if (find != right_registers.end()) {
-        auto leftCount = reg.second, rightCount = find->second;
-        if (leftCount <= rightCount)
-          for (int i = 0; i < leftCount; i++)
-            this->registers.emplace_back(reg.first);
-        else
-          for (int i = 0; i < rightCount; i++)
-            this->registers.emplace_back(find->first);
-      }
+  this->row_width = this->group_key.size();
+  for (const auto& aggr_func : this->aggr_funcs) {
+    this->state_offsets.push_back(this->row_width);
+    this->row_width += state_size(aggr_func.func);
+  }
+  this->initial_state.resize(this->row_width - this->group_key.size(),
+                             Register::null());
+  for (size_t aggr = 0; aggr < this->aggr_funcs.size(); ++aggr) {
+    Register* state = &this->initial_state[this->state_offsets[aggr] -
+                                           this->group_key.size()];
+    switch (this->aggr_funcs[aggr].func) {
+      case AggrFunc::COUNT:
+      case AggrFunc::COUNT_DISTINCT:
+        state[0] = Register::from_int(0);
+        break;
+
+      case AggrFunc::AVG:
+        // The sum and the count.
+        state[1] = Register::from_int(0);
+        break;
+
+      case AggrFunc::APPROX_COUNT_DISTINCT:
+        HyperLogLog::init(state);
+        break;
+
+      case AggrFunc::APPROX_QUANTILE:
+        QuantileSketch::init(state);
+        break;
+
+      default:
+        break;
     }
+  }
+}
 
-    std::sort(this->registers.begin(), this->registers.end(),
-              [&](const Register& a, const Register& b) { return a < b; });
-    this->isFinished = true;
+HashAggregation::~HashAggregation() = default;
+
+size_t HashAggregation::state_size(AggrFunc::Func func) {
+  switch (func) {
+    case AggrFunc::AVG:
+      return 2;
+    case AggrFunc::APPROX_COUNT_DISTINCT:
+      return HyperLogLog::STATE_SIZE;
+    case AggrFunc::APPROX_QUANTILE:
+      return QuantileSketch::STATE_SIZE;
+    default:
+      return 1;
   }
+}
 
-  if (this->counter < static_cast<int>(this->registers.size())) {
-    this->output_regs.emplace_back(this->registers[this->counter]);
-    this->counter++;
-    return true;
+void HashAggregation::open() {
+  this->input->open();
+  this->tables.clear();
+  this->tables.push_back(std::make_unique<AggregationHashTable>());
+  this->tables[0]->reset(this->group_key.size(), this->row_width);
+  this->pool = std::make_unique<ThreadPool>(this->options.num_threads);
+  this->spill_files.clear();
+  this->partitions.clear();
+  this->statistics = Statistics{};
+  this->isFinished = false;
+  this->output_table = 0;
+  this->next_group = 0;
+  this->results.resize(this->aggr_funcs.size());
+  this->group_row.resize(this->row_width);
+  this->output_row.resize(this->row_width);
+  this->has_group = false;
+  this->input_batch.reset(0);
+  this->input_pos = 0;
+}
+
+Register* HashAggregation::find_group(AggregationHashTable& table,
+                                      const Register* key,
+                                      uint64_t hash) const {
+  auto [row, inserted] = table.insert(key, hash);
+  if (inserted)
+    std::copy(this->initial_state.begin(), this->initial_state.end(),
+              row + this->group_key.size());
+  return row;
+}
+
+namespace {
+
+/// Adds `value` to the sum in `sum`, which is NULL before the first value.
+inline void add_to_sum(Register* sum, const Register& value) {
+  int64_t result = value.as_int();
+  if (!sum->is_null() &&
+      __builtin_add_overflow(sum->as_int(), value.as_int(), &result))
+    throw std::overflow_error("SUM exceeds the range of int64_t");
+  *sum = Register::from_int(result);
+}
+
+/// The maximum number of registers of the state of an aggregate.
+constexpr size_t MAX_STATE_SIZE =
+    std::max(HyperLogLog::STATE_SIZE, QuantileSketch::STATE_SIZE);
+
+}  // namespace
+
+void HashAggregation::update(size_t aggr, Register* state,
+                             const Register& value) const {
+  if (value.is_null()) return;
+  switch (this->aggr_funcs[aggr].func) {
+    case AggrFunc::MIN:
+      if (state->is_null() || value < *state) *state = value;
+      break;
+
+    case AggrFunc::MAX:
+      if (state->is_null() || value > *state) *state = value;
+      break;
+
+    case AggrFunc::SUM:
+      add_to_sum(state, value);
+      break;
+
+    case AggrFunc::COUNT:
+    // The values of COUNT_DISTINCT are the distinct groups, see
+    // `distinct_groups`.
+    case AggrFunc::COUNT_DISTINCT:
+      *state = Register::from_int(state->as_int() + 1);
+      break;
+
+    case AggrFunc::AVG:
+      add_to_sum(&state[0], value);
+      state[1] = Register::from_int(state[1].as_int() + 1);
+      break;
+
+    case AggrFunc::APPROX_COUNT_DISTINCT:
+      HyperLogLog::add(state, value.get_hash());
+      break;
+
+    case AggrFunc::APPROX_QUANTILE:
+      QuantileSketch::add(state, value.as_int());
+      break;
   }
+}
 
-  return false;
+void HashAggregation::merge(size_t aggr, Register* state,
+                            const Register* partial) const {
+  switch (this->aggr_funcs[aggr].func) {
+    case AggrFunc::COUNT:
+    case AggrFunc::COUNT_DISTINCT:
+      *state = Register::from_int(state->as_int() + partial->as_int());
+      break;
+
+    case AggrFunc::AVG:
+      if (!partial[0].is_null()) add_to_sum(&state[0], partial[0]);
+      state[1] = Register::from_int(state[1].as_int() + partial[1].as_int());
+      break;
+
+    case AggrFunc::APPROX_COUNT_DISTINCT:
+      HyperLogLog::merge(state, partial);
+      break;
+
+    case AggrFunc::APPROX_QUANTILE:
+      QuantileSketch::merge(state, partial);
+      break;
+
+    default:
+      // Partial minimums, maximums and sums are merged like values.
+      this->update(aggr, state, *partial);
+      break;
+  }
 }
 
-std::vector<Register*> IntersectAll::get_output() {
-  std::vector<Register*> output;
-  for (auto& reg : this->output_regs) output.emplace_back(&reg);
-  this->output_regs.clear();
-  return output;
+template <typename Values>
+void HashAggregation::update_group(Register* row, const Values& values) const {
+  if (!this->distinct_groups) {
+    for (size_t aggr = 0; aggr < this->aggr_funcs.size(); ++aggr)
+      this->update(aggr, &row[this->state_offsets[aggr]],
+                   values(this->aggr_funcs[aggr].attr_index));
+    return;
+  }
+
+  for (size_t aggr = 0; aggr < this->aggr_funcs.size(); ++aggr) {
+    Register* state = &row[this->state_offsets[aggr]];
+    const size_t attr = this->aggr_funcs[aggr].attr_index;
+    if (!this->partial_input[aggr]) {
+      this->update(aggr, state, values(attr));
+      continue;
+    }
+
+    Register partial[MAX_STATE_SIZE];
+    const size_t size = state_size(this->aggr_funcs[aggr].func);
+    for (size_t i = 0; i < size; ++i) partial[i] = values(attr + i);
+    this->merge(aggr, state, partial);
+  }
 }
 
-void IntersectAll::close() {
-  this->input_left->close();
-  this->input_right->close();
+Register HashAggregation::finalize(size_t aggr, const Register* state) const {
+  switch (this->aggr_funcs[aggr].func) {
+    case AggrFunc::AVG:
+      if (state[1].as_int() == 0) return Register::null();
+      return Register::from_int(state[0].as_int() / state[1].as_int());
+
+    case AggrFunc::APPROX_COUNT_DISTINCT:
+      return Register::from_int(
+          static_cast<int64_t>(HyperLogLog::estimate(state)));
+
+    case AggrFunc::APPROX_QUANTILE:
+      if (QuantileSketch::empty(state)) return Register::null();
+      return Register::from_int(std::llround(
+          QuantileSketch::quantile(state, this->aggr_funcs[aggr].quantile)));
+
+    default:
+      return *state;
+  }
 }
 
-Except::Except(Operator& input_left, Operator& input_right)
-    : BinaryOperator(input_left, input_right) {}
+size_t HashAggregation::max_groups(size_t memory_budget) const {
+  return std::max<size_t>(
+      1, memory_budget /
+             AggregationHashTable::memory_per_group(this->row_width));
+}
 
-Except::~Except() = default;
+void HashAggregation::spill_table(
+    AggregationHashTable& table, std::vector<std::unique_ptr<SpillFile>>& files,
+    size_t depth) const {
+  if (files.empty()) files.resize(NUM_PARTITIONS);
+  for (size_t group = 0; group < table.get_num_groups(); ++group) {
+    auto& file = files[partition_of(table.get_hash(group), depth)];
+    if (!file) file = std::make_unique<SpillFile>();
+    file->write_tuple(table.get_row(group), table.get_row_width());
+  }
+  table.clear();
+}
 
-void Except::open() {
-  this->input_left->open();
-  this->input_right->open();
+void HashAggregation::aggregate_tuples() {
+  const size_t key_size = this->group_key.size();
+  const size_t max_groups = this->max_groups(this->options.memory_budget);
+  AggregationHashTable& table = *this->tables[0];
+  this->keys.resize(key_size);
+  while (this->input->next()) {
+    const auto& regs = this->input->get_output();
+    this->group_key.gather(regs, this->keys.data());
+    Register* group =
+        this->find_group(table, this->keys.data(),
+                         CompositeKey::hash(this->keys.data(), key_size));
+    this->update_group(
+        group, [&](size_t attr) -> const Register& { return *regs[attr]; });
+    if (table.get_num_groups() > max_groups)
+      this->spill_table(table, this->spill_files, 0);
+  }
 }
 
-bool Except::next() {
-  std::unordered_map<Register, int, RegisterHasher> left_registers,
-      right_registers;
+void HashAggregation::aggregate_batches(Batch& batch) {
+  const size_t key_size = this->group_key.size();
+  const size_t max_groups = this->max_groups(this->options.memory_budget);
+  AggregationHashTable& table = *this->tables[0];
+  while (this->input->next_batch(batch)) {
+    // Gather and hash all keys first and prefetch their directory slots, so
+    // the cache misses of the lookups below overlap. Keys without attributes
+    // are empty, so they are addressed by pointer, not by element.
+    const size_t count = batch.size();
+    this->keys.resize(count * key_size);
+    this->hashes.resize(count);
+    for (size_t i = 0; i < count; ++i) {
+      Register* key = this->keys.data() + i * key_size;
+      this->group_key.gather(batch, batch.row(i), key);
+      this->hashes[i] = CompositeKey::hash(key, key_size);
+      table.prefetch(this->hashes[i]);
+    }
 
-  if (!this->isFinished) {
-    while (this->input_left->next()) {
-      std::vector<Register*> regs = this->input_left->get_output();
-      for (const auto& reg : regs) left_registers[*reg]++;
+    for (size_t i = 0; i < count; ++i) {
+      Register* group = this->find_group(
+          table, this->keys.data() + i * key_size, this->hashes[i]);
+      size_t row = batch.row(i);
+      this->update_group(group, [&](size_t attr) -> const Register& {
+        return batch.column(attr)[row];
+      });
+      if (table.get_num_groups() > max_groups)
+        this->spill_table(table, this->spill_files, 0);
     }
+  }
+}
+
+size_t HashAggregation::partition_of(uint64_t hash, size_t depth) {
+  // Mix the hash first (the finalizer of MurmurHash3), since integers hash
+  // to themselves and the tables use the high bits of the hash.
+  hash ^= hash >> 33;
+  hash *= 0xff51afd7ed558ccdull;
+  hash ^= hash >> 33;
+  hash *= 0xc4ceb9fe1a85ec53ull;
+  hash ^= hash >> 33;
+  return (hash >> (depth * PARTITION_BITS)) & (NUM_PARTITIONS - 1);
+}
 
-    while (this->input_right->next()) {
-      std::vector<Register*> regs = this->input_right->get_output();
-      for (const auto& reg : regs) right_registers[*reg]++;
+void HashAggregation::preaggregate(LocalState& state,
+                                   const Batch& batch) const {
+  const size_t key_size = this->group_key.size();
+  const size_t row_width = this->row_width;
+  const size_t count = batch.size();
+  state.keys.resize(count * key_size);
+  state.hashes.resize(count);
+  for (size_t i = 0; i < count; ++i) {
+    Register* key = state.keys.data() + i * key_size;
+    this->group_key.gather(batch, batch.row(i), key);
+    state.hashes[i] = CompositeKey::hash(key, key_size);
+    if (!state.passthrough) state.table->prefetch(state.hashes[i]);
+  }
+
+  for (size_t i = 0; i < count; ++i) {
+    const Register* key = state.keys.data() + i * key_size;
+    Register* group;
+    if (state.passthrough) {
+      // The tuple becomes a partial group of its own.
+      auto& partial = state.partitions[partition_of(state.hashes[i], 0)];
+      partial.rows.resize(partial.rows.size() + row_width);
+      group = &partial.rows[partial.rows.size() - row_width];
+      std::copy(key, key + key_size, group);
+      std::copy(this->initial_state.begin(), this->initial_state.end(),
+                group + key_size);
+      partial.hashes.push_back(state.hashes[i]);
+      state.num_partial_groups++;
+      state.num_buffered_groups++;
+    } else {
+      group = this->find_group(*state.table, key, state.hashes[i]);
     }
 
-    for (const auto& reg : left_registers)
-      if (right_registers.find(reg.first) == right_registers.end())
-        this->registers.emplace_back(reg.first);
+    size_t row = batch.row(i);
+    this->update_group(group, [&](size_t attr) -> const Register& {
+      return batch.column(attr)[row];
+    });
+    state.num_tuples++;
+    if (!state.passthrough &&
+        state.table->get_num_groups() == MAX_LOCAL_GROUPS)
+      this->flush(state);
+    if (state.num_buffered_groups > state.max_buffered_groups)
+      this->spill_partitions(state);
+  }
+}
 
-    std::sort(this->registers.begin(), this->registers.end(),
-              [&](const Register& a, const Register& b) { return a < b; });
-    this->isFinished = true;
+void HashAggregation::flush(LocalState& state) const {
+  AggregationHashTable& table = *state.table;
+  const size_t row_width = table.get_row_width();
+  for (size_t group = 0; group < table.get_num_groups(); ++group) {
+    auto& partial = state.partitions[partition_of(table.get_hash(group), 0)];
+    const Register* row = table.get_row(group);
+    partial.rows.insert(partial.rows.end(), row, row + row_width);
+    partial.hashes.push_back(table.get_hash(group));
   }
+  state.num_partial_groups += table.get_num_groups();
+  state.num_buffered_groups += table.get_num_groups();
+  table.clear();
 
-  if (this->counter < static_cast<int>(this->registers.size())) {
-    this->output_regs.emplace_back(this->registers[this->counter]);
-    this->counter++;
-    return true;
+  // Pre-aggregation which merges less than two tuples per group on average
+  // costs more than it saves in the second phase.
+  if (2 * state.num_partial_groups > state.num_tuples) state.passthrough = true;
+}
+
+void HashAggregation::spill_partitions(LocalState& state) const {
+  const size_t row_width = this->row_width;
+  if (state.files.empty()) state.files.resize(NUM_PARTITIONS);
+  for (size_t p = 0; p < NUM_PARTITIONS; ++p) {
+    auto& partial = state.partitions[p];
+    if (partial.hashes.empty()) continue;
+    auto& file = state.files[p];
+    if (!file) file = std::make_unique<SpillFile>();
+    for (size_t i = 0; i < partial.hashes.size(); ++i)
+      file->write_tuple(&partial.rows[i * row_width], row_width);
+    partial.rows.clear();
+    partial.hashes.clear();
   }
+  state.num_buffered_groups = 0;
+}
 
-  return false;
+void HashAggregation::merge_group(AggregationHashTable& table,
+                                  const Register* partial,
+                                  uint64_t hash) const {
+  const size_t key_size = this->group_key.size();
+  auto [row, inserted] = table.insert(partial, hash);
+  if (inserted) {
+    std::copy(partial + key_size, partial + table.get_row_width(),
+              row + key_size);
+    return;
+  }
+  for (size_t aggr = 0; aggr < this->aggr_funcs.size(); ++aggr)
+    this->merge(aggr, &row[this->state_offsets[aggr]],
+                &partial[this->state_offsets[aggr]]);
+}
+
+void HashAggregation::aggregate_parallel() {
+  const size_t key_size = this->group_key.size();
+  const size_t row_width = this->row_width;
+  ThreadPool& pool = *this->pool;
+  std::vector<LocalState> states(pool.get_num_threads());
+  for (auto& state : states) {
+    state.table = std::make_unique<AggregationHashTable>();
+    state.table->reset(key_size, row_width);
+    state.partitions.resize(NUM_PARTITIONS);
+    state.max_buffered_groups =
+        this->max_groups(this->options.memory_budget / states.size());
+  }
+
+  // First phase: read a round of batches and pre-aggregate them in
+  // parallel, until the input is exhausted.
+  std::vector<Batch> batches(BATCHES_PER_THREAD * states.size());
+  bool exhausted = false;
+  while (!exhausted) {
+    size_t num_batches = 0;
+    while (num_batches < batches.size() &&
+           this->input->next_batch(batches[num_batches]))
+      ++num_batches;
+    exhausted = num_batches < batches.size();
+    pool.parallel_for(num_batches, [&](size_t b, size_t thread) {
+      this->preaggregate(states[thread], batches[b]);
+    });
+  }
+  for (const auto& state : states)
+    this->statistics.num_passthrough_threads += state.passthrough;
+  pool.parallel_for(states.size(), [&](size_t thread) {
+    this->flush(states[thread]);
+    if (states[thread].num_buffered_groups >
+        states[thread].max_buffered_groups)
+      this->spill_partitions(states[thread]);
+  });
+  bool spilled = false;
+  for (const auto& state : states) {
+    this->statistics.num_partial_groups += state.num_partial_groups;
+    spilled |= !state.files.empty();
+  }
+
+  this->tables.clear();
+  if (spilled) {
+    // The partitions are merged from their spill files while the output is
+    // produced.
+    pool.parallel_for(states.size(), [&](size_t thread) {
+      this->spill_partitions(states[thread]);
+    });
+    for (size_t p = 0; p < NUM_PARTITIONS; ++p) {
+      Partition partition{{}, 1};
+      for (auto& state : states) {
+        if (!state.files[p]) continue;
+        this->statistics.spilled_bytes += state.files[p]->get_size();
+        partition.files.push_back(std::move(state.files[p]));
+      }
+      if (!partition.files.empty())
+        this->partitions.push_back(std::move(partition));
+    }
+    this->statistics.max_partitioning_depth = 1;
+    return;
+  }
+
+  // Second phase: merge the partial groups of every partition.
+  for (size_t p = 0; p < NUM_PARTITIONS; ++p) {
+    this->tables.push_back(std::make_unique<AggregationHashTable>());
+    this->tables.back()->reset(key_size, row_width);
+  }
+  pool.parallel_for(NUM_PARTITIONS, [&](size_t p) {
+    AggregationHashTable& table = *this->tables[p];
+    for (auto& state : states) {
+      auto& partial = state.partitions[p];
+      for (size_t i = 0; i < partial.hashes.size(); ++i)
+        this->merge_group(table, &partial.rows[i * row_width],
+                          partial.hashes[i]);
+      partial = PartialGroups{};
+    }
+  });
 }
 
-std::vector<Register*> Except::get_output() {
-  std::vector<Register*> output;
-  for (auto& reg : this->output_regs) output.emplace_back(&reg);
-  this->output_regs.clear();
-  return output;
+void HashAggregation::merge_partition(
+    Partition& partition, AggregationHashTable& table, size_t memory_budget,
+    std::vector<std::unique_ptr<SpillFile>>& files) const {
+  const size_t key_size = this->group_key.size();
+  const size_t row_width = this->row_width;
+  const size_t max_groups = this->max_groups(memory_budget);
+  std::vector<Register> partial(row_width);
+  table.reset(key_size, row_width);
+  for (auto& file : partition.files) {
+    file->rewind();
+    while (file->read_tuple(partial.data(), row_width)) {
+      uint64_t hash = CompositeKey::hash(partial.data(), key_size);
+      if (!files.empty()) {
+        auto& sub_file = files[partition_of(hash, partition.depth)];
+        if (!sub_file) sub_file = std::make_unique<SpillFile>();
+        sub_file->write_tuple(partial.data(), row_width);
+        continue;
+      }
+
+      this->merge_group(table, partial.data(), hash);
+      // Partition the groups and all following partial groups again with
+      // the next bits of the hash.
+      if (table.get_num_groups() > max_groups &&
+          partition.depth < MAX_PARTITIONING_DEPTH)
+        this->spill_table(table, files, partition.depth);
+    }
+    file.reset();
+  }
+  if (!files.empty()) table.reset(key_size, row_width);
 }
 
-void Except::close() {
-  this->input_left->close();
-  this->input_right->close();
+void HashAggregation::collect_partitions(
+    std::vector<std::unique_ptr<SpillFile>>& files, size_t depth) {
+  for (auto& file : files) {
+    if (!file) continue;
+    this->statistics.spilled_bytes += file->get_size();
+    this->statistics.max_partitioning_depth =
+        std::max(this->statistics.max_partitioning_depth, depth);
+    Partition partition{{}, depth};
+    partition.files.push_back(std::move(file));
+    this->partitions.push_back(std::move(partition));
+  }
+  files.clear();
+}
+
+void HashAggregation::merge_partitions() {
+  // Every thread merges one partition with its share of the budget.
+  const size_t num_partitions =
+      std::min(this->partitions.size(), this->pool->get_num_threads());
+  std::vector<Partition> merged;
+  for (size_t i = 0; i < num_partitions; ++i) {
+    merged.push_back(std::move(this->partitions.back()));
+    this->partitions.pop_back();
+  }
+
+  this->tables.clear();
+  for (size_t i = 0; i < num_partitions; ++i)
+    this->tables.push_back(std::make_unique<AggregationHashTable>());
+  std::vector<std::vector<std::unique_ptr<SpillFile>>> files(num_partitions);
+  const size_t memory_budget = this->options.memory_budget / num_partitions;
+  this->pool->parallel_for(num_partitions, [&](size_t i) {
+    this->merge_partition(merged[i], *this->tables[i], memory_budget,
+                          files[i]);
+  });
+
+  for (size_t i = 0; i < num_partitions; ++i) {
+    if (files[i].empty()) this->statistics.num_spilled_partitions++;
+    this->collect_partitions(files[i], merged[i].depth + 1);
+  }
+  this->output_table = 0;
+  this->next_group = 0;
+}
+
+void HashAggregation::aggregate_input(Batch* batch) {
+  if (this->options.num_threads > 1) {
+    this->aggregate_parallel();
+  } else {
+    if (batch)
+      this->aggregate_batches(*batch);
+    else
+      this->aggregate_tuples();
+    if (!this->spill_files.empty()) {
+      this->spill_table(*this->tables[0], this->spill_files, 0);
+      this->collect_partitions(this->spill_files, 1);
+    }
+  }
+
+  // Without group by attributes, the single group exists for empty inputs.
+  if (this->group_key.size() == 0 && this->partitions.empty()) {
+    size_t num_groups = 0;
+    for (const auto& table : this->tables)
+      num_groups += table->get_num_groups();
+    if (num_groups == 0) this->find_group(*this->tables[0], nullptr, 0);
+  }
+
+  if (this->distinct_groups) {
+    const Statistics& statistics = this->distinct_groups->get_statistics();
+    this->statistics.num_partial_groups += statistics.num_partial_groups;
+    this->statistics.num_passthrough_threads +=
+        statistics.num_passthrough_threads;
+    this->statistics.spilled_bytes += statistics.spilled_bytes;
+    this->statistics.num_spilled_partitions +=
+        statistics.num_spilled_partitions;
+    this->statistics.max_partitioning_depth =
+        std::max(this->statistics.max_partitioning_depth,
+                 statistics.max_partitioning_depth);
+  }
+  this->isFinished = true;
+}
+
+Register* HashAggregation::next_row() {
+  while (true) {
+    if (this->output_table < this->tables.size()) {
+      auto& table = *this->tables[this->output_table];
+      if (this->next_group < table.get_num_groups())
+        return table.get_row(this->next_group++);
+      this->output_table++;
+      this->next_group = 0;
+    } else if (!this->partitions.empty()) {
+      this->merge_partitions();
+    } else {
+      return nullptr;
+    }
+  }
+}
+
+void HashAggregation::set_output(Register* row) {
+  if (this->partial_output) {
+    this->output.resize(this->row_width);
+    for (size_t attr = 0; attr < this->row_width; ++attr)
+      this->output[attr] = &row[attr];
+    return;
+  }
+
+  const size_t key_size = this->group_key.size();
+  this->output.resize(key_size + this->aggr_funcs.size());
+  for (size_t attr = 0; attr < key_size; ++attr)
+    this->output[attr] = &row[attr];
+  for (size_t aggr = 0; aggr < this->aggr_funcs.size(); ++aggr) {
+    this->results[aggr] = this->finalize(aggr, &row[this->state_offsets[aggr]]);
+    this->output[key_size + aggr] = &this->results[aggr];
+  }
+}
+
+void HashAggregation::append_group(Batch& batch, const Register* group) {
+  size_t row = batch.append_row();
+  if (this->partial_output) {
+    for (size_t attr = 0; attr < this->row_width; ++attr)
+      batch.column(attr)[row] = group[attr];
+    return;
+  }
+
+  const size_t key_size = this->group_key.size();
+  for (size_t attr = 0; attr < key_size; ++attr)
+    batch.column(attr)[row] = group[attr];
+  for (size_t aggr = 0; aggr < this->aggr_funcs.size(); ++aggr)
+    batch.column(key_size + aggr)[row] =
+        this->finalize(aggr, &group[this->state_offsets[aggr]]);
+}
+
+bool HashAggregation::next() {
+  if (this->options.ordered_input) return this->next_ordered();
+  if (!this->isFinished) this->aggregate_input(nullptr);
+
+  Register* row = this->next_row();
+  if (!row) return false;
+  this->set_output(row);
+  return true;
 }
 
-ExceptAll::ExceptAll(Operator& input_left, Operator& input_right)
-    : BinaryOperator(input_left, input_right) {}
+bool HashAggregation::next_batch(Batch& batch) {
+  if (this->options.ordered_input) return this->next_batch_ordered(batch);
+  if (!this->isFinished) this->aggregate_input(&batch);
 
-ExceptAll::~ExceptAll() = default;
+  batch.reset(this->partial_output
+                  ? this->row_width
+                  : this->group_key.size() + this->aggr_funcs.size());
+  const Register* group;
+  while (!batch.full() && (group = this->next_row()))
+    this->append_group(batch, group);
 
-void ExceptAll::open() {
+  return batch.size() > 0;
+}
+
+void HashAggregation::start_group(const Register* key) {
+  const size_t key_size = this->group_key.size();
+  std::copy(key, key + key_size, this->group_row.begin());
+  std::copy(this->initial_state.begin(), this->initial_state.end(),
+            this->group_row.begin() + key_size);
+  this->has_group = true;
+}
+
+bool HashAggregation::finish_ordered() {
+  if (this->isFinished) return false;
+  this->isFinished = true;
+  if (!this->has_group) {
+    // Without group by attributes, the single group exists for empty inputs.
+    if (this->group_key.size() > 0) return false;
+    this->start_group(nullptr);
+  }
+  std::swap(this->group_row, this->output_row);
+  this->has_group = false;
+  return true;
+}
+
+bool HashAggregation::next_ordered() {
+  const size_t key_size = this->group_key.size();
+  this->keys.resize(key_size);
+  while (!this->isFinished && this->input->next()) {
+    const auto& regs = this->input->get_output();
+    this->group_key.gather(regs, this->keys.data());
+    // A tuple of another group closes the current one, which is output.
+    bool closed =
+        this->has_group && !CompositeKey::equal(this->keys.data(),
+                                                this->group_row.data(),
+                                                key_size);
+    if (closed) std::swap(this->group_row, this->output_row);
+    if (!this->has_group || closed) this->start_group(this->keys.data());
+    this->update_group(this->group_row.data(),
+                       [&](size_t attr) -> const Register& {
+                         return *regs[attr];
+                       });
+    if (closed) {
+      this->set_output(this->output_row.data());
+      return true;
+    }
+  }
+
+  if (!this->finish_ordered()) return false;
+  this->set_output(this->output_row.data());
+  return true;
+}
+
+bool HashAggregation::next_batch_ordered(Batch& batch) {
+  const size_t key_size = this->group_key.size();
+  this->keys.resize(key_size);
+  batch.reset(this->partial_output
+                  ? this->row_width
+                  : key_size + this->aggr_funcs.size());
+  while (!batch.full()) {
+    if (this->input_pos == this->input_batch.size()) {
+      this->input_pos = 0;
+      if (!this->isFinished && this->input->next_batch(this->input_batch))
+        continue;
+      this->input_batch.reset(0);
+      if (this->finish_ordered())
+        this->append_group(batch, this->output_row.data());
+      break;
+    }
+
+    const Batch& input = this->input_batch;
+    size_t row = input.row(this->input_pos++);
+    this->group_key.gather(input, row, this->keys.data());
+    if (this->has_group && !CompositeKey::equal(this->keys.data(),
+                                                this->group_row.data(),
+                                                key_size)) {
+      this->append_group(batch, this->group_row.data());
+      this->has_group = false;
+    }
+    if (!this->has_group) this->start_group(this->keys.data());
+    this->update_group(this->group_row.data(),
+                       [&](size_t attr) -> const Register& {
+                         return input.column(attr)[row];
+                       });
+  }
+
+  return batch.size() > 0;
+}
+
+void HashAggregation::close() {
+  this->input->close();
+  this->tables.clear();
+  this->spill_files.clear();
+  this->partitions.clear();
+  this->pool.reset();
+}
+
+const std::vector<Register*>& HashAggregation::get_output() {
+  return this->output;
+}
+
+namespace {
+
+/// Compares two registers like an ascending `Sort` orders them: by value,
+/// and registers of different types by type, so NULLs sort last.
+int compare_registers(const Register& r1, const Register& r2) {
+  if (r1 == r2) return 0;
+  if (r1.get_type() != r2.get_type())
+    return r1.get_type() < r2.get_type() ? -1 : 1;
+  return r1 < r2 ? -1 : 1;
+}
+
+/// Compares two tuples by their attributes from left to right.
+int compare_tuples(const std::vector<Register*>& tuple1,
+                   const Register* tuple2) {
+  for (size_t attr = 0; attr < tuple1.size(); ++attr)
+    if (int cmp = compare_registers(*tuple1[attr], tuple2[attr])) return cmp;
+  return 0;
+}
+int compare_tuples(const std::vector<Register*>& tuple1,
+                   const std::vector<Register*>& tuple2) {
+  for (size_t attr = 0; attr < tuple1.size(); ++attr)
+    if (int cmp = compare_registers(*tuple1[attr], *tuple2[attr])) return cmp;
+  return 0;
+}
+
+}  // namespace
+
+template <typename Policy>
+SetOperation<Policy>::SetOperation(Operator& input_left,
+                                   Operator& input_right)
+    : SetOperation(input_left, input_right, Options{}) {}
+
+template <typename Policy>
+SetOperation<Policy>::SetOperation(Operator& input_left,
+                                   Operator& input_right, Options options)
+    : BinaryOperator(input_left, input_right),
+      options(options),
+      table(std::make_unique<AggregationHashTable>()) {}
+
+template <typename Policy>
+SetOperation<Policy>::~SetOperation() = default;
+
+template <typename Policy>
+void SetOperation<Policy>::open() {
   this->input_left->open();
   this->input_right->open();
+  this->table->reset(0, 2);
+  this->width = 0;
+  this->groups.clear();
+  this->current_group = 0;
+  this->remaining = 0;
+  this->current_row = nullptr;
+  this->isFinished = false;
+  this->output.clear();
+  this->side = 0;
+  this->input_batch.reset(0);
+  this->input_pos = 0;
+  this->tuple.clear();
+  this->run_tuple.clear();
+  this->has_left = this->has_right = false;
 }
 
-bool ExceptAll::next() {
-  std::unordered_map<Register, int, RegisterHasher> left_registers,
-      right_registers;
+template <typename Policy>
+bool SetOperation<Policy>::read_tuple() {
+  while (this->input_pos == this->input_batch.size()) {
+    this->input_pos = 0;
+    // Tuples which are only in the right input are not needed when the
+    // policy never returns them, so it is not read after an empty left one.
+    if (this->side == 1 && this->table->get_num_groups() == 0 &&
+        Policy::count(0, 1) == 0)
+      this->side = 2;
+    if (this->side == 2) {
+      this->input_batch.reset(0);
+      return false;
+    }
 
-  if (!this->isFinished) {
-    while (this->input_left->next()) {
-      std::vector<Register*> regs = this->input_left->get_output();
-      for (const auto& reg : regs) left_registers[*reg]++;
+    Operator& input = this->side == 0 ? *this->input_left : *this->input_right;
+    if (!input.next_batch(this->input_batch)) {
+      this->input_batch.reset(0);
+      ++this->side;
+      continue;
+    }
+    if (this->width == 0) {
+      this->width = this->input_batch.num_columns();
+      this->table->reset(this->width, this->width + 2);
+      this->tuple.resize(this->width);
+      this->output.resize(this->width);
+    } else if (this->input_batch.num_columns() != this->width) {
+      throw std::runtime_error(
+          "set operation inputs must have the same number of attributes");
     }
+  }
 
-    while (this->input_right->next()) {
-      std::vector<Register*> regs = this->input_right->get_output();
-      for (const auto& reg : regs) right_registers[*reg]++;
+  size_t row = this->input_batch.row(this->input_pos++);
+  for (size_t attr = 0; attr < this->width; ++attr)
+    this->tuple[attr] = this->input_batch.column(attr)[row];
+  return true;
+}
+
+template <typename Policy>
+Register* SetOperation<Policy>::count_tuple(int64_t& added) {
+  const Register* tuple = this->tuple.data();
+  uint64_t hash = CompositeKey::hash(tuple, this->width);
+  Register* row;
+  if (this->side == 0 || Policy::count(0, 1) > 0) {
+    bool inserted;
+    std::tie(row, inserted) = this->table->insert(tuple, hash);
+    if (inserted)
+      row[this->width] = row[this->width + 1] = Register::from_int(0);
+  } else {
+    row = this->table->find(tuple, hash);
+    if (!row) {
+      added = 0;
+      return nullptr;
     }
+  }
 
-    for (const auto& reg : left_registers) {
-      auto find = right_registers.find(reg.first);
-      if (find != right_registers.end()) {
-        int leftCount = reg.second, rightCount = find->second;
-        if (leftCount > rightCount)
-          for (int i = rightCount; i < leftCount; i++)
-            this->registers.emplace_back(reg.first);
-      } else {
-        int leftCount = reg.second;
-        for (int i = 0; i < leftCount; i++)
-          this->registers.emplace_back(reg.first);
+  Register* counts = row + this->width;
+  int64_t left = counts[0].as_int(), right = counts[1].as_int();
+  const int64_t before = Policy::count(left, right);
+  counts[this->side] = Register::from_int(++(this->side == 0 ? left : right));
+  added = Policy::count(left, right) - before;
+  return row;
+}
+
+template <typename Policy>
+void SetOperation<Policy>::build() {
+  this->isFinished = true;
+  if (this->options.sorted_inputs) {
+    this->has_left = this->advance(*this->input_left);
+    this->has_right = this->advance(*this->input_right);
+    return;
+  }
+
+  int64_t added;
+  while (this->read_tuple()) this->count_tuple(added);
+
+  const size_t width = this->width;
+  for (size_t group = 0; group < this->table->get_num_groups(); ++group) {
+    const Register* counts = this->table->get_row(group) + width;
+    if (Policy::count(counts[0].as_int(), counts[1].as_int()) > 0)
+      this->groups.push_back(static_cast<uint32_t>(group));
+  }
+
+  if (!this->options.sorted_output) return;
+  std::sort(this->groups.begin(), this->groups.end(),
+            [&](uint32_t group1, uint32_t group2) {
+              const Register* tuple1 = this->table->get_row(group1);
+              const Register* tuple2 = this->table->get_row(group2);
+              for (size_t attr = 0; attr < width; ++attr)
+                if (int cmp = compare_registers(tuple1[attr], tuple2[attr]))
+                  return cmp < 0;
+              return false;
+            });
+}
+
+template <typename Policy>
+bool SetOperation<Policy>::advance(Operator& input) {
+  if (!input.next()) return false;
+  const size_t width = input.get_output().size();
+  if (this->run_tuple.empty()) {
+    this->width = width;
+    this->run_tuple.resize(width);
+    this->output.resize(width);
+  } else if (width != this->width) {
+    throw std::runtime_error(
+        "set operation inputs must have the same number of attributes");
+  }
+  return true;
+}
+
+template <typename Policy>
+int64_t SetOperation<Policy>::count_run(Operator& input, bool& has_tuple) {
+  for (int64_t count = 1;; ++count) {
+    has_tuple = this->advance(input);
+    if (!has_tuple) return count;
+    int cmp = compare_tuples(input.get_output(), this->run_tuple.data());
+    if (cmp < 0)
+      throw std::runtime_error("set operation input is not sorted");
+    if (cmp > 0) return count;
+  }
+}
+
+template <typename Policy>
+Register* SetOperation<Policy>::next_merged() {
+  int64_t count = 0;
+  while (count == 0) {
+    // Once one input is exhausted, the tuples of the other one may not be
+    // returned anymore.
+    if (!this->has_left && (!this->has_right || Policy::count(0, 1) == 0))
+      return nullptr;
+    if (!this->has_right && Policy::count(1, 0) == 0) return nullptr;
+
+    // The run is the one of the smaller current tuple, on one or both
+    // sides.
+    int cmp = !this->has_left    ? 1
+              : !this->has_right ? -1
+                                 : compare_tuples(
+                                       this->input_left->get_output(),
+                                       this->input_right->get_output());
+    const auto& first = cmp <= 0 ? this->input_left->get_output()
+                                 : this->input_right->get_output();
+    for (size_t attr = 0; attr < this->width; ++attr)
+      this->run_tuple[attr] = *first[attr];
+
+    int64_t left_count =
+        cmp <= 0 ? this->count_run(*this->input_left, this->has_left) : 0;
+    int64_t right_count =
+        cmp >= 0 ? this->count_run(*this->input_right, this->has_right) : 0;
+    count = Policy::count(left_count, right_count);
+  }
+  this->remaining = count - 1;
+  this->current_row = this->run_tuple.data();
+  return this->current_row;
+}
+
+template <typename Policy>
+Register* SetOperation<Policy>::next_row() {
+  if (this->remaining > 0) {
+    --this->remaining;
+    return this->current_row;
+  }
+
+  if (this->pipelined()) {
+    // Return every tuple as soon as it qualifies.
+    int64_t added;
+    while (this->read_tuple()) {
+      Register* row = this->count_tuple(added);
+      if (added > 0) {
+        this->current_row = row;
+        this->remaining = added - 1;
+        return row;
       }
     }
+    return nullptr;
+  }
 
-    std::sort(this->registers.begin(), this->registers.end(),
-              [&](const Register& a, const Register& b) { return a < b; });
-    this->isFinished = true;
+  if (!this->isFinished) this->build();
+  if (this->options.sorted_inputs) return this->next_merged();
+  if (this->current_group == this->groups.size()) return nullptr;
+  this->current_row = this->table->get_row(this->groups[this->current_group++]);
+  const Register* counts = this->current_row + this->width;
+  this->remaining =
+      Policy::count(counts[0].as_int(), counts[1].as_int()) - 1;
+  return this->current_row;
+}
+
+template <typename Policy>
+bool SetOperation<Policy>::next() {
+  Register* row = this->next_row();
+  if (!row) return false;
+  // The row stays in place until the next tuple is read.
+  for (size_t attr = 0; attr < this->width; ++attr)
+    this->output[attr] = &row[attr];
+  return true;
+}
+
+template <typename Policy>
+bool SetOperation<Policy>::next_batch(Batch& batch) {
+  batch.reset(this->width);
+  const Register* row;
+  while (!batch.full() && (row = this->next_row())) {
+    if (batch.num_columns() != this->width) batch.reset(this->width);
+    size_t index = batch.append_row();
+    for (size_t attr = 0; attr < this->width; ++attr)
+      batch.column(attr)[index] = row[attr];
+  }
+  return batch.size() > 0;
+}
+
+template <typename Policy>
+const std::vector<Register*>& SetOperation<Policy>::get_output() {
+  return this->output;
+}
+
+template <typename Policy>
+void SetOperation<Policy>::close() {
+  this->input_left->close();
+  this->input_right->close();
+}
+
+template class SetOperation<UnionPolicy>;
+template class SetOperation<IntersectPolicy>;
+template class SetOperation<IntersectAllPolicy>;
+template class SetOperation<ExceptPolicy>;
+template class SetOperation<ExceptAllPolicy>;
+
+struct UnionAll::ReadAhead {
+  std::mutex mutex;
+  std::condition_variable batch_available;
+  std::condition_variable space_available;
+  /// Batches read by the threads, in the order they were read.
+  std::deque<Batch> batches;
+  /// Batches returned by the consumer, which the threads read into next.
+  std::vector<Batch> free_batches;
+  size_t num_running = 0;
+  bool stopping = false;
+  std::exception_ptr error;
+  std::vector<std::thread> threads;
+};
+
+UnionAll::UnionAll(Operator& input_left, Operator& input_right)
+    : UnionAll(input_left, input_right, Options{}) {}
+
+UnionAll::UnionAll(Operator& input_left, Operator& input_right,
+                   Options options)
+    : UnionAll(std::vector<Operator*>{&input_left, &input_right}, options) {}
+
+UnionAll::UnionAll(std::vector<Operator*> inputs)
+    : UnionAll(std::move(inputs), Options{}) {}
+
+UnionAll::UnionAll(std::vector<Operator*> inputs, Options options)
+    : inputs(std::move(inputs)), options(options), width(UNKNOWN_WIDTH) {}
+
+UnionAll::~UnionAll() { this->stop_read_ahead(); }
+
+void UnionAll::open() {
+  for (Operator* input : this->inputs) input->open();
+  this->current_input = 0;
+  this->first_tuple = true;
+  this->width = UNKNOWN_WIDTH;
+  this->output.clear();
+  this->current_batch.reset(0);
+  this->current_row = 0;
+  this->has_tuple.assign(this->inputs.size(), false);
+  this->merge_started = false;
+  this->advance_winner = false;
+}
+
+void UnionAll::check_width(size_t width) {
+  if (this->width == UNKNOWN_WIDTH) {
+    this->width = width;
+  } else if (width != this->width) {
+    throw std::runtime_error(
+        "set operation inputs must have the same number of attributes");
+  }
+}
+
+void UnionAll::start_read_ahead() {
+  const size_t num_threads =
+      std::min(this->options.num_threads, this->inputs.size());
+  this->read_ahead = std::make_unique<ReadAhead>();
+  ReadAhead& state = *this->read_ahead;
+  state.num_running = num_threads;
+  for (size_t thread = 0; thread < num_threads; ++thread) {
+    state.threads.emplace_back([this, &state, thread, num_threads] {
+      // Reads the inputs of this thread until they are exhausted or the
+      // union is closed.
+      auto read_inputs = [&] {
+        Batch batch;
+        for (size_t i = thread; i < this->inputs.size(); i += num_threads) {
+          while (this->inputs[i]->next_batch(batch)) {
+            std::unique_lock<std::mutex> lock(state.mutex);
+            state.space_available.wait(lock, [&] {
+              return state.stopping ||
+                     state.batches.size() < QUEUE_CAPACITY;
+            });
+            if (state.stopping) return;
+            state.batches.push_back(std::move(batch));
+            if (!state.free_batches.empty()) {
+              batch = std::move(state.free_batches.back());
+              state.free_batches.pop_back();
+            } else {
+              batch = Batch{};
+            }
+            state.batch_available.notify_one();
+          }
+        }
+      };
+
+      try {
+        read_inputs();
+      } catch (...) {
+        std::lock_guard<std::mutex> lock(state.mutex);
+        if (!state.error) state.error = std::current_exception();
+      }
+      std::lock_guard<std::mutex> lock(state.mutex);
+      --state.num_running;
+      state.batch_available.notify_one();
+    });
+  }
+}
+
+void UnionAll::stop_read_ahead() {
+  if (!this->read_ahead) return;
+  ReadAhead& state = *this->read_ahead;
+  {
+    std::lock_guard<std::mutex> lock(state.mutex);
+    state.stopping = true;
+  }
+  state.space_available.notify_all();
+  for (std::thread& thread : state.threads) thread.join();
+  this->read_ahead.reset();
+}
+
+bool UnionAll::next_read_ahead(Batch& batch) {
+  if (!this->read_ahead) this->start_read_ahead();
+  ReadAhead& state = *this->read_ahead;
+
+  std::unique_lock<std::mutex> lock(state.mutex);
+  state.batch_available.wait(lock, [&] {
+    return state.error || !state.batches.empty() || state.num_running == 0;
+  });
+  if (state.error) std::rethrow_exception(state.error);
+  if (state.batches.empty()) {
+    batch.reset(0);
+    return false;
+  }
+  // The batch of the caller is read into by one of the threads next.
+  state.free_batches.push_back(std::move(batch));
+  batch = std::move(state.batches.front());
+  state.batches.pop_front();
+  lock.unlock();
+  state.space_available.notify_one();
+
+  this->check_width(batch.num_columns());
+  return true;
+}
+
+bool UnionAll::next_merged() {
+  auto less = [this](size_t a, size_t b) {
+    if (!this->has_tuple[a]) return false;
+    if (!this->has_tuple[b]) return true;
+    int cmp = compare_tuples(this->inputs[a]->get_output(),
+                             this->inputs[b]->get_output());
+    return cmp < 0 || (cmp == 0 && a < b);
+  };
+  auto advance = [this](size_t i) {
+    Operator& input = *this->inputs[i];
+    this->has_tuple[i] = input.next();
+    if (this->has_tuple[i]) this->check_width(input.get_output().size());
+  };
+
+  if (!this->merge_started) {
+    for (size_t i = 0; i < this->inputs.size(); ++i) advance(i);
+    this->merge_tree.init(this->inputs.size(), less);
+    this->merge_started = true;
+  } else if (this->advance_winner) {
+    advance(this->merge_tree.winner());
+    this->merge_tree.replay(less);
+  }
+
+  if (this->inputs.empty() || !this->has_tuple[this->merge_tree.winner()]) {
+    this->advance_winner = false;
+    this->current_input = this->inputs.size();
+    return false;
   }
+  // The tuple stays in the output registers of the winner until the next
+  // call.
+  this->current_input = this->merge_tree.winner();
+  this->advance_winner = true;
+  return true;
+}
 
-  if (this->counter < static_cast<int>(this->registers.size())) {
-    this->output_regs.emplace_back(this->registers[this->counter]);
-    this->counter++;
+bool UnionAll::next() {
+  if (this->options.sorted_inputs) return this->next_merged();
+  if (this->options.num_threads > 1) {
+    while (this->current_row == this->current_batch.size()) {
+      if (!this->next_read_ahead(this->current_batch)) return false;
+      this->current_row = 0;
+    }
+    size_t row = this->current_batch.row(this->current_row++);
+    this->output.resize(this->width);
+    for (size_t attr = 0; attr < this->width; ++attr)
+      this->output[attr] = &this->current_batch.column(attr)[row];
     return true;
   }
 
+  for (; this->current_input < this->inputs.size(); ++this->current_input) {
+    Operator& input = *this->inputs[this->current_input];
+    if (input.next()) {
+      if (this->first_tuple) {
+        this->check_width(input.get_output().size());
+        this->first_tuple = false;
+      }
+      return true;
+    }
+    this->first_tuple = true;
+  }
   return false;
 }
 
-std::vector<Register*> ExceptAll::get_output() {
-  std::vector<Register*> output;
-  for (auto& reg : this->output_regs) output.emplace_back(&reg);
-  this->output_regs.clear();
-  return output;
+bool UnionAll::next_batch(Batch& batch) {
+  if (this->options.sorted_inputs) return Operator::next_batch(batch);
+  if (this->options.num_threads > 1) return this->next_read_ahead(batch);
+
+  for (; this->current_input < this->inputs.size(); ++this->current_input) {
+    if (this->inputs[this->current_input]->next_batch(batch)) {
+      this->check_width(batch.num_columns());
+      return true;
+    }
+  }
+  batch.reset(0);
+  return false;
 }
 
-void ExceptAll::close() {
-  this->input_left->close();
-  this->input_right->close();
+const std::vector<Register*>& UnionAll::get_output() {
+  // Serial unions return the tuples of their inputs in place.
+  if ((this->options.num_threads <= 1 || this->options.sorted_inputs) &&
+      this->current_input < this->inputs.size())
+    return this->inputs[this->current_input]->get_output();
+  return this->output;
+}
+
+void UnionAll::close() {
+  this->stop_read_ahead();
+  for (Operator* input : this->inputs) input->close();
 }
 
 }  // namespace operators
@@ -0,0 +1,161 @@
+#include "operators/radix_join.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace buzzdb {
+namespace operators {
+namespace radix {
+
+namespace {
+
+/// Number of entries in a cache line.
+constexpr size_t ENTRIES_PER_LINE = 64 / sizeof(Entry);
+
+/// Returns the radix of `hash`: its high bits after multiplying with the
+/// golden ratio, so that integers, which hash to themselves, are spread.
+inline size_t radix_of(uint64_t hash, unsigned bits) {
+  return bits ? static_cast<size_t>((hash * 0x9E3779B97F4A7C15ull) >>
+                                    (64 - bits))
+              : 0;
+}
+
+/// Returns the bucket of `hash` in a table with `2^bucket_bits` buckets
+/// over a partition: the bits of the mixed hash right below its radix.
+/// The radix bits are equal within the partition, and the low bits of the
+/// hash are not spread, since integers hash to themselves.
+inline size_t bucket_of(uint64_t hash, unsigned radix_bits,
+                        unsigned bucket_bits) {
+  uint64_t remaining = (hash * 0x9E3779B97F4A7C15ull) << radix_bits;
+  return bucket_bits ? static_cast<size_t>(remaining >> (64 - bucket_bits))
+                     : 0;
+}
+
+}  // namespace
+
+unsigned choose_radix_bits(size_t num_left_tuples, size_t left_width,
+                           size_t num_threads) {
+  size_t tuple_size = left_width * sizeof(Register) + 2 * sizeof(Entry);
+  unsigned bits = 0;
+  while (bits < MAX_RADIX_BITS &&
+         ((num_left_tuples * tuple_size >> bits) > PARTITION_CACHE_SIZE ||
+          (size_t{1} << bits) < 4 * num_threads))
+    ++bits;
+  return bits;
+}
+
+Partitions partition(ThreadPool& pool, const Register* tuples, size_t width,
+                     size_t num_tuples, const CompositeKey& key,
+                     unsigned bits) {
+  const size_t num_partitions = size_t{1} << bits;
+  const size_t num_chunks = pool.get_num_threads();
+  std::vector<Entry> hashed(num_tuples);
+  std::vector<std::vector<size_t>> histograms(
+      num_chunks, std::vector<size_t>(num_partitions));
+  auto chunk_begin = [&](size_t chunk) {
+    return num_tuples * chunk / num_chunks;
+  };
+
+  // Hash every tuple and count the tuples per partition in every chunk.
+  pool.parallel_for(num_chunks, [&](size_t chunk) {
+    auto& histogram = histograms[chunk];
+    std::vector<Register> key_buffer(key.size());
+    for (size_t t = chunk_begin(chunk); t < chunk_begin(chunk + 1); ++t) {
+      key.gather(tuples + t * width, key_buffer.data());
+      uint64_t hash = CompositeKey::hash(key_buffer.data(), key.size());
+      hashed[t] = Entry{hash, static_cast<uint32_t>(t)};
+      histogram[radix_of(hash, bits)]++;
+    }
+  });
+
+  // Every chunk writes its tuples of a partition behind the ones of the
+  // previous chunks, which keeps the input order within the partitions.
+  Partitions partitions;
+  partitions.entries.resize(num_tuples);
+  partitions.bounds.resize(num_partitions + 1);
+  size_t offset = 0;
+  for (size_t p = 0; p < num_partitions; ++p) {
+    partitions.bounds[p] = offset;
+    for (auto& histogram : histograms) {
+      size_t count = histogram[p];
+      histogram[p] = offset;
+      offset += count;
+    }
+  }
+  partitions.bounds[num_partitions] = offset;
+
+  pool.parallel_for(num_chunks, [&](size_t chunk) {
+    auto& offsets = histograms[chunk];
+    std::vector<Entry> buffers(num_partitions * ENTRIES_PER_LINE);
+    std::vector<uint8_t> fill(num_partitions);
+    Entry* entries = partitions.entries.data();
+    for (size_t t = chunk_begin(chunk); t < chunk_begin(chunk + 1); ++t) {
+      size_t p = radix_of(hashed[t].hash, bits);
+      Entry* buffer = &buffers[p * ENTRIES_PER_LINE];
+      buffer[fill[p]++] = hashed[t];
+      if (fill[p] == ENTRIES_PER_LINE) {
+        std::memcpy(entries + offsets[p], buffer, sizeof(Entry) * fill[p]);
+        offsets[p] += fill[p];
+        fill[p] = 0;
+      }
+    }
+    for (size_t p = 0; p < num_partitions; ++p)
+      std::memcpy(entries + offsets[p], &buffers[p * ENTRIES_PER_LINE],
+                  sizeof(Entry) * fill[p]);
+  });
+
+  return partitions;
+}
+
+void join(ThreadPool& pool, const Register* left, size_t left_width,
+          const CompositeKey& left_key, const Partitions& left_partitions,
+          const Register* right, size_t right_width,
+          const CompositeKey& right_key, const Partitions& right_partitions,
+          size_t first_partition, size_t num_partitions,
+          std::vector<std::vector<Match>>& matches) {
+  const auto radix_bits = static_cast<unsigned>(
+      __builtin_ctzll(left_partitions.bounds.size() - 1));
+  matches.assign(num_partitions, {});
+
+  pool.parallel_for(num_partitions, [&](size_t partition) {
+    const size_t p = first_partition + partition;
+    const Entry* build = &left_partitions.entries[left_partitions.bounds[p]];
+    size_t num_build =
+        left_partitions.bounds[p + 1] - left_partitions.bounds[p];
+    const Entry* probe = &right_partitions.entries[right_partitions.bounds[p]];
+    size_t num_probe =
+        right_partitions.bounds[p + 1] - right_partitions.bounds[p];
+    if (num_build == 0 || num_probe == 0) return;
+
+    // A chained table over the partition, see `bucket_of()`. Inserting
+    // backwards keeps every chain in input order.
+    constexpr uint32_t NONE = UINT32_MAX;
+    unsigned bucket_bits = 0;
+    while ((size_t{1} << bucket_bits) < num_build) ++bucket_bits;
+    std::vector<uint32_t> heads(size_t{1} << bucket_bits, NONE),
+        next(num_build);
+    for (size_t t = num_build; t-- > 0;) {
+      uint32_t& head = heads[bucket_of(build[t].hash, radix_bits, bucket_bits)];
+      next[t] = head;
+      head = static_cast<uint32_t>(t);
+    }
+
+    auto& partition_matches = matches[partition];
+    std::vector<Register> key(right_key.size());
+    for (size_t j = 0; j < num_probe; ++j) {
+      right_key.gather(right + probe[j].tuple * right_width, key.data());
+      if (CompositeKey::has_null(key.data(), key.size())) continue;
+      for (uint32_t entry = heads[bucket_of(probe[j].hash, radix_bits,
+                                            bucket_bits)];
+           entry != NONE; entry = next[entry])
+        if (build[entry].hash == probe[j].hash &&
+            left_key.matches(left + build[entry].tuple * left_width,
+                             key.data()))
+          partition_matches.emplace_back(build[entry].tuple, probe[j].tuple);
+    }
+  });
+}
+
+}  // namespace radix
+}  // namespace operators
+}  // namespace buzzdb
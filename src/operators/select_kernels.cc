@@ -0,0 +1,293 @@
+#include "operators/select_kernels.h"
+
+#include <cstring>
+#include <type_traits>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define BUZZDB_X86_KERNELS 1
+#endif
+
+namespace buzzdb {
+namespace operators {
+namespace kernels {
+
+namespace {
+
+/// Every predicate type is computed as one of three comparisons whose result
+/// is optionally negated: NE = !EQ, LE = !GT and GE = !LT.
+enum Comparison { CMP_EQ, CMP_GT, CMP_LT };
+
+using PredicateType = Select::PredicateType;
+
+template <typename F>
+size_t dispatch(PredicateType predicate_type, F&& kernel) {
+  using Yes = std::true_type;
+  using No = std::false_type;
+  switch (predicate_type) {
+    case PredicateType::EQ:
+      return kernel(std::integral_constant<int, CMP_EQ>{}, No{});
+    case PredicateType::NE:
+      return kernel(std::integral_constant<int, CMP_EQ>{}, Yes{});
+    case PredicateType::LT:
+      return kernel(std::integral_constant<int, CMP_LT>{}, No{});
+    case PredicateType::LE:
+      return kernel(std::integral_constant<int, CMP_GT>{}, Yes{});
+    case PredicateType::GT:
+      return kernel(std::integral_constant<int, CMP_GT>{}, No{});
+    case PredicateType::GE:
+      return kernel(std::integral_constant<int, CMP_LT>{}, Yes{});
+  }
+  return 0;
+}
+
+template <int Cmp, bool Negate, typename T>
+bool evaluate(const T& left, const T& right) {
+  bool result = (Cmp == CMP_EQ)   ? left == right
+                : (Cmp == CMP_GT) ? left > right
+                                  : left < right;
+  return result != Negate;
+}
+
+/// Three-way comparison of 16 characters as unsigned bytes.
+int compare_chars(const char* c1, const char* c2) {
+  return std::memcmp(c1, c2, 16);
+}
+
+template <int Cmp, bool Negate>
+size_t int64_scalar(const int64_t* values, size_t begin, size_t count,
+                    int64_t constant, const uint16_t* rows,
+                    uint16_t* selection, size_t num_selected) {
+  for (size_t i = begin; i < count; ++i) {
+    selection[num_selected] = rows ? rows[i] : static_cast<uint16_t>(i);
+    num_selected += evaluate<Cmp, Negate>(values[i], constant);
+  }
+  return num_selected;
+}
+
+template <int Cmp, bool Negate>
+size_t char16_scalar(const char* base, size_t stride, size_t begin,
+                     size_t count, const char* constant, const uint16_t* rows,
+                     uint16_t* selection, size_t num_selected) {
+  for (size_t i = begin; i < count; ++i) {
+    size_t row = rows ? rows[i] : i;
+    int cmp = compare_chars(base + row * stride, constant);
+    selection[num_selected] = static_cast<uint16_t>(row);
+    num_selected += evaluate<Cmp, Negate>(cmp, 0);
+  }
+  return num_selected;
+}
+
+#ifdef BUZZDB_X86_KERNELS
+
+/// For every 4 bit comparison mask, a byte shuffle that moves the 16 bit row
+/// indexes of the set lanes to the front.
+struct CompactionTable {
+  alignas(16) uint8_t shuffles[16][16];
+
+  constexpr CompactionTable() : shuffles() {
+    for (unsigned mask = 0; mask < 16; ++mask) {
+      unsigned out = 0;
+      for (unsigned lane = 0; lane < 4; ++lane) {
+        if (!((mask >> lane) & 1)) continue;
+        shuffles[mask][2 * out] = static_cast<uint8_t>(2 * lane);
+        shuffles[mask][2 * out + 1] = static_cast<uint8_t>(2 * lane + 1);
+        ++out;
+      }
+      for (unsigned byte = 2 * out; byte < 16; ++byte)
+        shuffles[mask][byte] = 0x80;
+    }
+  }
+};
+
+constexpr CompactionTable compaction_table{};
+
+/// Appends the rows of the 4 values starting at `i` whose bit in `mask` is
+/// set. Always writes 4 entries, so `selection` needs room for them, and
+/// reads the rows before writing, so `selection` may alias `rows`.
+__attribute__((target("sse4.2"))) inline size_t append_lanes(
+    unsigned mask, size_t i, const uint16_t* rows, uint16_t* selection,
+    size_t num_selected) {
+  __m128i indexes =
+      rows ? _mm_loadl_epi64(reinterpret_cast<const __m128i*>(rows + i))
+           : _mm_add_epi16(_mm_set1_epi16(static_cast<int16_t>(i)),
+                           _mm_setr_epi16(0, 1, 2, 3, 0, 0, 0, 0));
+  __m128i shuffle = _mm_load_si128(
+      reinterpret_cast<const __m128i*>(compaction_table.shuffles[mask]));
+  _mm_storel_epi64(reinterpret_cast<__m128i*>(selection + num_selected),
+                   _mm_shuffle_epi8(indexes, shuffle));
+  return num_selected + __builtin_popcount(mask);
+}
+
+/// Returns the 2 bit comparison mask of the values at `values` and `c`.
+template <int Cmp>
+__attribute__((target("sse4.2"))) inline unsigned compare_int64_sse42(
+    const int64_t* values, __m128i c) {
+  __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(values));
+  __m128i result = (Cmp == CMP_EQ)   ? _mm_cmpeq_epi64(v, c)
+                   : (Cmp == CMP_GT) ? _mm_cmpgt_epi64(v, c)
+                                     : _mm_cmpgt_epi64(c, v);
+  return static_cast<unsigned>(_mm_movemask_pd(_mm_castsi128_pd(result)));
+}
+
+template <int Cmp, bool Negate>
+__attribute__((target("sse4.2"))) size_t int64_sse42(
+    const int64_t* values, size_t count, int64_t constant,
+    const uint16_t* rows, uint16_t* selection) {
+  const __m128i c = _mm_set1_epi64x(constant);
+  size_t num_selected = 0, i = 0;
+  for (; i + 4 <= count; i += 4) {
+    unsigned mask = compare_int64_sse42<Cmp>(values + i, c) |
+                    (compare_int64_sse42<Cmp>(values + i + 2, c) << 2);
+    if (Negate) mask ^= 0xF;
+    num_selected = append_lanes(mask, i, rows, selection, num_selected);
+  }
+  return int64_scalar<Cmp, Negate>(values, i, count, constant, rows, selection,
+                                   num_selected);
+}
+
+template <int Cmp, bool Negate>
+__attribute__((target("avx2"))) size_t int64_avx2(const int64_t* values,
+                                                  size_t count,
+                                                  int64_t constant,
+                                                  const uint16_t* rows,
+                                                  uint16_t* selection) {
+  const __m256i c = _mm256_set1_epi64x(constant);
+  size_t num_selected = 0, i = 0;
+  for (; i + 4 <= count; i += 4) {
+    __m256i v =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(values + i));
+    __m256i result = (Cmp == CMP_EQ)   ? _mm256_cmpeq_epi64(v, c)
+                     : (Cmp == CMP_GT) ? _mm256_cmpgt_epi64(v, c)
+                                       : _mm256_cmpgt_epi64(c, v);
+    unsigned mask = _mm256_movemask_pd(_mm256_castsi256_pd(result));
+    if (Negate) mask ^= 0xF;
+    num_selected = append_lanes(mask, i, rows, selection, num_selected);
+  }
+  return int64_scalar<Cmp, Negate>(values, i, count, constant, rows, selection,
+                                   num_selected);
+}
+
+/// Turns the index of the first differing byte (16 if there is none) into a
+/// three-way comparison result.
+inline int compare_at(const char* chars, const char* constant, int index) {
+  if (index == 16) return 0;
+  return static_cast<unsigned char>(chars[index]) <
+                 static_cast<unsigned char>(constant[index])
+             ? -1
+             : 1;
+}
+
+template <int Cmp, bool Negate>
+__attribute__((target("sse4.2"))) size_t char16_sse42(
+    const char* base, size_t stride, size_t count, const char* constant,
+    const uint16_t* rows, uint16_t* selection) {
+  const __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(constant));
+  size_t num_selected = 0;
+  for (size_t i = 0; i < count; ++i) {
+    size_t row = rows ? rows[i] : i;
+    const char* chars = base + row * stride;
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(chars));
+    // Index of the first byte in which both strings differ.
+    int index = _mm_cmpestri(c, 16, v, 16,
+                             _SIDD_UBYTE_OPS | _SIDD_CMP_EQUAL_EACH |
+                                 _SIDD_NEGATIVE_POLARITY |
+                                 _SIDD_LEAST_SIGNIFICANT);
+    selection[num_selected] = static_cast<uint16_t>(row);
+    num_selected +=
+        evaluate<Cmp, Negate>(compare_at(chars, constant, index), 0);
+  }
+  return num_selected;
+}
+
+template <int Cmp, bool Negate>
+__attribute__((target("avx2"))) size_t char16_avx2(
+    const char* base, size_t stride, size_t count, const char* constant,
+    const uint16_t* rows, uint16_t* selection) {
+  const __m256i c = _mm256_broadcastsi128_si256(
+      _mm_loadu_si128(reinterpret_cast<const __m128i*>(constant)));
+  size_t num_selected = 0, i = 0;
+  // Compares two strings per instruction, one in each 128 bit lane.
+  for (; i + 2 <= count; i += 2) {
+    size_t row0 = rows ? rows[i] : i, row1 = rows ? rows[i + 1] : i + 1;
+    const char* chars0 = base + row0 * stride;
+    const char* chars1 = base + row1 * stride;
+    __m256i v = _mm256_set_m128i(
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(chars1)),
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(chars0)));
+    unsigned diff = ~static_cast<unsigned>(
+        _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, c)));
+    unsigned diff0 = diff & 0xFFFF, diff1 = diff >> 16;
+    int index0 = diff0 ? __builtin_ctz(diff0) : 16;
+    int index1 = diff1 ? __builtin_ctz(diff1) : 16;
+
+    selection[num_selected] = static_cast<uint16_t>(row0);
+    num_selected +=
+        evaluate<Cmp, Negate>(compare_at(chars0, constant, index0), 0);
+    selection[num_selected] = static_cast<uint16_t>(row1);
+    num_selected +=
+        evaluate<Cmp, Negate>(compare_at(chars1, constant, index1), 0);
+  }
+  return char16_scalar<Cmp, Negate>(base, stride, i, count, constant, rows,
+                                    selection, num_selected);
+}
+
+#endif  // BUZZDB_X86_KERNELS
+
+}  // namespace
+
+InstructionSet detect_instruction_set() {
+#ifdef BUZZDB_X86_KERNELS
+  static const InstructionSet isa = [] {
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return InstructionSet::AVX2;
+    if (__builtin_cpu_supports("sse4.2")) return InstructionSet::SSE42;
+    return InstructionSet::SCALAR;
+  }();
+  return isa;
+#else
+  return InstructionSet::SCALAR;
+#endif
+}
+
+size_t select_int64(InstructionSet isa, Select::PredicateType predicate_type,
+                    const int64_t* values, size_t count, int64_t constant,
+                    const uint16_t* rows, uint16_t* selection) {
+  return dispatch(predicate_type, [&](auto cmp, auto negate) -> size_t {
+    constexpr int Cmp = decltype(cmp)::value;
+    constexpr bool Negate = decltype(negate)::value;
+#ifdef BUZZDB_X86_KERNELS
+    if (isa == InstructionSet::AVX2)
+      return int64_avx2<Cmp, Negate>(values, count, constant, rows, selection);
+    if (isa == InstructionSet::SSE42)
+      return int64_sse42<Cmp, Negate>(values, count, constant, rows,
+                                      selection);
+#endif
+    return int64_scalar<Cmp, Negate>(values, 0, count, constant, rows,
+                                     selection, 0);
+  });
+}
+
+size_t select_char16(InstructionSet isa, Select::PredicateType predicate_type,
+                     const char* base, size_t stride, size_t count,
+                     const char* constant, const uint16_t* rows,
+                     uint16_t* selection) {
+  return dispatch(predicate_type, [&](auto cmp, auto negate) -> size_t {
+    constexpr int Cmp = decltype(cmp)::value;
+    constexpr bool Negate = decltype(negate)::value;
+#ifdef BUZZDB_X86_KERNELS
+    if (isa == InstructionSet::AVX2)
+      return char16_avx2<Cmp, Negate>(base, stride, count, constant, rows,
+                                      selection);
+    if (isa == InstructionSet::SSE42)
+      return char16_sse42<Cmp, Negate>(base, stride, count, constant, rows,
+                                       selection);
+#endif
+    return char16_scalar<Cmp, Negate>(base, stride, 0, count, constant, rows,
+                                      selection, 0);
+  });
+}
+
+}  // namespace kernels
+}  // namespace operators
+}  // namespace buzzdb
@@ -0,0 +1,263 @@
+#include "operators/sketches.h"
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+
+namespace buzzdb {
+namespace operators {
+
+namespace {
+
+/// Mixes the hash (the finalizer of MurmurHash3), since integers hash to
+/// themselves.
+uint64_t mix(uint64_t hash) {
+  hash ^= hash >> 33;
+  hash *= 0xff51afd7ed558ccdull;
+  hash ^= hash >> 33;
+  hash *= 0xc4ceb9fe1a85ec53ull;
+  hash ^= hash >> 33;
+  return hash;
+}
+
+/// Returns the bucket bytes of a register of a `HyperLogLog` state.
+std::array<uint8_t, HyperLogLog::BUCKETS_PER_REGISTER> get_buckets(
+    const Register& reg) {
+  std::array<uint8_t, HyperLogLog::BUCKETS_PER_REGISTER> buckets;
+  int64_t value = reg.as_int();
+  std::memcpy(buckets.data(), &value, sizeof(value));
+  return buckets;
+}
+
+Register from_buckets(
+    const std::array<uint8_t, HyperLogLog::BUCKETS_PER_REGISTER>& buckets) {
+  int64_t value;
+  std::memcpy(&value, buckets.data(), sizeof(value));
+  return Register::from_int(value);
+}
+
+struct Centroid {
+  double mean;
+  int64_t count;
+};
+
+/// Centroids of a `QuantileSketch` while it is compressed, which has room
+/// for the centroids of two merged states.
+using Centroids = std::array<Centroid, 2 * QuantileSketch::CAPACITY>;
+
+Register from_double(double value) {
+  int64_t bits;
+  std::memcpy(&bits, &value, sizeof(bits));
+  return Register::from_int(bits);
+}
+
+double as_double(const Register& reg) {
+  int64_t bits = reg.as_int();
+  double value;
+  std::memcpy(&value, &bits, sizeof(value));
+  return value;
+}
+
+/// Appends the centroids of `state` to the first `size` ones of
+/// `centroids` and returns the new number of centroids.
+size_t load_centroids(const Register* state, Centroids& centroids,
+                      size_t size) {
+  size_t count = static_cast<size_t>(state[0].as_int());
+  for (size_t i = 0; i < count; ++i)
+    centroids[size + i] = Centroid{as_double(state[3 + 2 * i]),
+                                   state[4 + 2 * i].as_int()};
+  return size + count;
+}
+
+void store_centroids(Register* state, const Centroids& centroids,
+                     size_t size) {
+  assert(size <= QuantileSketch::CAPACITY);
+  state[0] = Register::from_int(static_cast<int64_t>(size));
+  for (size_t i = 0; i < size; ++i) {
+    state[3 + 2 * i] = from_double(centroids[i].mean);
+    state[4 + 2 * i] = Register::from_int(centroids[i].count);
+  }
+}
+
+/// The scale function k_1 of the t-digest, which maps a quantile to the
+/// index of its centroid. It is steep near 0 and 1, so centroids there
+/// stay small.
+double scale(double q) {
+  return QuantileSketch::COMPRESSION / (2 * M_PI) * std::asin(2 * q - 1);
+}
+
+/// The inverse of `scale()`.
+double inverse_scale(double k) {
+  if (k >= QuantileSketch::COMPRESSION / 4) return 1;
+  return (std::sin(k * 2 * M_PI / QuantileSketch::COMPRESSION) + 1) / 2;
+}
+
+/// Sorts the centroids and merges neighbours whose merged centroid spans
+/// at most one unit of `scale()`. Returns the new number of centroids,
+/// which is at most `COMPRESSION + 2`.
+size_t compress(Centroids& centroids, size_t size) {
+  if (size == 0) return 0;
+  std::sort(centroids.begin(), centroids.begin() + size,
+            [](const Centroid& c1, const Centroid& c2) {
+              return c1.mean < c2.mean;
+            });
+  double total = 0;
+  for (size_t i = 0; i < size; ++i) total += centroids[i].count;
+
+  size_t merged = 0;
+  // The number of values before the current centroid, and the maximum
+  // number of values up to its end.
+  double before = 0;
+  double limit = total * inverse_scale(scale(0) + 1);
+  for (size_t i = 1; i < size; ++i) {
+    Centroid& current = centroids[merged];
+    const Centroid& next = centroids[i];
+    if (before + current.count + next.count <= limit) {
+      current.mean += (next.mean - current.mean) * next.count /
+                      static_cast<double>(current.count + next.count);
+      current.count += next.count;
+    } else {
+      before += current.count;
+      limit = total * inverse_scale(scale(before / total) + 1);
+      centroids[++merged] = next;
+    }
+  }
+  return merged + 1;
+}
+
+}  // namespace
+
+void HyperLogLog::init(Register* state) {
+  std::fill(state, state + STATE_SIZE, Register::from_int(0));
+}
+
+void HyperLogLog::add(Register* state, uint64_t hash) {
+  hash = mix(hash);
+  size_t bucket = hash >> (64 - PRECISION);
+  // The rank is the position of the first set bit in the remaining bits.
+  uint64_t remaining = hash << PRECISION;
+  uint8_t rank =
+      remaining ? __builtin_clzll(remaining) + 1 : 64 - PRECISION + 1;
+
+  Register& reg = state[bucket / BUCKETS_PER_REGISTER];
+  auto buckets = get_buckets(reg);
+  uint8_t& value = buckets[bucket % BUCKETS_PER_REGISTER];
+  if (rank <= value) return;
+  value = rank;
+  reg = from_buckets(buckets);
+}
+
+void HyperLogLog::merge(Register* state, const Register* other) {
+  for (size_t i = 0; i < STATE_SIZE; ++i) {
+    auto buckets = get_buckets(state[i]);
+    auto other_buckets = get_buckets(other[i]);
+    for (size_t j = 0; j < BUCKETS_PER_REGISTER; ++j)
+      buckets[j] = std::max(buckets[j], other_buckets[j]);
+    state[i] = from_buckets(buckets);
+  }
+}
+
+uint64_t HyperLogLog::estimate(const Register* state) {
+  double sum = 0;
+  size_t num_zeros = 0;
+  for (size_t i = 0; i < STATE_SIZE; ++i) {
+    for (uint8_t rank : get_buckets(state[i])) {
+      sum += std::ldexp(1.0, -rank);
+      num_zeros += rank == 0;
+    }
+  }
+
+  const double m = NUM_BUCKETS;
+  double estimate = 0.7213 / (1 + 1.079 / m) * m * m / sum;
+  // Small cardinalities are estimated by linear counting of the empty
+  // buckets, which is more accurate for them.
+  if (estimate <= 2.5 * m && num_zeros > 0)
+    estimate = m * std::log(m / num_zeros);
+  return static_cast<uint64_t>(std::llround(estimate));
+}
+
+void QuantileSketch::init(Register* state) {
+  std::fill(state, state + STATE_SIZE, Register::from_int(0));
+}
+
+void QuantileSketch::add(Register* state, int64_t value) {
+  size_t size = static_cast<size_t>(state[0].as_int());
+  if (size == 0 || value < state[1].as_int())
+    state[1] = Register::from_int(value);
+  if (size == 0 || value > state[2].as_int())
+    state[2] = Register::from_int(value);
+  if (size == CAPACITY) {
+    Centroids centroids;
+    size = compress(centroids, load_centroids(state, centroids, 0));
+    store_centroids(state, centroids, size);
+  }
+
+  state[0] = Register::from_int(static_cast<int64_t>(size + 1));
+  state[3 + 2 * size] = from_double(static_cast<double>(value));
+  state[4 + 2 * size] = Register::from_int(1);
+}
+
+void QuantileSketch::merge(Register* state, const Register* other) {
+  if (empty(other)) return;
+  if (empty(state) || other[1].as_int() < state[1].as_int())
+    state[1] = other[1];
+  if (empty(state) || other[2].as_int() > state[2].as_int())
+    state[2] = other[2];
+
+  Centroids centroids;
+  size_t size = load_centroids(state, centroids, 0);
+  size = load_centroids(other, centroids, size);
+  if (size > CAPACITY) size = compress(centroids, size);
+  store_centroids(state, centroids, size);
+}
+
+double QuantileSketch::quantile(const Register* state, double q) {
+  assert(!empty(state));
+  Centroids centroids;
+  size_t size = load_centroids(state, centroids, 0);
+  std::sort(centroids.begin(), centroids.begin() + size,
+            [](const Centroid& c1, const Centroid& c2) {
+              return c1.mean < c2.mean;
+            });
+  const double min = static_cast<double>(state[1].as_int());
+  const double max = static_cast<double>(state[2].as_int());
+  double total = 0;
+  for (size_t i = 0; i < size; ++i) total += centroids[i].count;
+
+  // Every centroid stands for its values spread evenly around its mean, so
+  // the quantile is interpolated between the means of the two centroids
+  // around it, or between a mean and the minimum or maximum at the ends.
+  double rank = std::clamp(q, 0.0, 1.0) * total;
+  double left = centroids[0].count / 2.0;
+  double result;
+  if (rank < left) {
+    result = min + (centroids[0].mean - min) * rank / left;
+  } else {
+    double before = 0;
+    result = centroids[size - 1].mean;
+    size_t i = 0;
+    for (; i + 1 < size; ++i) {
+      double center = before + centroids[i].count / 2.0;
+      double next_center =
+          before + centroids[i].count + centroids[i + 1].count / 2.0;
+      if (rank < next_center) {
+        result = centroids[i].mean + (rank - center) / (next_center - center) *
+                                         (centroids[i + 1].mean -
+                                          centroids[i].mean);
+        break;
+      }
+      before += centroids[i].count;
+    }
+    if (i + 1 == size) {
+      double center = total - centroids[i].count / 2.0;
+      if (total > center)
+        result += (max - result) * (rank - center) / (total - center);
+    }
+  }
+  return std::clamp(result, min, max);
+}
+
+}  // namespace operators
+}  // namespace buzzdb
@@ -0,0 +1,100 @@
+#include "operators/spill_file.h"
+
+#include <cassert>
+#include <cstring>
+#include <stdexcept>
+#include <string_view>
+
+namespace buzzdb {
+namespace operators {
+
+SpillFile::SpillFile() : file(std::tmpfile()), buffer(BUFFER_SIZE) {
+  if (!this->file) throw std::runtime_error("cannot create spill file");
+}
+
+SpillFile::~SpillFile() { std::fclose(this->file); }
+
+void SpillFile::write_register(const Register& reg) {
+  char type = static_cast<char>(reg.get_type());
+  this->write_bytes(&type, 1);
+  if (reg.get_type() == Register::Type::INT64)
+    this->write_bytes(reg.payload_data(), sizeof(int64_t));
+  else if (reg.get_type() == Register::Type::CHAR16)
+    this->write_bytes(reg.payload_data(), REGISTER_SIZE - 1);
+}
+
+void SpillFile::write_tuple(const Register* tuple, size_t width) {
+  for (size_t attr = 0; attr < width; ++attr) this->write_register(tuple[attr]);
+  this->num_tuples++;
+}
+
+void SpillFile::write_tuple(const std::vector<Register*>& tuple) {
+  for (const auto* reg : tuple) this->write_register(*reg);
+  this->num_tuples++;
+}
+
+void SpillFile::write_bytes(const char* data, size_t count) {
+  assert(this->writing);
+  if (this->buffer_pos + count > this->buffer.size()) this->flush();
+  std::memcpy(&this->buffer[this->buffer_pos], data, count);
+  this->buffer_pos += count;
+  this->size += count;
+}
+
+void SpillFile::flush() {
+  if (this->buffer_pos &&
+      std::fwrite(this->buffer.data(), 1, this->buffer_pos, this->file) !=
+          this->buffer_pos)
+    throw std::runtime_error("cannot write spill file");
+  this->buffer_pos = 0;
+}
+
+void SpillFile::rewind() {
+  if (this->writing) this->flush();
+  this->writing = false;
+  std::rewind(this->file);
+  this->buffer_pos = 0;
+  this->buffer_end = 0;
+}
+
+bool SpillFile::read_bytes(char* data, size_t count) {
+  if (this->buffer_pos + count > this->buffer_end) {
+    // Move the unread rest to the front and refill the buffer behind it.
+    size_t rest = this->buffer_end - this->buffer_pos;
+    std::memmove(this->buffer.data(), &this->buffer[this->buffer_pos], rest);
+    this->buffer_end =
+        rest + std::fread(&this->buffer[rest], 1, this->buffer.size() - rest,
+                          this->file);
+    this->buffer_pos = 0;
+    if (count > this->buffer_end) return false;
+  }
+
+  std::memcpy(data, &this->buffer[this->buffer_pos], count);
+  this->buffer_pos += count;
+  return true;
+}
+
+bool SpillFile::read_tuple(Register* tuple, size_t width) {
+  for (size_t attr = 0; attr < width; ++attr) {
+    char type;
+    if (!this->read_bytes(&type, 1)) return false;
+
+    if (static_cast<Register::Type>(type) == Register::Type::NULL_VALUE) {
+      tuple[attr] = Register::null();
+    } else if (static_cast<Register::Type>(type) == Register::Type::INT64) {
+      int64_t value;
+      if (!this->read_bytes(reinterpret_cast<char*>(&value), sizeof(value)))
+        return false;
+      tuple[attr] = Register::from_int(value);
+    } else {
+      char chars[REGISTER_SIZE - 1];
+      if (!this->read_bytes(chars, sizeof(chars))) return false;
+      tuple[attr] = Register::from_string(
+          std::string_view{chars, strnlen(chars, sizeof(chars))});
+    }
+  }
+  return true;
+}
+
+}  // namespace operators
+}  // namespace buzzdb
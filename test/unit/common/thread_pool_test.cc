@@ -0,0 +1,62 @@
+#include <gtest/gtest.h>
+#include <atomic>
+#include <cstddef>
+#include <stdexcept>
+#include <vector>
+
+#include "common/thread_pool.h"
+
+namespace {
+
+using buzzdb::ThreadPool;
+
+TEST(ThreadPoolTest, RunsEveryTaskOnce) {
+  for (size_t num_threads : {1, 2, 4}) {
+    ThreadPool pool(num_threads);
+    EXPECT_EQ(num_threads, pool.get_num_threads());
+
+    // Reuse the pool for several jobs of different sizes.
+    for (size_t num_tasks : {0, 1, 3, 100}) {
+      std::vector<std::atomic<int>> calls(num_tasks);
+      pool.parallel_for(num_tasks, [&](size_t i) { calls[i]++; });
+      for (auto& count : calls) EXPECT_EQ(1, count.load());
+    }
+  }
+}
+
+TEST(ThreadPoolTest, RethrowsExceptions) {
+  ThreadPool pool(3);
+  EXPECT_THROW(pool.parallel_for(10,
+                                 [](size_t i) {
+                                   if (i == 7) throw std::runtime_error("7");
+                                 }),
+               std::runtime_error);
+
+  // The pool stays usable.
+  std::atomic<size_t> sum{0};
+  pool.parallel_for(10, [&](size_t i) { sum += i; });
+  EXPECT_EQ(45, sum.load());
+}
+
+TEST(ThreadPoolTest, PassesThreadIndexes) {
+  // Tasks of the same thread never overlap.
+  ThreadPool pool(4);
+  std::vector<std::atomic<int>> running(pool.get_num_threads());
+  std::atomic<size_t> calls{0};
+  std::atomic<bool> overlapped{false};
+  pool.parallel_for(1000, [&](size_t, size_t thread) {
+    ASSERT_LT(thread, pool.get_num_threads());
+    if (running[thread]++ != 0) overlapped = true;
+    calls++;
+    running[thread]--;
+  });
+  EXPECT_EQ(1000, calls.load());
+  EXPECT_FALSE(overlapped.load());
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,93 @@
+#include <gtest/gtest.h>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "operators/aggregation_hash_table.h"
+#include "operators/operators.h"
+
+namespace {
+
+using buzzdb::operators::AggregationHashTable;
+using buzzdb::operators::CompositeKey;
+using buzzdb::operators::Register;
+
+TEST(AggregationHashTableTest, InsertsEveryKeyOnce) {
+  // Keys which are multiples of a power of two collide under weak hashes,
+  // and the directory grows several times.
+  AggregationHashTable table;
+  table.reset(1, 2);
+  for (int64_t i = 0; i < 10000; ++i) {
+    Register key = Register::from_int((i % 1000) * 1024);
+    auto [row, inserted] = table.insert(&key, key.get_hash());
+    EXPECT_EQ(i < 1000, inserted);
+    EXPECT_EQ(key, row[0]);
+    if (inserted) {
+      EXPECT_TRUE(row[1].is_null());
+      row[1] = Register::from_int(0);
+    }
+    row[1] = Register::from_int(row[1].as_int() + 1);
+  }
+
+  ASSERT_EQ(1000, table.get_num_groups());
+  for (size_t group = 0; group < 1000; ++group) {
+    const Register* row = table.get_row(group);
+    EXPECT_EQ(static_cast<int64_t>(group) * 1024, row[0].as_int());
+    EXPECT_EQ(10, row[1].as_int());
+  }
+}
+
+TEST(AggregationHashTableTest, CompositeKeys) {
+  AggregationHashTable table;
+  table.reset(2, 3);
+  auto insert = [&](Register key0, Register key1) {
+    Register key[] = {key0, key1};
+    return table.insert(key, CompositeKey::hash(key, 2)).second;
+  };
+
+  EXPECT_TRUE(insert(Register::from_int(1), Register::from_string("a")));
+  EXPECT_TRUE(insert(Register::from_int(1), Register::from_string("b")));
+  EXPECT_TRUE(insert(Register::from_int(2), Register::from_string("a")));
+  EXPECT_TRUE(insert(Register::from_string("a"), Register::from_int(1)));
+  EXPECT_FALSE(insert(Register::from_int(1), Register::from_string("b")));
+  // NULLs are grouped like any other value.
+  EXPECT_TRUE(insert(Register::null(), Register::from_string("a")));
+  EXPECT_FALSE(insert(Register::null(), Register::from_string("a")));
+  EXPECT_EQ(5, table.get_num_groups());
+}
+
+TEST(AggregationHashTableTest, Find) {
+  AggregationHashTable table;
+  table.reset(1, 2);
+  for (int64_t i = 0; i < 1000; i += 2) {
+    Register key = Register::from_int(i);
+    table.insert(&key, key.get_hash()).first[1] = Register::from_int(-i);
+  }
+
+  for (int64_t i = 0; i < 1000; ++i) {
+    Register key = Register::from_int(i);
+    Register* row = table.find(&key, key.get_hash());
+    if (i % 2) {
+      EXPECT_EQ(nullptr, row);
+    } else {
+      ASSERT_NE(nullptr, row);
+      EXPECT_EQ(-i, row[1].as_int());
+    }
+  }
+  EXPECT_EQ(500, table.get_num_groups());
+}
+
+TEST(AggregationHashTableTest, EmptyKey) {
+  AggregationHashTable table;
+  table.reset(0, 1);
+  EXPECT_TRUE(table.insert(nullptr, 0).second);
+  EXPECT_FALSE(table.insert(nullptr, 0).second);
+  EXPECT_EQ(1, table.get_num_groups());
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
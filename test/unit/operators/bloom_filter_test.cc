@@ -0,0 +1,41 @@
+#include <gtest/gtest.h>
+#include <cstdint>
+#include <string>
+
+#include "operators/bloom_filter.h"
+#include "operators/operators.h"
+
+namespace {
+
+using buzzdb::operators::BloomFilter;
+using buzzdb::operators::Register;
+
+TEST(BloomFilterTest, NoFalseNegatives) {
+  BloomFilter filter(10000);
+  for (int64_t i = 0; i < 10000; ++i)
+    filter.insert(Register::from_int(i * 3).get_hash());
+  for (int64_t i = 0; i < 10000; ++i)
+    EXPECT_TRUE(filter.may_contain(Register::from_int(i * 3).get_hash()));
+}
+
+TEST(BloomFilterTest, FalsePositiveRate) {
+  BloomFilter filter(10000);
+  EXPECT_EQ(0, filter.estimate_false_positive_rate());
+  for (int64_t i = 0; i < 10000; ++i)
+    filter.insert(Register::from_string("key" + std::to_string(i)).get_hash());
+
+  size_t false_positives = 0;
+  for (int64_t i = 0; i < 100000; ++i)
+    false_positives += filter.may_contain(
+        Register::from_string("other" + std::to_string(i)).get_hash());
+  double rate = false_positives / 100000.0;
+  EXPECT_LT(rate, 0.005);
+  EXPECT_NEAR(rate, filter.estimate_false_positive_rate(), 0.002);
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,109 @@
+#include <gtest/gtest.h>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "operators/join_hash_table.h"
+#include "operators/operators.h"
+
+namespace {
+
+using buzzdb::operators::CompositeKey;
+using buzzdb::operators::JoinHashTable;
+using buzzdb::operators::Register;
+
+/// Returns the values of the second attribute of all matches of `key`.
+std::vector<int64_t> matches(const JoinHashTable& table, const Register& key) {
+  std::vector<int64_t> values;
+  for (uint32_t t = table.find(&key); t != JoinHashTable::NONE;
+       t = table.next_match(t))
+    values.push_back(table.get_tuple(t)[1].as_int());
+  return values;
+}
+
+TEST(JoinHashTableTest, Empty) {
+  JoinHashTable table;
+  Register key = Register::from_int(1);
+  EXPECT_EQ(JoinHashTable::NONE, table.find(&key));
+  table.reset(2, CompositeKey({0}));
+  table.build();
+  EXPECT_EQ(0, table.get_num_tuples());
+  EXPECT_EQ(JoinHashTable::NONE, table.find(&key));
+}
+
+TEST(JoinHashTableTest, ChainsDuplicatesInInsertionOrder) {
+  // Keys which are multiples of a power of two collide under weak hashes.
+  JoinHashTable table;
+  table.reset(2, CompositeKey({0}));
+  for (int64_t i = 0; i < 10000; ++i) {
+    Register* tuple = table.append_tuple();
+    tuple[0] = Register::from_int((i % 1000) * 1024);
+    tuple[1] = Register::from_int(i);
+  }
+  table.build();
+
+  EXPECT_EQ(10000, table.get_num_tuples());
+  for (int64_t key = 0; key < 1000; ++key) {
+    std::vector<int64_t> expected;
+    for (int64_t i = key; i < 10000; i += 1000) expected.push_back(i);
+    EXPECT_EQ(expected, matches(table, Register::from_int(key * 1024)));
+  }
+  EXPECT_TRUE(matches(table, Register::from_int(1)).empty());
+}
+
+TEST(JoinHashTableTest, StringKeys) {
+  JoinHashTable table;
+  table.reset(2, CompositeKey({0}));
+  for (int64_t i = 0; i < 100; ++i) {
+    Register* tuple = table.append_tuple();
+    tuple[0] = Register::from_string("key" + std::to_string(i % 10));
+    tuple[1] = Register::from_int(i);
+  }
+  table.build();
+
+  EXPECT_EQ(10, matches(table, Register::from_string("key3")).size());
+  EXPECT_TRUE(matches(table, Register::from_string("key")).empty());
+  // Integers and strings with the same bytes are different keys.
+  EXPECT_TRUE(matches(table, Register::from_int(3)).empty());
+}
+
+TEST(JoinHashTableTest, CompositeKeys) {
+  // The key consists of the first and the third attribute.
+  JoinHashTable table;
+  table.reset(3, CompositeKey({0, 2}));
+  for (int64_t i = 0; i < 1000; ++i) {
+    Register* tuple = table.append_tuple();
+    tuple[0] = Register::from_int(i % 10);
+    tuple[1] = Register::from_int(i);
+    tuple[2] = i % 100 == 0
+                   ? Register::null()
+                   : Register::from_string("k" + std::to_string(i % 4));
+  }
+  table.build();
+
+  auto find_all = [&](Register key0, Register key2) {
+    std::vector<int64_t> values;
+    Register key[] = {key0, key2};
+    for (uint32_t t = table.find(key); t != JoinHashTable::NONE;
+         t = table.next_match(t))
+      values.push_back(table.get_tuple(t)[1].as_int());
+    return values;
+  };
+  // Tuples 2, 22, 42, ... have the key (2, "k2") except every 100th one,
+  // whose NULL attribute matches nothing.
+  std::vector<int64_t> expected;
+  for (int64_t i = 2; i < 1000; i += 20)
+    if (i % 100 != 0) expected.push_back(i);
+  EXPECT_EQ(expected,
+            find_all(Register::from_int(2), Register::from_string("k2")));
+  EXPECT_TRUE(
+      find_all(Register::from_int(2), Register::from_string("k1")).empty());
+  EXPECT_TRUE(find_all(Register::from_int(0), Register::null()).empty());
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
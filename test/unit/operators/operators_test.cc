@@ -1,26 +1,39 @@
 #include <gtest/gtest.h>
 #include <algorithm>
+#include <cstring>
+#include <functional>
+#include <limits>
+#include <map>
+#include <numeric>
+#include <optional>
+#include <set>
 #include <sstream>
+#include <stdexcept>
 #include <string>
 #include <tuple>
 #include <utility>
 #include <vector>
 
+#include "operators/join_hash_table.h"
 #include "operators/operators.h"
 
 namespace {
 
 using namespace std::literals::string_literals;
 
+using buzzdb::operators::Batch;
 using buzzdb::operators::Except;
 using buzzdb::operators::ExceptAll;
 using buzzdb::operators::HashAggregation;
 using buzzdb::operators::HashJoin;
 using buzzdb::operators::Intersect;
 using buzzdb::operators::IntersectAll;
+using buzzdb::operators::JoinHashTable;
+using buzzdb::operators::Operator;
 using buzzdb::operators::Print;
 using buzzdb::operators::Projection;
 using buzzdb::operators::Register;
+using buzzdb::operators::RuntimeFilter;
 using buzzdb::operators::Select;
 using buzzdb::operators::Sort;
 using buzzdb::operators::Union;
@@ -71,6 +84,56 @@ TEST(OperatorsTest, Register) {
   EXPECT_EQ(reg_s1.get_hash(), reg_s3.get_hash());
 }
 
+TEST(OperatorsTest, RegisterShortString) {
+  auto reg_s1 = Register::from_string("abc"s);
+  auto reg_s2 = Register::from_string("abcd"s);
+  auto reg_s3 = Register::from_string(""s);
+
+  EXPECT_EQ("abc"s, reg_s1.as_string());
+  EXPECT_EQ("abc", reg_s1.as_string_view());
+  EXPECT_EQ(""s, reg_s3.as_string());
+  EXPECT_EQ(0u, reg_s3.as_string_view().size());
+
+  EXPECT_LT(reg_s1, reg_s2);
+  EXPECT_LT(reg_s3, reg_s1);
+  EXPECT_GT(Register::from_string("b"s), reg_s2);
+
+  Register copy = reg_s2;
+  EXPECT_EQ(reg_s2, copy);
+  EXPECT_EQ("abcd"s, copy.as_string());
+
+  EXPECT_EQ("sixteen chars..."s,
+            Register::from_string("sixteen chars..."s).as_string());
+  EXPECT_THROW(Register::from_string("seventeen chars.."s),
+               std::invalid_argument);
+}
+
+TEST(OperatorsTest, RegisterEqualityComparesValues) {
+  // Both registers have an all-zero payload but different types.
+  EXPECT_NE(Register::from_int(0), Register::from_string(""s));
+  EXPECT_NE(Register::from_int(1), Register::from_int(-1));
+  EXPECT_EQ(Register::from_int(-1), Register::from_int(-1));
+}
+
+TEST(OperatorsTest, RegisterNull) {
+  Register null = Register::null();
+  EXPECT_TRUE(null.is_null());
+  EXPECT_FALSE(Register::from_int(0).is_null());
+  EXPECT_NE(Register::from_int(0), null);
+  EXPECT_NE(Register::from_string(""s), null);
+
+  // NULLs sort after all values.
+  char null_key[Register::SORT_KEY_SIZE], int_key[Register::SORT_KEY_SIZE];
+  null.write_sort_key(null_key, false);
+  Register::from_int(std::numeric_limits<int64_t>::max())
+      .write_sort_key(int_key, false);
+  EXPECT_GT(std::memcmp(null_key, int_key, Register::SORT_KEY_SIZE), 0);
+  null.write_sort_key(null_key, true);
+  Register::from_int(std::numeric_limits<int64_t>::min())
+      .write_sort_key(int_key, true);
+  EXPECT_GT(std::memcmp(null_key, int_key, Register::SORT_KEY_SIZE), 0);
+}
+
 Register convert_to_register(int64_t value) {
   return Register::from_int(value);
 }
@@ -79,6 +142,10 @@ Register convert_to_register(const std::string& value) {
   return Register::from_string(value);
 }
 
+Register convert_to_register(const std::optional<int64_t>& value) {
+  return value ? Register::from_int(*value) : Register::null();
+}
+
 template <typename... Ts, size_t... Is>
 void write_to_registers_impl(std::vector<Register>& registers,
                              const std::tuple<Ts...>& tuple,
@@ -98,6 +165,7 @@ class TestTupleSource : public buzzdb::operators::Operator {
   const std::vector<std::tuple<Ts...>>& tuples;
   size_t current_index = 0;
   std::vector<Register> output_regs;
+  std::vector<Register*> output;
 
  public:
   bool opened = false;
@@ -107,7 +175,11 @@ class TestTupleSource : public buzzdb::operators::Operator {
       : tuples(tuples) {}
 
   void open() override {
+    // Sources start over when they are opened again.
+    current_index = 0;
     output_regs.resize(sizeof...(Ts));
+    output.clear();
+    for (auto& reg : output_regs) output.push_back(&reg);
     opened = true;
   }
 
@@ -122,18 +194,15 @@ class TestTupleSource : public buzzdb::operators::Operator {
   }
 
   void close() override {
+    output.clear();
     output_regs.clear();
     closed = true;
   }
 
-  std::vector<Register*> get_output() override {
-    std::vector<Register*> output;
-    output.reserve(sizeof...(Ts));
-    for (auto& reg : output_regs) {
-      output.push_back(&reg);
-    }
-    return output;
-  }
+  const std::vector<Register*>& get_output() override { return output; }
+
+  /// Returns the number of tuples read so far.
+  size_t num_read() const { return current_index; }
 };
 
 const std::vector<std::tuple<int64_t, std::string>> relation_students{
@@ -174,6 +243,28 @@ std::string sort_output(const std::string& str) {
   return sorted_str;
 }
 
+/// Runs `print` with the batch-at-a-time interface.
+void print_batches(Print& print) {
+  Batch batch;
+  print.open();
+  while (print.next_batch(batch)) {
+  }
+  print.close();
+}
+
+/// Runs `print` with the batch-at-a-time interface when `batches` is set,
+/// and tuple at a time otherwise.
+void run_print(Print& print, bool batches) {
+  if (batches) {
+    print_batches(print);
+    return;
+  }
+  print.open();
+  while (print.next()) {
+  }
+  print.close();
+}
+
 TEST(OperatorsTest, Print) {
   TestTupleSource source{relation_students};
   std::stringstream output;
@@ -215,6 +306,32 @@ TEST(OperatorsTest, Projection) {
   EXPECT_EQ(expected_output, sort_output(output.str()));
 }
 
+TEST(OperatorsTest, GetOutputIsStable) {
+  TestTupleSource source{relation_students};
+  Projection projection{source, {1}};
+
+  projection.open();
+  ASSERT_TRUE(projection.next());
+  const auto& output = projection.get_output();
+  ASSERT_EQ(1u, output.size());
+  EXPECT_EQ("Xenokrates      "s, output[0]->as_string());
+  EXPECT_EQ(&output, &projection.get_output());
+  EXPECT_EQ(output, projection.get_output());
+
+  ASSERT_TRUE(projection.next());
+  EXPECT_EQ("Fichte          "s, projection.get_output()[0]->as_string());
+  projection.close();
+
+  TestTupleSource source_left{relation_set_a};
+  TestTupleSource source_right{relation_set_b};
+  Union union_{source_left, source_right};
+  union_.open();
+  ASSERT_TRUE(union_.next());
+  EXPECT_EQ(1u, union_.get_output().size());
+  EXPECT_EQ(1u, union_.get_output().size());
+  union_.close();
+}
+
 TEST(OperatorsTest, SelectIntEq) {
   TestTupleSource source{relation_students};
   Select select{source, Select::PredicateAttributeInt64{
@@ -340,6 +457,66 @@ TEST(OperatorsTest, SelectAttrAttr) {
   EXPECT_EQ(expected_output, sort_output(output.str()));
 }
 
+TEST(OperatorsTest, SelectPredicateTree) {
+  std::vector<std::tuple<int64_t, std::string>> relation;
+  for (int64_t i = 0; i < 3000; ++i)
+    relation.emplace_back(i, (i % 4) ? "other" : "match");
+
+  // (a >= 10 AND a < 20) OR (NOT b == "match" AND a > 2990)
+  auto make_predicate = [] {
+    using Predicate = Select::Predicate;
+    return Predicate::disjunction(
+        {Predicate::conjunction(
+             {Predicate::from_int({0, 10, Select::PredicateType::GE}),
+              Predicate::from_int({0, 20, Select::PredicateType::LT})}),
+         Predicate::conjunction(
+             {Predicate::negation(Predicate::from_string(
+                  {1, "match", Select::PredicateType::EQ})),
+              Predicate::from_int({0, 2990, Select::PredicateType::GT})})});
+  };
+
+  std::string expected_output;
+  for (int64_t i = 0; i < 3000; ++i) {
+    bool other = (i % 4) != 0;
+    if ((i >= 10 && i < 20) || (other && i > 2990))
+      expected_output +=
+          std::to_string(i) + "," + (other ? "other" : "match") + "\n";
+  }
+
+  for (bool batch_mode : {false, true}) {
+    TestTupleSource source{relation};
+    Select select{source, make_predicate()};
+    std::stringstream output;
+    Print print{select, output};
+
+    run_print(print, batch_mode);
+    EXPECT_EQ(expected_output, output.str());
+  }
+}
+
+TEST(OperatorsTest, SelectReordersConjuncts) {
+  std::vector<std::tuple<int64_t, int64_t>> relation;
+  for (int64_t i = 0; i < 64 * 1024; ++i) relation.emplace_back(i, i % 100);
+
+  // The first conjunct passes every row, the second one almost none.
+  using Predicate = Select::Predicate;
+  TestTupleSource source{relation};
+  Select select{source,
+                Predicate::conjunction(
+                    {Predicate::from_int({0, 0, Select::PredicateType::GE}),
+                     Predicate::from_int({1, 7, Select::PredicateType::EQ})})};
+  std::stringstream output;
+  Print print{select, output};
+
+  print_batches(print);
+
+  const auto& conjuncts = select.get_predicate().get_children();
+  ASSERT_EQ(2u, conjuncts.size());
+  EXPECT_EQ(Select::PredicateType::EQ, conjuncts[0].get_predicate_type());
+  auto lines = output.str();
+  EXPECT_EQ(656, std::count(lines.begin(), lines.end(), '\n'));
+}
+
 TEST(OperatorsTest, Sort) {
   TestTupleSource source{relation_grades};
   Sort sort{source, {{0, true}, {2, false}}};
@@ -361,6 +538,168 @@ TEST(OperatorsTest, Sort) {
   EXPECT_EQ(expected_output, output.str());
 }
 
+TEST(OperatorsTest, SortMultipleKeys) {
+  static const std::vector<std::tuple<std::string, int64_t, int64_t>>
+      relation{{"b", -5, 1}, {"a", 3, 2}, {"b", 7, 3}, {"a", -10, 4},
+               {"b", -5, 5}, {"c", 0, 6}, {"a", 3, 7}};
+  TestTupleSource source{relation};
+  Sort sort{source, {{0, false}, {1, true}}, Sort::Options{true}};
+  std::stringstream output;
+  Print print{sort, output};
+
+  print.open();
+  while (print.next()) {
+  }
+  print.close();
+
+  // Ties in both keys keep their input order.
+  auto expected_output =
+      ("a,3,2\n"
+       "a,3,7\n"
+       "a,-10,4\n"
+       "b,7,3\n"
+       "b,-5,1\n"
+       "b,-5,5\n"
+       "c,0,6\n"s);
+  EXPECT_EQ(expected_output, output.str());
+}
+
+TEST(OperatorsTest, SortDescendingNull) {
+  static const std::vector<std::tuple<std::optional<int64_t>, int64_t>>
+      relation{{3, 1}, {std::nullopt, 2}, {-4, 3}, {7, 4}, {std::nullopt, 5}};
+  TestTupleSource source{relation};
+  Sort sort{source, {{0, true}}, Sort::Options{true}};
+  std::stringstream output;
+  Print print{sort, output};
+
+  print.open();
+  while (print.next()) {
+  }
+  print.close();
+
+  // NULLs sort last in descending order as well.
+  EXPECT_EQ("7,4\n3,1\n-4,3\nNULL,2\nNULL,5\n", output.str());
+}
+
+TEST(OperatorsTest, SortParallel) {
+  std::vector<std::tuple<int64_t, std::string, int64_t>> relation;
+  for (int64_t i = 0; i < 100000; ++i)
+    relation.emplace_back((i * 7919) % 1009, std::to_string(i % 13), i);
+
+  auto sort_relation = [&](size_t num_threads) {
+    Sort::Options options;
+    options.stable = true;
+    options.num_threads = num_threads;
+    TestTupleSource source{relation};
+    Sort sort{source, {{1, true}, {0, false}}, options};
+    std::stringstream output;
+    Print print{sort, output};
+    print.open();
+    while (print.next()) {
+    }
+    print.close();
+    return output.str();
+  };
+
+  // Odd and even partition counts, and more threads than tuples allow.
+  std::string serial = sort_relation(1);
+  EXPECT_EQ(serial, sort_relation(2));
+  EXPECT_EQ(serial, sort_relation(3));
+  EXPECT_EQ(serial, sort_relation(5));
+  EXPECT_EQ(serial, sort_relation(64));
+}
+
+TEST(OperatorsTest, SortLimitOffset) {
+  std::vector<std::tuple<int64_t, int64_t>> relation;
+  for (int64_t i = 0; i < 1000; ++i) relation.emplace_back((i * 31) % 97, i);
+
+  auto sort_relation = [&](size_t limit, size_t offset) {
+    Sort::Options options;
+    options.stable = true;
+    options.limit = limit;
+    options.offset = offset;
+    TestTupleSource source{relation};
+    Sort sort{source, {{0, true}}, options};
+    std::stringstream output;
+    Print print{sort, output};
+    print.open();
+    while (print.next()) {
+    }
+    print.close();
+    return output.str();
+  };
+
+  // Returns the lines [begin, end) of the sorted relation.
+  std::string all = sort_relation(Sort::NO_LIMIT, 0);
+  auto lines = [&](size_t begin, size_t end) {
+    std::vector<size_t> starts{0};
+    for (size_t i = 0; i < all.size(); ++i)
+      if (all[i] == '\n') starts.push_back(i + 1);
+    begin = std::min(begin, starts.size() - 1);
+    end = std::min(end, starts.size() - 1);
+    return all.substr(starts[begin], starts[end] - starts[begin]);
+  };
+
+  EXPECT_EQ(lines(0, 10), sort_relation(10, 0));
+  EXPECT_EQ(lines(25, 40), sort_relation(15, 25));
+  EXPECT_EQ(lines(990, 1000), sort_relation(100, 990));
+  EXPECT_EQ(lines(0, 1000), sort_relation(5000, 0));
+  EXPECT_EQ(lines(500, 1000), sort_relation(Sort::NO_LIMIT, 500));
+  EXPECT_EQ("", sort_relation(0, 0));
+  EXPECT_EQ("", sort_relation(Sort::NO_LIMIT - 1, 2000));
+}
+
+TEST(OperatorsTest, SortSpillsRuns) {
+  std::vector<std::tuple<int64_t, std::string, int64_t>> relation;
+  for (int64_t i = 0; i < 1000; ++i)
+    relation.emplace_back((i * 37) % 50, "t" + std::to_string(i), i);
+  auto sorted = relation;
+  std::stable_sort(sorted.begin(), sorted.end(), [](auto& t1, auto& t2) {
+    return std::get<0>(t1) < std::get<0>(t2);
+  });
+  std::string expected_output;
+  for (auto& [key, name, i] : sorted)
+    expected_output += std::to_string(key) + "," + name + "," +
+                       std::to_string(i) + "\n";
+
+  // Every run holds 10 tuples, so the 100 runs need an intermediate merge
+  // pass before the last one.
+  Sort::Options options;
+  options.stable = true;
+  options.memory_budget = 10 * (3 * sizeof(Register) + Register::SORT_KEY_SIZE +
+                                sizeof(uint32_t));
+  TestTupleSource source{relation};
+  Sort sort{source, {{0, false}}, options};
+  std::stringstream output;
+  Print print{sort, output};
+
+  print.open();
+  while (print.next()) {
+  }
+  print.close();
+
+  EXPECT_EQ(expected_output, output.str());
+  EXPECT_EQ(100, sort.get_statistics().num_runs);
+  EXPECT_EQ(2, sort.get_statistics().num_merge_passes);
+  EXPECT_GT(sort.get_statistics().spilled_bytes, 0);
+}
+
+TEST(OperatorsTest, SortWithinBudgetDoesNotSpill) {
+  TestTupleSource source{relation_students};
+  Sort sort{source, {{1, false}}};
+  std::stringstream output;
+  Print print{sort, output};
+
+  print.open();
+  while (print.next()) {
+  }
+  print.close();
+
+  EXPECT_EQ(0, sort.get_statistics().num_runs);
+  EXPECT_EQ(0, sort.get_statistics().num_merge_passes);
+  EXPECT_EQ(0, sort.get_statistics().spilled_bytes);
+}
+
 TEST(OperatorsTest, HashJoin) {
   TestTupleSource source_students{relation_students};
   TestTupleSource source_grades{relation_grades};
@@ -386,6 +725,393 @@ TEST(OperatorsTest, HashJoin) {
   EXPECT_EQ(expected_output, sort_output(output.str()));
 }
 
+TEST(OperatorsTest, HashJoinDuplicateKeys) {
+  static const std::vector<std::tuple<int64_t, std::string>> relation_left{
+      {1, "a"}, {2, "b"}, {1, "c"}, {3, "d"}, {1, "e"}};
+  static const std::vector<std::tuple<int64_t, int64_t>> relation_right{
+      {1, 10}, {4, 40}, {1, 11}, {3, 30}};
+  TestTupleSource source_left{relation_left};
+  TestTupleSource source_right{relation_right};
+  HashJoin join{source_left, source_right, 0, 0};
+  std::stringstream output;
+  Print print{join, output};
+
+  print.open();
+  while (print.next()) {
+  }
+  print.close();
+
+  // Every right tuple is joined with all its matches in their input order.
+  auto expected_output =
+      ("1,a,1,10\n"
+       "1,c,1,10\n"
+       "1,e,1,10\n"
+       "1,a,1,11\n"
+       "1,c,1,11\n"
+       "1,e,1,11\n"
+       "3,d,3,30\n"s);
+  EXPECT_EQ(expected_output, output.str());
+}
+
+TEST(OperatorsTest, HashJoinReopen) {
+  // Every right tuple has two partners, so the first output batch is full
+  // in the middle of the first probe batch.
+  std::vector<std::tuple<int64_t, int64_t>> relation_left, relation_right;
+  for (int64_t i = 0; i < 2000; ++i) relation_left.emplace_back(i % 1000, i);
+  for (int64_t i = 0; i < 1000; ++i) relation_right.emplace_back(i, i);
+
+  TestTupleSource source_left{relation_left};
+  TestTupleSource source_right{relation_right};
+  HashJoin join{source_left, source_right, 0, 0};
+  Batch batch;
+  join.open();
+  ASSERT_TRUE(join.next_batch(batch));
+  join.close();
+
+  // Opened again, the join starts over instead of probing the rest of the
+  // previous probe batch.
+  size_t count = 0;
+  join.open();
+  while (join.next_batch(batch)) count += batch.size();
+  join.close();
+  EXPECT_EQ(2000u, count);
+}
+
+TEST(OperatorsTest, HashJoinSpillsPartitions) {
+  // Key 0 occurs 600 times on the left, so its partition cannot be split.
+  std::vector<std::tuple<int64_t, int64_t>> relation_left, relation_right;
+  for (int64_t i = 0; i < 3000; ++i)
+    relation_left.emplace_back(i % 5 == 0 ? 0 : i, i);
+  for (int64_t i = 0; i < 5000; ++i)
+    relation_right.emplace_back((i * 7) % 4000, i);
+
+  auto join_relations = [&](size_t memory_budget,
+                            HashJoin::Statistics* statistics) {
+    TestTupleSource source_left{relation_left};
+    TestTupleSource source_right{relation_right};
+    HashJoin::Options options;
+    options.memory_budget = memory_budget;
+    HashJoin join{source_left, source_right, 0, 0, options};
+    std::stringstream output;
+    Print print{join, output};
+    print.open();
+    while (print.next()) {
+    }
+    print.close();
+    *statistics = join.get_statistics();
+    return sort_output(output.str());
+  };
+
+  HashJoin::Statistics in_memory, hybrid, grace;
+  std::string expected_output =
+      join_relations(std::numeric_limits<size_t>::max(), &in_memory);
+  EXPECT_EQ(0, in_memory.spilled_bytes);
+  EXPECT_EQ(0, in_memory.max_partitioning_depth);
+
+  // The first partition of about 1/16 of the tuples stays in memory.
+  size_t tuple_memory = JoinHashTable::memory_per_tuple(2, 1);
+  EXPECT_EQ(expected_output, join_relations(1000 * tuple_memory, &hybrid));
+  EXPECT_GT(hybrid.spilled_bytes, 0);
+  EXPECT_EQ(15, hybrid.num_spilled_partitions);
+  EXPECT_EQ(1, hybrid.max_partitioning_depth);
+
+  // Everything is spilled and partitioned again.
+  EXPECT_EQ(expected_output, join_relations(20 * tuple_memory, &grace));
+  EXPECT_GT(grace.num_spilled_partitions, 16);
+  EXPECT_EQ(HashJoin::MAX_PARTITIONING_DEPTH, grace.max_partitioning_depth);
+}
+
+TEST(OperatorsTest, HashJoinParallel) {
+  std::vector<std::tuple<int64_t, std::string>> relation_left;
+  std::vector<std::tuple<std::string, int64_t>> relation_right;
+  for (int64_t i = 0; i < 20000; ++i)
+    relation_left.emplace_back(i % 7000, std::to_string(i));
+  for (int64_t i = 0; i < 30000; ++i)
+    relation_right.emplace_back(std::to_string(i), (i * 3) % 9000);
+
+  auto join_relations = [&](size_t num_threads, bool batches) {
+    TestTupleSource source_left{relation_left};
+    TestTupleSource source_right{relation_right};
+    HashJoin::Options options;
+    options.num_threads = num_threads;
+    HashJoin join{source_left, source_right, 0, 1, options};
+    std::stringstream output;
+    Print print{join, output};
+    run_print(print, batches);
+    return sort_output(output.str());
+  };
+
+  std::string expected_output = join_relations(1, false);
+  EXPECT_EQ(expected_output, join_relations(2, false));
+  EXPECT_EQ(expected_output, join_relations(3, true));
+  EXPECT_EQ(expected_output, join_relations(8, true));
+}
+
+TEST(OperatorsTest, HashJoinParallelBudget) {
+  std::vector<std::tuple<int64_t, int64_t>> relation_left, relation_right;
+  for (int64_t i = 0; i < 1000; ++i) relation_left.emplace_back(i, i);
+  for (int64_t i = 0; i < 20000; ++i) relation_right.emplace_back(i % 1500, i);
+
+  TestTupleSource source_left{relation_left};
+  TestTupleSource source_right{relation_right};
+  HashJoin::Options options;
+  options.num_threads = 2;
+  options.memory_budget = 2000 * JoinHashTable::memory_per_tuple(2, 1);
+  HashJoin join{source_left, source_right, 0, 0, options};
+
+  join.open();
+  Batch batch;
+  ASSERT_TRUE(join.next_batch(batch));
+  // The right tuples are read in chunks that fit into the budget.
+  EXPECT_LT(source_right.num_read(), relation_right.size());
+  size_t count = batch.size();
+  while (join.next_batch(batch)) {
+    for (size_t i = 0; i < batch.size(); ++i) {
+      size_t row = batch.row(i);
+      EXPECT_EQ(batch.column(0)[row], batch.column(2)[row]);
+    }
+    count += batch.size();
+  }
+  join.close();
+  EXPECT_EQ(13500u, count);
+}
+
+TEST(OperatorsTest, HashJoinParallelPowerOfTwoKeys) {
+  // Integers hash to themselves, so these keys share all their low bits.
+  // They must still be spread over the buckets of a partition.
+  std::vector<std::tuple<int64_t, int64_t>> relation_left, relation_right;
+  for (int64_t i = 0; i < 50000; ++i) {
+    relation_left.emplace_back(i * 65536, i);
+    relation_right.emplace_back((49999 - i) * 65536, i);
+  }
+
+  for (size_t num_threads : {2, 4}) {
+    TestTupleSource source_left{relation_left};
+    TestTupleSource source_right{relation_right};
+    HashJoin::Options options;
+    options.num_threads = num_threads;
+    HashJoin join{source_left, source_right, 0, 0, options};
+    join.open();
+    Batch batch;
+    size_t count = 0;
+    while (join.next_batch(batch)) {
+      for (size_t i = 0; i < batch.size(); ++i) {
+        size_t row = batch.row(i);
+        EXPECT_EQ(batch.column(0)[row], batch.column(2)[row]);
+        EXPECT_EQ(batch.column(1)[row].as_int(),
+                  49999 - batch.column(3)[row].as_int());
+      }
+      count += batch.size();
+    }
+    join.close();
+    EXPECT_EQ(50000u, count);
+  }
+}
+
+TEST(OperatorsTest, HashJoinRuntimeFilter) {
+  // Only every tenth right tuple has a partner, and half of the right keys
+  // are above the largest left key.
+  std::vector<std::tuple<int64_t, int64_t>> relation_left, relation_right;
+  for (int64_t i = 0; i < 1000; ++i) relation_left.emplace_back(i * 10, i);
+  for (int64_t i = 0; i < 20000; ++i) relation_right.emplace_back(i, i);
+
+  auto join_relations = [&](bool runtime_filter, bool batches,
+                            size_t memory_budget) {
+    TestTupleSource source_left{relation_left};
+    TestTupleSource source_right{relation_right};
+    RuntimeFilter filter{source_right, 0};
+    HashJoin::Options options;
+    options.memory_budget = memory_budget;
+    HashJoin join{source_left, filter, 0, 0, options};
+    if (runtime_filter) join.add_runtime_filter(filter);
+    std::stringstream output;
+    Print print{join, output};
+    run_print(print, batches);
+
+    const auto& statistics = filter.get_statistics();
+    if (runtime_filter) {
+      EXPECT_TRUE(filter.get_filter().has_range);
+      EXPECT_EQ(9990, filter.get_filter().max);
+      EXPECT_EQ(20000, statistics.num_tuples);
+      EXPECT_EQ(10009, statistics.num_pruned_by_range);
+      EXPECT_GT(statistics.get_pruning_ratio(), 0.9);
+      EXPECT_LE(statistics.get_pruning_ratio(), 0.95);
+    } else {
+      EXPECT_EQ(0, statistics.num_tuples);
+    }
+    return sort_output(output.str());
+  };
+
+  const size_t unlimited = std::numeric_limits<size_t>::max();
+  std::string expected_output = join_relations(false, false, unlimited);
+  EXPECT_EQ(1000, std::count(expected_output.begin(), expected_output.end(),
+                             '\n'));
+  EXPECT_EQ(expected_output, join_relations(true, false, unlimited));
+  EXPECT_EQ(expected_output, join_relations(true, true, unlimited));
+  // The filter also covers the spilled left tuples.
+  size_t memory_budget = 100 * JoinHashTable::memory_per_tuple(2, 1);
+  EXPECT_EQ(expected_output, join_relations(true, false, memory_budget));
+}
+
+TEST(OperatorsTest, HashJoinTypes) {
+  using JoinType = HashJoin::JoinType;
+  static const std::vector<std::tuple<std::optional<int64_t>, std::string>>
+      relation_left{{1, "a"}, {2, "b"}, {2, "c"}, {std::nullopt, "d"},
+                    {5, "e"}};
+  static const std::vector<std::tuple<std::optional<int64_t>, int64_t>>
+      relation_right{{2, 10}, {3, 30}, {2, 20}, {std::nullopt, 40}, {1, 50}};
+
+  auto join_relations = [&](JoinType join_type, size_t memory_budget,
+                            bool batches) {
+    TestTupleSource source_left{relation_left};
+    TestTupleSource source_right{relation_right};
+    HashJoin::Options options;
+    options.join_type = join_type;
+    options.memory_budget = memory_budget;
+    HashJoin join{source_left, source_right, 0, 0, options};
+    std::stringstream output;
+    Print print{join, output};
+    run_print(print, batches);
+    return sort_output(output.str());
+  };
+
+  const std::string inner =
+      "1,a,1,50\n"
+      "2,b,2,10\n"
+      "2,b,2,20\n"
+      "2,c,2,10\n"
+      "2,c,2,20\n";
+  const std::string left = "NULL,d,NULL,NULL\n5,e,NULL,NULL\n";
+  const std::string right = "NULL,NULL,3,30\nNULL,NULL,NULL,40\n";
+  const std::vector<std::pair<JoinType, std::string>> expected_outputs{
+      {JoinType::INNER, inner},
+      {JoinType::LEFT_OUTER, inner + left},
+      {JoinType::RIGHT_OUTER, inner + right},
+      {JoinType::FULL_OUTER, inner + left + right},
+      {JoinType::LEFT_SEMI, "1,a\n2,b\n2,c\n"},
+      {JoinType::LEFT_ANTI, "NULL,d\n5,e\n"},
+  };
+
+  // Small budgets spill partitions with tuples on only one side.
+  const size_t unlimited = std::numeric_limits<size_t>::max();
+  const size_t memory_budget = JoinHashTable::memory_per_tuple(2, 1);
+  for (const auto& [join_type, expected_output] : expected_outputs) {
+    std::string sorted_output = sort_output(expected_output);
+    EXPECT_EQ(sorted_output, join_relations(join_type, unlimited, false));
+    EXPECT_EQ(sorted_output, join_relations(join_type, unlimited, true));
+    EXPECT_EQ(sorted_output, join_relations(join_type, memory_budget, false));
+  }
+}
+
+TEST(OperatorsTest, HashJoinCompositeKey) {
+  // The left key (a, b) joins the right key (b, a). Both attributes are
+  // needed to find the partners, and every 50th right tuple has a NULL.
+  std::vector<std::tuple<int64_t, std::string, int64_t>> relation_left;
+  std::vector<std::tuple<std::string, std::optional<int64_t>, int64_t>>
+      relation_right;
+  for (int64_t i = 0; i < 600; ++i)
+    relation_left.emplace_back(i % 30, "b" + std::to_string(i % 7), i);
+  for (int64_t i = 0; i < 900; ++i)
+    relation_right.emplace_back(
+        "b" + std::to_string(i % 11),
+        i % 50 == 0 ? std::nullopt : std::optional<int64_t>{i % 40}, i);
+
+  std::string expected_output;
+  for (const auto& [a, b, l] : relation_left)
+    for (const auto& [b2, a2, r] : relation_right)
+      if (a2 && *a2 == a && b2 == b)
+        expected_output += std::to_string(a) + "," + b + "," +
+                           std::to_string(l) + "," + b2 + "," +
+                           std::to_string(*a2) + "," + std::to_string(r) +
+                           "\n";
+  expected_output = sort_output(expected_output);
+  ASSERT_FALSE(expected_output.empty());
+
+  auto join_relations = [&](HashJoin::Options options, bool batches) {
+    TestTupleSource source_left{relation_left};
+    TestTupleSource source_right{relation_right};
+    RuntimeFilter filter{source_right, {1, 0}};
+    HashJoin join{source_left, filter, {0, 1}, {1, 0}, options};
+    join.add_runtime_filter(filter);
+    std::stringstream output;
+    Print print{join, output};
+    run_print(print, batches);
+    // Ranges are only published for keys of a single attribute.
+    EXPECT_FALSE(filter.get_filter().has_range);
+    EXPECT_GT(filter.get_statistics().num_pruned_by_bloom, 0);
+    return sort_output(output.str());
+  };
+
+  HashJoin::Options options;
+  EXPECT_EQ(expected_output, join_relations(options, false));
+  EXPECT_EQ(expected_output, join_relations(options, true));
+  options.memory_budget = 20 * JoinHashTable::memory_per_tuple(3, 2);
+  EXPECT_EQ(expected_output, join_relations(options, false));
+  options.memory_budget = std::numeric_limits<size_t>::max();
+  options.num_threads = 2;
+  EXPECT_EQ(expected_output, join_relations(options, true));
+}
+
+TEST(OperatorsTest, SelectNull) {
+  static const std::vector<std::tuple<std::optional<int64_t>, int64_t>>
+      relation{{1, 1}, {std::nullopt, 2}, {3, 3}};
+  for (bool batches : {false, true}) {
+    TestTupleSource source{relation};
+    Select select{source,
+                  Select::PredicateAttributeInt64{
+                      0, 2, Select::PredicateType::NE}};
+    std::stringstream output;
+    Print print{select, output};
+    run_print(print, batches);
+
+    // Comparisons with NULL are never true.
+    EXPECT_EQ("1,1\n3,3\n", output.str());
+  }
+}
+
+TEST(OperatorsTest, SelectNotNull) {
+  static const std::vector<std::tuple<std::optional<int64_t>, int64_t>>
+      relation{{1, 1}, {std::nullopt, 2}, {3, 3}, {std::nullopt, 4}};
+  using Predicate = Select::Predicate;
+  auto a_eq_3 = [] {
+    return Predicate::from_int({0, 3, Select::PredicateType::EQ});
+  };
+  auto b_eq_4 = [] {
+    return Predicate::from_int({1, 4, Select::PredicateType::EQ});
+  };
+  // NOT of an unknown comparison is unknown, but NOT (a = 3 AND b = 4) is
+  // true when b = 4 is false, whatever a is.
+  const std::vector<std::pair<std::function<Predicate()>, std::string>>
+      cases{
+          {[&] { return Predicate::negation(a_eq_3()); }, "1,1\n"},
+          {[&] {
+             return Predicate::negation(Predicate::negation(a_eq_3()));
+           },
+           "3,3\n"},
+          {[&] {
+             return Predicate::negation(
+                 Predicate::conjunction({a_eq_3(), b_eq_4()}));
+           },
+           "1,1\nNULL,2\n3,3\n"},
+          {[&] {
+             return Predicate::negation(
+                 Predicate::disjunction({a_eq_3(), b_eq_4()}));
+           },
+           "1,1\n"},
+      };
+
+  for (const auto& [make_predicate, expected_output] : cases) {
+    for (bool batches : {false, true}) {
+      TestTupleSource source{relation};
+      Select select{source, make_predicate()};
+      std::stringstream output;
+      Print print{select, output};
+      run_print(print, batches);
+      EXPECT_EQ(expected_output, output.str());
+    }
+  }
+}
+
 TEST(OperatorsTest, HashAggregationMinMax) {
   TestTupleSource source{relation_students};
   HashAggregation aggregation{
@@ -436,6 +1162,571 @@ TEST(OperatorsTest, HashAggregationSumCount) {
   EXPECT_EQ(expected_output, sort_output(output.str()));
 }
 
+TEST(OperatorsTest, HashAggregationGroups) {
+  // Groups on two attributes, one of which is NULL for some tuples, and
+  // aggregates an attribute which is NULL for other tuples.
+  using AggrFunc = HashAggregation::AggrFunc;
+  std::vector<std::tuple<std::optional<int64_t>, std::string,
+                         std::optional<int64_t>>>
+      relation;
+  for (int64_t i = 0; i < 5000; ++i)
+    relation.emplace_back(
+        i % 97 == 0 ? std::nullopt : std::optional<int64_t>{i % 13},
+        "g" + std::to_string(i % 5),
+        i % 7 == 0 ? std::nullopt : std::optional<int64_t>{i * 1000003});
+
+  struct Group {
+    std::optional<int64_t> min, max, sum;
+    int64_t count = 0, count_all = 0;
+  };
+  std::map<std::pair<std::optional<int64_t>, std::string>, Group> groups;
+  for (const auto& [a, b, value] : relation) {
+    Group& group = groups[{a, b}];
+    group.count_all++;
+    if (!value) continue;
+    group.min = std::min(group.min.value_or(*value), *value);
+    group.max = std::max(group.max.value_or(*value), *value);
+    group.sum = group.sum.value_or(0) + *value;
+    group.count++;
+  }
+  auto to_string = [](std::optional<int64_t> value) {
+    return value ? std::to_string(*value) : "NULL"s;
+  };
+  std::string expected_output;
+  for (const auto& [key, group] : groups)
+    expected_output += to_string(key.first) + "," + key.second + "," +
+                       std::to_string(group.count) + "," +
+                       to_string(group.sum) + "," + to_string(group.min) +
+                       "," + to_string(group.max) + "," +
+                       std::to_string(group.count_all) + "\n";
+  expected_output = sort_output(expected_output);
+
+  for (bool batches : {false, true}) {
+    TestTupleSource source{relation};
+    HashAggregation aggregation{source,
+                                {0, 1},
+                                {
+                                    AggrFunc{AggrFunc::COUNT, 2},
+                                    AggrFunc{AggrFunc::SUM, 2},
+                                    AggrFunc{AggrFunc::MIN, 2},
+                                    AggrFunc{AggrFunc::MAX, 2},
+                                    AggrFunc{AggrFunc::COUNT, 1},
+                                }};
+    std::stringstream output;
+    Print print{aggregation, output};
+    run_print(print, batches);
+    EXPECT_EQ(expected_output, sort_output(output.str()));
+  }
+}
+
+TEST(OperatorsTest, HashAggregationEmptyInput) {
+  using AggrFunc = HashAggregation::AggrFunc;
+  static const std::vector<std::tuple<int64_t, int64_t>> relation;
+  const std::vector<AggrFunc> aggr_funcs{AggrFunc{AggrFunc::COUNT, 0},
+                                         AggrFunc{AggrFunc::SUM, 1}};
+
+  // Only the aggregation without group by attributes outputs a tuple.
+  TestTupleSource source{relation};
+  HashAggregation aggregation{source, {}, aggr_funcs};
+  std::stringstream output;
+  Print print{aggregation, output};
+  print_batches(print);
+  EXPECT_EQ("0,NULL\n", output.str());
+
+  TestTupleSource grouped_source{relation};
+  HashAggregation grouped_aggregation{grouped_source, {0}, aggr_funcs};
+  std::stringstream grouped_output;
+  Print grouped_print{grouped_aggregation, grouped_output};
+  print_batches(grouped_print);
+  EXPECT_EQ("", grouped_output.str());
+}
+
+TEST(OperatorsTest, HashAggregationSumOverflow) {
+  using AggrFunc = HashAggregation::AggrFunc;
+  const int64_t max = std::numeric_limits<int64_t>::max();
+  static const std::vector<std::tuple<int64_t, int64_t>> relation{
+      {1, max}, {2, max}, {1, 1}, {2, -1}};
+
+  // The sum of group 2 stays in range, the one of group 1 does not.
+  TestTupleSource source{relation};
+  HashAggregation aggregation{source, {0}, {AggrFunc{AggrFunc::SUM, 1}}};
+  aggregation.open();
+  EXPECT_THROW(aggregation.next(), std::overflow_error);
+  aggregation.close();
+}
+
+TEST(OperatorsTest, HashAggregationParallel) {
+  using AggrFunc = HashAggregation::AggrFunc;
+  const std::vector<AggrFunc> aggr_funcs{
+      AggrFunc{AggrFunc::SUM, 2}, AggrFunc{AggrFunc::COUNT, 2},
+      AggrFunc{AggrFunc::MIN, 1}, AggrFunc{AggrFunc::MAX, 1}};
+
+  auto aggregate = [&](const auto& relation, std::vector<size_t> group_by,
+                       size_t num_threads, bool batches,
+                       HashAggregation::Statistics* statistics) {
+    TestTupleSource source{relation};
+    HashAggregation::Options options;
+    options.num_threads = num_threads;
+    HashAggregation aggregation{source, group_by, aggr_funcs, options};
+    std::stringstream output;
+    Print print{aggregation, output};
+    run_print(print, batches);
+    if (statistics) *statistics = aggregation.get_statistics();
+    return sort_output(output.str());
+  };
+
+  // Few groups are pre-aggregated by every thread, many unique groups are
+  // moved into the partitions right away.
+  std::vector<std::tuple<int64_t, std::string, std::optional<int64_t>>>
+      relation;
+  for (int64_t i = 0; i < 100000; ++i)
+    relation.emplace_back(i % 10, "s" + std::to_string(i % 1000),
+                          i % 3 ? std::optional<int64_t>{i} : std::nullopt);
+  for (std::vector<size_t> group_by :
+       {std::vector<size_t>{0}, std::vector<size_t>{0, 1},
+        std::vector<size_t>{}}) {
+    std::string expected_output =
+        aggregate(relation, group_by, 1, false, nullptr);
+    HashAggregation::Statistics statistics;
+    EXPECT_EQ(expected_output,
+              aggregate(relation, group_by, 4, false, &statistics));
+    EXPECT_EQ(0, statistics.num_passthrough_threads);
+    EXPECT_LE(statistics.num_partial_groups, 4 * 1000);
+    EXPECT_EQ(expected_output, aggregate(relation, group_by, 3, true, nullptr));
+  }
+
+  std::vector<std::tuple<int64_t, std::string, int64_t>> unique_relation;
+  for (int64_t i = 0; i < 100000; ++i)
+    unique_relation.emplace_back(i * 7, "s", i);
+  std::string expected_output =
+      aggregate(unique_relation, {0}, 1, true, nullptr);
+  HashAggregation::Statistics statistics;
+  EXPECT_EQ(expected_output,
+            aggregate(unique_relation, {0}, 2, true, &statistics));
+  EXPECT_GT(statistics.num_passthrough_threads, 0);
+
+  // Without group by attributes, empty inputs have one group.
+  static const std::vector<std::tuple<int64_t, int64_t, int64_t>> empty;
+  EXPECT_EQ("NULL,0,NULL,NULL\n", aggregate(empty, {}, 2, false, nullptr));
+  EXPECT_EQ("", aggregate(empty, {0}, 2, true, nullptr));
+}
+
+TEST(OperatorsTest, HashAggregationAvgCountDistinct) {
+  using AggrFunc = HashAggregation::AggrFunc;
+  std::vector<std::tuple<int64_t, std::optional<int64_t>, std::string>>
+      relation;
+  for (int64_t i = 0; i < 20000; ++i)
+    relation.emplace_back(i % 10,
+                          i % 11 ? std::optional<int64_t>{i % 17 - 8}
+                                 : std::nullopt,
+                          "s" + std::to_string(i % 1000));
+
+  struct Group {
+    int64_t sum = 0, count = 0;
+    std::set<int64_t> values;
+  };
+  std::map<int64_t, Group> groups;
+  for (const auto& [a, value, s] : relation) {
+    Group& group = groups[a];
+    if (!value) continue;
+    group.sum += *value;
+    group.count++;
+    group.values.insert(*value);
+  }
+  std::string expected_output;
+  for (const auto& [a, group] : groups)
+    expected_output += std::to_string(a) + "," +
+                       std::to_string(group.values.size()) + "," +
+                       std::to_string(group.sum / group.count) + "," +
+                       std::to_string(group.values.size()) + "," +
+                       std::to_string(group.count) + "\n";
+  expected_output = sort_output(expected_output);
+
+  // The groups of COUNT_DISTINCT are aggregated in parallel and spilled
+  // like any other groups.
+  for (size_t num_threads : {1, 3}) {
+    for (size_t memory_budget : {SIZE_MAX, size_t{1} << 12}) {
+      for (bool batches : {false, true}) {
+        TestTupleSource source{relation};
+        HashAggregation::Options options;
+        options.num_threads = num_threads;
+        options.memory_budget = memory_budget;
+        HashAggregation aggregation{source,
+                                    {0},
+                                    {AggrFunc{AggrFunc::COUNT_DISTINCT, 1},
+                                     AggrFunc{AggrFunc::AVG, 1},
+                                     AggrFunc{AggrFunc::COUNT_DISTINCT, 1},
+                                     AggrFunc{AggrFunc::COUNT, 1}},
+                                    options};
+        std::stringstream output;
+        Print print{aggregation, output};
+        run_print(print, batches);
+        EXPECT_EQ(expected_output, sort_output(output.str()));
+        EXPECT_TRUE(source.closed);
+        EXPECT_EQ(memory_budget != SIZE_MAX,
+                  aggregation.get_statistics().spilled_bytes > 0);
+      }
+    }
+  }
+
+  // Without group by attributes, and on an empty input.
+  auto aggregate = [](const auto& relation) {
+    TestTupleSource source{relation};
+    HashAggregation aggregation{source,
+                                {},
+                                {AggrFunc{AggrFunc::AVG, 0},
+                                 AggrFunc{AggrFunc::COUNT_DISTINCT, 1},
+                                 AggrFunc{AggrFunc::SUM, 0}}};
+    std::stringstream output;
+    Print print{aggregation, output};
+    print_batches(print);
+    return output.str();
+  };
+  static const std::vector<std::tuple<int64_t, std::string>> small{
+      {-7, "a"}, {2, "b"}, {1, "a"}, {10, "c"}};
+  EXPECT_EQ("1,3,6\n", aggregate(small));
+  static const std::vector<std::tuple<int64_t, std::string>> empty;
+  EXPECT_EQ("NULL,0,NULL\n", aggregate(empty));
+
+  TestTupleSource source{relation};
+  EXPECT_THROW(
+      (HashAggregation{source,
+                       {0},
+                       {AggrFunc{AggrFunc::COUNT_DISTINCT, 1},
+                        AggrFunc{AggrFunc::COUNT_DISTINCT, 2}}}),
+      std::runtime_error);
+}
+
+TEST(OperatorsTest, HashAggregationApproximate) {
+  using AggrFunc = HashAggregation::AggrFunc;
+  // The groups alternate in runs of 1000 tuples, so the groups are spilled
+  // and merged several times with a small budget. Every value of the
+  // second attribute occurs eight times.
+  std::vector<std::tuple<int64_t, int64_t, std::optional<int64_t>>> relation;
+  std::map<int64_t, std::vector<int64_t>> group_values;
+  for (int64_t i = 0; i < 160000; ++i) {
+    relation.emplace_back(i / 1000 % 4, i / 8,
+                          i % 5 ? std::optional<int64_t>{i / 8}
+                                : std::nullopt);
+    if (i % 5) group_values[i / 1000 % 4].push_back(i / 8);
+  }
+  // The values of a group have gaps, so the error is measured in ranks.
+  auto rank = [&](int64_t group, int64_t value) {
+    const auto& values = group_values[group];
+    return static_cast<double>(
+               std::lower_bound(values.begin(), values.end(), value) -
+               values.begin()) /
+           (values.size() - 1);
+  };
+
+  for (size_t num_threads : {1, 2}) {
+    for (size_t memory_budget : {SIZE_MAX, size_t{1} << 15}) {
+      TestTupleSource source{relation};
+      HashAggregation::Options options;
+      options.num_threads = num_threads;
+      options.memory_budget = memory_budget;
+      HashAggregation aggregation{
+          source,
+          {0},
+          {AggrFunc{AggrFunc::APPROX_COUNT_DISTINCT, 1},
+           AggrFunc{AggrFunc::APPROX_QUANTILE, 2},
+           AggrFunc{AggrFunc::APPROX_QUANTILE, 2, 0.99},
+           AggrFunc{AggrFunc::APPROX_QUANTILE, 2, 1}},
+          options};
+
+      size_t num_groups = 0;
+      aggregation.open();
+      while (aggregation.next()) {
+        const auto& output = aggregation.get_output();
+        int64_t group = output[0]->as_int();
+        EXPECT_NEAR(5000, output[1]->as_int(), 250);
+        EXPECT_NEAR(0.5, rank(group, output[2]->as_int()), 0.002);
+        EXPECT_NEAR(0.99, rank(group, output[3]->as_int()), 0.002);
+        EXPECT_EQ(group_values[group].back(), output[4]->as_int());
+        ++num_groups;
+      }
+      aggregation.close();
+      EXPECT_EQ(4, num_groups);
+      EXPECT_EQ(memory_budget != SIZE_MAX,
+                aggregation.get_statistics().spilled_bytes > 0);
+    }
+  }
+
+  // The quantile of a group without values is NULL.
+  static const std::vector<std::tuple<int64_t, std::optional<int64_t>>>
+      nulls{{1, std::nullopt}};
+  TestTupleSource source{nulls};
+  HashAggregation aggregation{source,
+                              {0},
+                              {AggrFunc{AggrFunc::APPROX_QUANTILE, 1},
+                               AggrFunc{AggrFunc::APPROX_COUNT_DISTINCT, 1}}};
+  std::stringstream output;
+  Print print{aggregation, output};
+  print_batches(print);
+  EXPECT_EQ("1,NULL,0\n", output.str());
+}
+
+TEST(OperatorsTest, HashAggregationOrderedInput) {
+  using AggrFunc = HashAggregation::AggrFunc;
+  const std::vector<AggrFunc> aggr_funcs{AggrFunc{AggrFunc::SUM, 2},
+                                         AggrFunc{AggrFunc::COUNT, 2},
+                                         AggrFunc{AggrFunc::MAX, 2}};
+  auto aggregate = [&](Operator& input, std::vector<size_t> group_by,
+                       bool batches) {
+    HashAggregation::Options options;
+    options.ordered_input = true;
+    HashAggregation aggregation{input, group_by, aggr_funcs, options};
+    std::stringstream output;
+    Print print{aggregation, output};
+    run_print(print, batches);
+    return output.str();
+  };
+
+  // Spans several batches, and groups cross the batch boundaries. The
+  // groups are output in the order of the sort.
+  std::vector<std::tuple<int64_t, std::string, std::optional<int64_t>>>
+      relation;
+  for (int64_t i = 0; i < 5000; ++i)
+    relation.emplace_back(i * 7 % 300, "s" + std::to_string(i % 2),
+                          i % 7 ? std::optional<int64_t>{i} : std::nullopt);
+  std::map<std::pair<int64_t, std::string>, std::vector<int64_t>> groups;
+  for (const auto& [a, b, value] : relation) {
+    auto& values = groups[{a, b}];
+    if (value) values.push_back(*value);
+  }
+  std::string expected_output;
+  for (const auto& [key, values] : groups)
+    expected_output +=
+        std::to_string(key.first) + "," + key.second + "," +
+        std::to_string(std::accumulate(values.begin(), values.end(),
+                                       int64_t{0})) +
+        "," + std::to_string(values.size()) + "," +
+        std::to_string(*std::max_element(values.begin(), values.end())) +
+        "\n";
+  for (bool batches : {false, true}) {
+    TestTupleSource source{relation};
+    Sort sort{source, {{0, false}, {1, false}}};
+    EXPECT_EQ(expected_output, aggregate(sort, {0, 1}, batches));
+  }
+
+  // The input only has to be grouped, not sorted.
+  static const std::vector<std::tuple<int64_t, int64_t, int64_t>> runs{
+      {3, 0, 1}, {3, 0, 2}, {1, 0, 3}, {2, 0, 4}, {2, 0, 5}, {2, 0, 6}};
+  for (bool batches : {false, true}) {
+    TestTupleSource source{runs};
+    EXPECT_EQ("3,3,2,2\n1,3,1,3\n2,15,3,6\n", aggregate(source, {0}, batches));
+  }
+
+  // Without group by attributes, empty inputs have one group.
+  static const std::vector<std::tuple<int64_t, int64_t, int64_t>> empty;
+  for (bool batches : {false, true}) {
+    TestTupleSource source{empty};
+    EXPECT_EQ("NULL,0,NULL\n", aggregate(source, {}, batches));
+    TestTupleSource grouped_source{empty};
+    EXPECT_EQ("", aggregate(grouped_source, {0}, batches));
+  }
+
+  // COUNT_DISTINCT is aggregated with hash tables.
+  TestTupleSource source{runs};
+  HashAggregation::Options options;
+  options.ordered_input = true;
+  HashAggregation aggregation{source,
+                              {1},
+                              {AggrFunc{AggrFunc::COUNT_DISTINCT, 0},
+                               AggrFunc{AggrFunc::SUM, 2}},
+                              options};
+  std::stringstream output;
+  Print print{aggregation, output};
+  print_batches(print);
+  EXPECT_EQ("0,3,21\n", output.str());
+}
+
+TEST(OperatorsTest, HashAggregationSpills) {
+  using AggrFunc = HashAggregation::AggrFunc;
+  const std::vector<AggrFunc> aggr_funcs{
+      AggrFunc{AggrFunc::SUM, 2}, AggrFunc{AggrFunc::COUNT, 2},
+      AggrFunc{AggrFunc::MIN, 1}, AggrFunc{AggrFunc::MAX, 1}};
+
+  std::vector<std::tuple<int64_t, std::string, std::optional<int64_t>>>
+      relation;
+  for (int64_t i = 0; i < 50000; ++i)
+    relation.emplace_back(i * 7919 % 20000, "s" + std::to_string(i % 7),
+                          i % 3 ? std::optional<int64_t>{i} : std::nullopt);
+
+  auto aggregate = [&](std::vector<size_t> group_by, size_t num_threads,
+                       size_t memory_budget, bool batches,
+                       HashAggregation::Statistics* statistics) {
+    TestTupleSource source{relation};
+    HashAggregation::Options options;
+    options.num_threads = num_threads;
+    options.memory_budget = memory_budget;
+    HashAggregation aggregation{source, group_by, aggr_funcs, options};
+    std::stringstream output;
+    Print print{aggregation, output};
+    run_print(print, batches);
+    if (statistics) *statistics = aggregation.get_statistics();
+    return sort_output(output.str());
+  };
+
+  for (std::vector<size_t> group_by :
+       {std::vector<size_t>{0}, std::vector<size_t>{0, 1}}) {
+    const std::string expected_output =
+        aggregate(group_by, 1, SIZE_MAX, true, nullptr);
+    HashAggregation::Statistics statistics;
+    EXPECT_EQ(expected_output,
+              aggregate(group_by, 1, 1 << 20, false, &statistics));
+    EXPECT_GT(statistics.spilled_bytes, 0);
+    EXPECT_GT(statistics.num_spilled_partitions, 0);
+    EXPECT_EQ(1, statistics.max_partitioning_depth);
+
+    EXPECT_EQ(expected_output,
+              aggregate(group_by, 3, 1 << 20, true, &statistics));
+    EXPECT_GT(statistics.spilled_bytes, 0);
+    EXPECT_EQ(1, statistics.max_partitioning_depth);
+
+    // Partitions which still exceed the budget are partitioned again.
+    EXPECT_EQ(expected_output,
+              aggregate(group_by, 1, 1 << 14, true, &statistics));
+    EXPECT_GT(statistics.max_partitioning_depth, 1);
+    EXPECT_EQ(expected_output,
+              aggregate(group_by, 2, 1 << 14, true, &statistics));
+    EXPECT_GT(statistics.max_partitioning_depth, 1);
+  }
+
+  // A single group never exceeds the budget.
+  HashAggregation::Statistics statistics;
+  EXPECT_EQ(aggregate({}, 1, SIZE_MAX, true, nullptr),
+            aggregate({}, 1, 1, true, &statistics));
+  EXPECT_EQ(0, statistics.spilled_bytes);
+}
+
+TEST(BatchOperatorsTest, SelectProjection) {
+  // Spans several batches, so some batches are filtered out completely.
+  std::vector<std::tuple<int64_t, std::string>> relation;
+  for (int64_t i = 0; i < 3000; ++i) relation.emplace_back(i, "row");
+
+  TestTupleSource source{relation};
+  Select select{source, Select::PredicateAttributeInt64{
+                            0, 2500, Select::PredicateType::GE}};
+  Projection projection{select, {1, 0}};
+  std::stringstream output;
+  Print print{projection, output};
+
+  print_batches(print);
+  EXPECT_TRUE(source.opened);
+  EXPECT_TRUE(source.closed);
+
+  std::string expected_output;
+  for (int64_t i = 2500; i < 3000; ++i)
+    expected_output += "row," + std::to_string(i) + "\n";
+  EXPECT_EQ(expected_output, output.str());
+}
+
+TEST(BatchOperatorsTest, SelectAttrAttr) {
+  static const std::vector<std::tuple<int64_t, int64_t>> relation_numbers{
+      {1, 1}, {1, 2}, {1, 3}, {1, 4}, {2, 1}, {2, 3}, {3, 2}};
+  TestTupleSource source{relation_numbers};
+  Select select{source, Select::PredicateAttributeAttribute{
+                            0, 1, Select::PredicateType::LT}};
+  std::stringstream output;
+  Print print{select, output};
+
+  print_batches(print);
+
+  auto expected_output =
+      ("1,2\n"
+       "1,3\n"
+       "1,4\n"
+       "2,3\n"s);
+  EXPECT_EQ(expected_output, output.str());
+}
+
+TEST(BatchOperatorsTest, StackedSelects) {
+  std::vector<std::tuple<int64_t, std::string>> relation;
+  for (int64_t i = 0; i < 2000; ++i)
+    relation.emplace_back(i, (i % 3) ? "other" : "match");
+
+  TestTupleSource source{relation};
+  Select select_int{source, Select::PredicateAttributeInt64{
+                                0, 1500, Select::PredicateType::LT}};
+  Select select_char{select_int, Select::PredicateAttributeChar16{
+                                     1, "match", Select::PredicateType::EQ}};
+  Select select_int2{select_char, Select::PredicateAttributeInt64{
+                                      0, 30, Select::PredicateType::GE}};
+  std::stringstream output;
+  Print print{select_int2, output};
+
+  print_batches(print);
+
+  std::string expected_output;
+  for (int64_t i = 30; i < 1500; i += 3)
+    expected_output += std::to_string(i) + ",match\n";
+  EXPECT_EQ(expected_output, output.str());
+}
+
+TEST(BatchOperatorsTest, HashJoin) {
+  TestTupleSource source_students{relation_students};
+  TestTupleSource source_grades{relation_grades};
+  HashJoin join{source_students, source_grades, 0, 0};
+  std::stringstream output;
+  Print print{join, output};
+
+  print_batches(print);
+  EXPECT_TRUE(source_students.closed);
+  EXPECT_TRUE(source_grades.closed);
+
+  auto expected_output =
+      ("24002,Xenokrates      ,24002,5001,1\n"
+       "24002,Xenokrates      ,24002,5041,2\n"
+       "29555,Feuerbach       ,29555,4630,2\n"s);
+  EXPECT_EQ(expected_output, sort_output(output.str()));
+}
+
+TEST(BatchOperatorsTest, HashJoinManyMatches) {
+  // 3000 right tuples with 2 matches each fill several output batches, and
+  // the matches of one right tuple may span two of them.
+  std::vector<std::tuple<int64_t, int64_t>> relation_left, relation_right;
+  for (int64_t i = 0; i < 1000; ++i) {
+    relation_left.emplace_back(i, 2 * i);
+    relation_left.emplace_back(i, 2 * i + 1);
+  }
+  for (int64_t i = 0; i < 3000; ++i) relation_right.emplace_back(i % 1500, i);
+
+  auto join_relations = [&](bool batches) {
+    TestTupleSource source_left{relation_left};
+    TestTupleSource source_right{relation_right};
+    HashJoin join{source_left, source_right, 0, 0};
+    std::stringstream output;
+    Print print{join, output};
+    run_print(print, batches);
+    return output.str();
+  };
+
+  std::string output = join_relations(true);
+  EXPECT_EQ(join_relations(false), output);
+  EXPECT_EQ(4000, std::count(output.begin(), output.end(), '\n'));
+}
+
+TEST(BatchOperatorsTest, HashAggregationSumCount) {
+  TestTupleSource source{relation_grades};
+  HashAggregation aggregation{
+      source,
+      {0},
+      {
+          HashAggregation::AggrFunc{HashAggregation::AggrFunc::SUM, 2},
+          HashAggregation::AggrFunc{HashAggregation::AggrFunc::COUNT, 0},
+      }};
+  std::stringstream output;
+  Print print{aggregation, output};
+
+  print_batches(print);
+
+  auto expected_output =
+      ("24002,3,2\n"
+       "29555,2,1\n"s);
+  EXPECT_EQ(expected_output, sort_output(output.str()));
+}
+
 TEST(AdvancedOperatorsTest, Union) {
   TestTupleSource source_left{relation_set_a};
   TestTupleSource source_right{relation_set_b};
@@ -591,6 +1882,310 @@ TEST(BonusOperatorsTest, ExceptAll) {
   EXPECT_EQ(expected_output, sort_output(output.str()));
 }
 
+/// Runs the set operator on the two relations and returns its output,
+/// read with `next()` or `next_batch()`.
+template <typename SetOperator, typename... Ts>
+std::string run_set_operation(const std::vector<std::tuple<Ts...>>& left,
+                              const std::vector<std::tuple<Ts...>>& right,
+                              bool batches,
+                              typename SetOperator::Options options = {}) {
+  TestTupleSource source_left{left};
+  TestTupleSource source_right{right};
+  SetOperator set_operator{source_left, source_right, options};
+  std::stringstream output;
+  Print print{set_operator, output};
+  run_print(print, batches);
+  return output.str();
+}
+
+TEST(BonusOperatorsTest, SetOperationsOnTuples) {
+  // Tuples are compared as a whole, and NULLs equal each other.
+  const std::vector<std::tuple<std::optional<int64_t>, std::string>> left{
+      {1, "a"}, {1, "a"}, {1, "b"}, {2, "a"}, {std::nullopt, "a"},
+      {std::nullopt, "a"}};
+  const std::vector<std::tuple<std::optional<int64_t>, std::string>> right{
+      {1, "a"}, {2, "b"}, {2, "a"}, {2, "a"}, {std::nullopt, "a"}};
+
+  for (bool batches : {false, true}) {
+    // Union and Intersect return tuples as soon as they qualify, the other
+    // operators in the order the tuples first appear.
+    EXPECT_EQ("1,a\n1,b\n2,a\nNULL,a\n2,b\n"s,
+              run_set_operation<Union>(left, right, batches));
+    EXPECT_EQ("1,a\n1,b\n2,a\n2,b\nNULL,a\n"s,
+              run_set_operation<Union>(left, right, batches, {false, true}));
+    // UnionAll returns the left tuples followed by the right ones.
+    EXPECT_EQ(
+        "1,a\n1,a\n1,b\n2,a\nNULL,a\nNULL,a\n1,a\n2,b\n2,a\n2,a\n"
+        "NULL,a\n"s,
+        run_set_operation<UnionAll>(left, right, batches));
+    EXPECT_EQ("1,a\n2,a\nNULL,a\n"s,
+              run_set_operation<Intersect>(left, right, batches));
+    EXPECT_EQ("1,a\n2,a\nNULL,a\n"s,
+              run_set_operation<IntersectAll>(left, right, batches));
+    EXPECT_EQ("1,a\n2,a\nNULL,a\n"s,
+              run_set_operation<IntersectAll>(left, right, batches,
+                                              {false, true}));
+    EXPECT_EQ("1,b\n"s, run_set_operation<Except>(left, right, batches));
+    EXPECT_EQ("1,a\n1,b\nNULL,a\n"s,
+              run_set_operation<ExceptAll>(left, right, batches));
+
+    // Either input may be empty.
+    const decltype(left) empty;
+    EXPECT_EQ("1,a\n2,b\n2,a\nNULL,a\n"s,
+              run_set_operation<Union>(empty, right, batches));
+    EXPECT_EQ(""s, run_set_operation<Intersect>(left, empty, batches));
+    EXPECT_EQ(""s, run_set_operation<ExceptAll>(empty, right, batches));
+    EXPECT_EQ("1,a\n1,a\n1,b\n2,a\nNULL,a\nNULL,a\n"s,
+              run_set_operation<ExceptAll>(left, empty, batches));
+  }
+}
+
+TEST(BonusOperatorsTest, SetOperationsArePipelined) {
+  std::vector<std::tuple<int64_t>> relation;
+  for (int64_t i = 0; i < 5000; ++i) relation.emplace_back(i % 4);
+
+  // Union returns the first left tuple before reading the right input.
+  TestTupleSource source_left{relation_set_a};
+  TestTupleSource source_right{relation};
+  Union union_{source_left, source_right};
+  union_.open();
+  ASSERT_TRUE(union_.next());
+  EXPECT_EQ(1, union_.get_output()[0]->as_int());
+  EXPECT_EQ(0u, source_right.num_read());
+  union_.close();
+
+  // Intersect returns the first match within the first right batch.
+  TestTupleSource source_left2{relation_set_a};
+  TestTupleSource source_right2{relation};
+  Intersect intersect{source_left2, source_right2};
+  intersect.open();
+  ASSERT_TRUE(intersect.next());
+  EXPECT_EQ(1, intersect.get_output()[0]->as_int());
+  EXPECT_EQ(Batch::CAPACITY, source_right2.num_read());
+  size_t count = 1;
+  while (intersect.next()) ++count;
+  EXPECT_EQ(3u, count);
+  intersect.close();
+
+  // Sorted output and Except need both inputs completely.
+  TestTupleSource source_left3{relation_set_a};
+  TestTupleSource source_right3{relation};
+  Union sorted_union{source_left3, source_right3, Union::Options{false, true}};
+  sorted_union.open();
+  ASSERT_TRUE(sorted_union.next());
+  EXPECT_EQ(0, sorted_union.get_output()[0]->as_int());
+  EXPECT_EQ(relation.size(), source_right3.num_read());
+  sorted_union.close();
+}
+
+TEST(BonusOperatorsTest, SetOperationsOnSortedInputs) {
+  const std::vector<std::tuple<std::optional<int64_t>, std::string>> left{
+      {1, "a"}, {1, "a"}, {1, "b"}, {2, "a"}, {std::nullopt, "a"},
+      {std::nullopt, "a"}};
+  const std::vector<std::tuple<std::optional<int64_t>, std::string>> right{
+      {1, "a"}, {2, "a"}, {2, "a"}, {2, "b"}, {std::nullopt, "a"}};
+  const decltype(left) empty;
+
+  for (bool batches : {false, true}) {
+    EXPECT_EQ("1,a\n1,b\n2,a\n2,b\nNULL,a\n"s,
+              run_set_operation<Union>(left, right, batches, {true}));
+    EXPECT_EQ("1,a\n2,a\nNULL,a\n"s,
+              run_set_operation<Intersect>(left, right, batches, {true}));
+    EXPECT_EQ("1,a\n2,a\nNULL,a\n"s,
+              run_set_operation<IntersectAll>(left, right, batches, {true}));
+    EXPECT_EQ("1,b\n"s,
+              run_set_operation<Except>(left, right, batches, {true}));
+    EXPECT_EQ("1,a\n1,b\nNULL,a\n"s,
+              run_set_operation<ExceptAll>(left, right, batches, {true}));
+    EXPECT_EQ(
+        "1,a\n1,a\n1,a\n1,b\n2,a\n2,a\n2,a\n2,b\nNULL,a\nNULL,a\n"
+        "NULL,a\n"s,
+        run_set_operation<UnionAll>(left, right, batches, {1, true}));
+
+    EXPECT_EQ("1,a\n2,a\n2,b\nNULL,a\n"s,
+              run_set_operation<Union>(empty, right, batches, {true}));
+    EXPECT_EQ(""s, run_set_operation<Intersect>(left, empty, batches, {true}));
+    EXPECT_EQ("1,a\n1,a\n1,b\n2,a\nNULL,a\nNULL,a\n"s,
+              run_set_operation<ExceptAll>(left, empty, batches, {true}));
+  }
+
+  // Inputs which are not sorted are detected.
+  const std::vector<std::tuple<std::optional<int64_t>, std::string>>
+      unsorted{{2, "a"}, {1, "a"}};
+  EXPECT_THROW(run_set_operation<ExceptAll>(unsorted, right, false, {true}),
+               std::runtime_error);
+}
+
+TEST(BonusOperatorsTest, SortedSetOperationsMatchHashed) {
+  // Random relations with many duplicates, sorted on both attributes. The
+  // values have a single digit, so their lines sort like the tuples.
+  std::vector<std::tuple<int64_t, int64_t>> left, right;
+  uint64_t state = 42;
+  auto random = [&] {
+    state = state * 6364136223846793005ull + 1442695040888963407ull;
+    return static_cast<int64_t>((state >> 33) % 10);
+  };
+  for (size_t i = 0; i < 3000; ++i) left.emplace_back(random(), random() % 3);
+  for (size_t i = 0; i < 2000; ++i)
+    right.emplace_back(random(), random() % 3 + 1);
+  std::sort(left.begin(), left.end());
+  std::sort(right.begin(), right.end());
+
+  // Hashed inputs are sorted at the end.
+  EXPECT_EQ(run_set_operation<Union>(left, right, true, {false, true}),
+            run_set_operation<Union>(left, right, true, {true}));
+  EXPECT_EQ(run_set_operation<Intersect>(left, right, true, {false, true}),
+            run_set_operation<Intersect>(left, right, true, {true}));
+  EXPECT_EQ(run_set_operation<IntersectAll>(left, right, true, {false, true}),
+            run_set_operation<IntersectAll>(left, right, true, {true}));
+  EXPECT_EQ(run_set_operation<Except>(right, left, true, {false, true}),
+            run_set_operation<Except>(right, left, true, {true}));
+  EXPECT_EQ(run_set_operation<ExceptAll>(left, right, true, {false, true}),
+            run_set_operation<ExceptAll>(left, right, true, {true}));
+  EXPECT_EQ(sort_output(run_set_operation<UnionAll>(left, right, true)),
+            run_set_operation<UnionAll>(left, right, true, {1, true}));
+
+  // Without sorting, the same tuples are returned in another order.
+  EXPECT_EQ(sort_output(run_set_operation<Union>(left, right, false)),
+            run_set_operation<Union>(left, right, true, {true}));
+  EXPECT_EQ(sort_output(run_set_operation<IntersectAll>(left, right, false)),
+            run_set_operation<IntersectAll>(left, right, true, {true}));
+  EXPECT_EQ(sort_output(run_set_operation<ExceptAll>(left, right, false)),
+            run_set_operation<ExceptAll>(left, right, true, {true}));
+}
+
+TEST(BonusOperatorsTest, SetOperationInputsOfDifferentWidths) {
+  TestTupleSource source_left{relation_set_a};
+  TestTupleSource source_right{relation_students};
+  Union union_{source_left, source_right};
+  union_.open();
+  EXPECT_THROW(
+      {
+        while (union_.next()) {
+        }
+      },
+      std::runtime_error);
+  union_.close();
+
+  // UnionAll notices the difference when it reaches the right input.
+  for (size_t num_threads : {1, 2}) {
+    TestTupleSource source_left{relation_set_a};
+    TestTupleSource source_right{relation_students};
+    UnionAll union_all{source_left, source_right,
+                       UnionAll::Options{num_threads}};
+    union_all.open();
+    EXPECT_THROW(
+        {
+          while (union_all.next()) {
+          }
+        },
+        std::runtime_error);
+    union_all.close();
+  }
+}
+
+TEST(BonusOperatorsTest, UnionAllStreams) {
+  const std::vector<std::tuple<int64_t, std::string>> empty;
+  TestTupleSource source1{relation_students};
+  TestTupleSource source2{empty};
+  TestTupleSource source3{relation_students};
+  UnionAll union_all{{&source1, &source2, &source3}};
+  std::stringstream output;
+  Print print{union_all, output};
+
+  print.open();
+  // The first tuple is passed through before the other inputs are read.
+  ASSERT_TRUE(print.next());
+  EXPECT_EQ(&source1.get_output(), &union_all.get_output());
+  while (print.next()) {
+  }
+  print.close();
+  EXPECT_TRUE(source2.closed);
+  EXPECT_TRUE(source3.closed);
+
+  auto expected_output =
+      ("24002,Xenokrates      \n"
+       "26120,Fichte          \n"
+       "29555,Feuerbach       \n"
+       "24002,Xenokrates      \n"
+       "26120,Fichte          \n"
+       "29555,Feuerbach       \n"s);
+  EXPECT_EQ(expected_output, output.str());
+
+  // Batches are read from the inputs in place.
+  TestTupleSource source4{relation_students};
+  TestTupleSource source5{relation_students};
+  UnionAll union_batches{source4, source5};
+  union_batches.open();
+  Batch batch;
+  size_t num_batches = 0, num_tuples = 0;
+  while (union_batches.next_batch(batch)) {
+    ++num_batches;
+    num_tuples += batch.size();
+  }
+  union_batches.close();
+  EXPECT_EQ(2u, num_batches);
+  EXPECT_EQ(6u, num_tuples);
+
+  UnionAll no_inputs{std::vector<Operator*>{}};
+  no_inputs.open();
+  EXPECT_FALSE(no_inputs.next());
+  EXPECT_FALSE(no_inputs.next_batch(batch));
+  no_inputs.close();
+}
+
+TEST(BonusOperatorsTest, UnionAllParallel) {
+  std::vector<std::tuple<int64_t, int64_t>> relation;
+  for (int64_t i = 0; i < 10000; ++i) relation.emplace_back(i, i % 13);
+  const std::vector<std::tuple<int64_t, int64_t>> empty;
+
+  for (size_t num_threads : {2, 3, 8}) {
+    for (bool batches : {false, true}) {
+      TestTupleSource source1{relation};
+      TestTupleSource source2{empty};
+      TestTupleSource source3{relation};
+      UnionAll union_all{{&source1, &source2, &source3},
+                         UnionAll::Options{num_threads}};
+      std::vector<std::pair<int64_t, int64_t>> tuples;
+
+      union_all.open();
+      if (batches) {
+        Batch batch;
+        while (union_all.next_batch(batch)) {
+          ASSERT_EQ(2u, batch.num_columns());
+          for (size_t i = 0; i < batch.size(); ++i)
+            tuples.emplace_back(batch.column(0)[batch.row(i)].as_int(),
+                                batch.column(1)[batch.row(i)].as_int());
+        }
+      } else {
+        while (union_all.next()) {
+          const auto& output = union_all.get_output();
+          ASSERT_EQ(2u, output.size());
+          tuples.emplace_back(output[0]->as_int(), output[1]->as_int());
+        }
+      }
+      union_all.close();
+
+      // Both copies of every tuple are returned in some order.
+      ASSERT_EQ(20000u, tuples.size());
+      std::sort(tuples.begin(), tuples.end());
+      for (size_t i = 0; i < tuples.size(); ++i) {
+        int64_t value = static_cast<int64_t>(i / 2);
+        EXPECT_EQ(std::make_pair(value, value % 13), tuples[i]);
+      }
+    }
+  }
+
+  // Closing the union early stops the threads.
+  TestTupleSource source1{relation};
+  TestTupleSource source2{relation};
+  UnionAll union_all{source1, source2, UnionAll::Options{2}};
+  union_all.open();
+  EXPECT_TRUE(union_all.next());
+  union_all.close();
+  EXPECT_TRUE(source1.closed);
+}
+
 }  // namespace
 
 int main(int argc, char* argv[]) {
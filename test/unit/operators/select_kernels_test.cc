@@ -0,0 +1,149 @@
+#include <gtest/gtest.h>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "operators/operators.h"
+#include "operators/select_kernels.h"
+
+namespace {
+
+using buzzdb::operators::Register;
+using buzzdb::operators::Select;
+using buzzdb::operators::kernels::detect_instruction_set;
+using buzzdb::operators::kernels::InstructionSet;
+using buzzdb::operators::kernels::select_char16;
+using buzzdb::operators::kernels::select_int64;
+
+const std::vector<Select::PredicateType> all_predicate_types{
+    Select::PredicateType::EQ, Select::PredicateType::NE,
+    Select::PredicateType::LT, Select::PredicateType::LE,
+    Select::PredicateType::GT, Select::PredicateType::GE};
+
+/// Returns all instruction sets that can be executed on this machine.
+std::vector<InstructionSet> supported_instruction_sets() {
+  std::vector<InstructionSet> isas{InstructionSet::SCALAR};
+  if (detect_instruction_set() != InstructionSet::SCALAR)
+    isas.push_back(InstructionSet::SSE42);
+  if (detect_instruction_set() == InstructionSet::AVX2)
+    isas.push_back(InstructionSet::AVX2);
+  return isas;
+}
+
+bool qualifies(Select::PredicateType type, const Register& left,
+               const Register& right) {
+  switch (type) {
+    case Select::PredicateType::EQ:
+      return left == right;
+    case Select::PredicateType::NE:
+      return left != right;
+    case Select::PredicateType::LT:
+      return left < right;
+    case Select::PredicateType::LE:
+      return left <= right;
+    case Select::PredicateType::GT:
+      return left > right;
+    case Select::PredicateType::GE:
+      return left >= right;
+  }
+  return false;
+}
+
+/// Every row with an even index, to test kernels on a refined selection.
+std::vector<uint16_t> even_rows(size_t count) {
+  std::vector<uint16_t> rows;
+  for (size_t i = 0; i < count; i += 2) rows.push_back(i);
+  return rows;
+}
+
+TEST(SelectKernelsTest, Int64) {
+  std::mt19937_64 rng{1};
+  std::vector<Register> registers;
+  std::vector<int64_t> values;
+  for (size_t i = 0; i < 1023; ++i) {
+    int64_t value = static_cast<int64_t>(rng() % 16) - 8;
+    registers.push_back(Register::from_int(value));
+    values.push_back(value);
+  }
+  auto rows = even_rows(values.size());
+  std::vector<int64_t> row_values;
+  for (auto row : rows) row_values.push_back(values[row]);
+
+  for (auto isa : supported_instruction_sets()) {
+    for (auto type : all_predicate_types) {
+      for (int64_t constant : {-8, -3, 0, 5, 100}) {
+        auto reg_constant = Register::from_int(constant);
+        std::vector<uint16_t> expected, selection(values.size());
+        for (size_t i = 0; i < values.size(); ++i)
+          if (qualifies(type, registers[i], reg_constant))
+            expected.push_back(i);
+
+        size_t count = select_int64(isa, type, values.data(), values.size(),
+                                    constant, nullptr, selection.data());
+        selection.resize(count);
+        EXPECT_EQ(expected, selection);
+
+        // Refine an existing selection in place.
+        expected.clear();
+        for (auto row : rows)
+          if (qualifies(type, registers[row], reg_constant))
+            expected.push_back(row);
+        selection = rows;
+        count = select_int64(isa, type, row_values.data(), rows.size(),
+                             constant, selection.data(), selection.data());
+        selection.resize(count);
+        EXPECT_EQ(expected, selection);
+      }
+    }
+  }
+}
+
+TEST(SelectKernelsTest, Char16) {
+  const std::vector<std::string> strings{
+      "",  "a", "ab", "abc", "abd", "b", "this is a string", "this is a strinh",
+      "\x80\xff", "zzzzzzzzzzzzzzzz"};
+  std::mt19937_64 rng{2};
+  std::vector<Register> registers;
+  for (size_t i = 0; i < 999; ++i)
+    registers.push_back(Register::from_string(strings[rng() % strings.size()]));
+  auto rows = even_rows(registers.size());
+
+  for (auto isa : supported_instruction_sets()) {
+    for (auto type : all_predicate_types) {
+      for (const auto& constant : strings) {
+        auto reg_constant = Register::from_string(constant);
+        std::vector<uint16_t> expected, selection(registers.size());
+        for (size_t i = 0; i < registers.size(); ++i)
+          if (qualifies(type, registers[i], reg_constant))
+            expected.push_back(i);
+
+        size_t count = select_char16(
+            isa, type, registers[0].payload_data(), sizeof(Register),
+            registers.size(), reg_constant.payload_data(), nullptr,
+            selection.data());
+        selection.resize(count);
+        EXPECT_EQ(expected, selection);
+
+        expected.clear();
+        for (auto row : rows)
+          if (qualifies(type, registers[row], reg_constant))
+            expected.push_back(row);
+        selection = rows;
+        count = select_char16(isa, type, registers[0].payload_data(),
+                              sizeof(Register), rows.size(),
+                              reg_constant.payload_data(), selection.data(),
+                              selection.data());
+        selection.resize(count);
+        EXPECT_EQ(expected, selection);
+      }
+    }
+  }
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,92 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "operators/operators.h"
+#include "operators/sketches.h"
+
+namespace {
+
+using buzzdb::operators::HyperLogLog;
+using buzzdb::operators::QuantileSketch;
+using buzzdb::operators::Register;
+
+TEST(SketchesTest, HyperLogLogEstimates) {
+  for (int64_t count : {0, 1, 100, 10000, 1000000}) {
+    std::vector<Register> state(HyperLogLog::STATE_SIZE);
+    HyperLogLog::init(state.data());
+    // Every value is added twice.
+    for (int64_t i = 0; i < 2 * count; ++i)
+      HyperLogLog::add(state.data(), Register::from_int(i % count).get_hash());
+    double estimate = HyperLogLog::estimate(state.data());
+    EXPECT_NEAR(count, estimate, 0.05 * count) << count;
+  }
+}
+
+TEST(SketchesTest, HyperLogLogMerge) {
+  std::vector<Register> state1(HyperLogLog::STATE_SIZE);
+  std::vector<Register> state2(HyperLogLog::STATE_SIZE);
+  std::vector<Register> state(HyperLogLog::STATE_SIZE);
+  HyperLogLog::init(state1.data());
+  HyperLogLog::init(state2.data());
+  HyperLogLog::init(state.data());
+  for (int64_t i = 0; i < 30000; ++i) {
+    uint64_t hash = Register::from_string("v" + std::to_string(i)).get_hash();
+    HyperLogLog::add(i < 20000 ? state1.data() : state2.data(), hash);
+    if (i >= 10000) HyperLogLog::add(state2.data(), hash);
+    HyperLogLog::add(state.data(), hash);
+  }
+
+  // Merging gives exactly the sketch of all values.
+  HyperLogLog::merge(state1.data(), state2.data());
+  EXPECT_EQ(state, state1);
+  EXPECT_NEAR(30000.0, HyperLogLog::estimate(state1.data()), 1500);
+}
+
+TEST(SketchesTest, QuantileSketchSmallInputsAreExact) {
+  std::vector<Register> state(QuantileSketch::STATE_SIZE);
+  QuantileSketch::init(state.data());
+  EXPECT_TRUE(QuantileSketch::empty(state.data()));
+  QuantileSketch::add(state.data(), 7);
+  EXPECT_FALSE(QuantileSketch::empty(state.data()));
+  EXPECT_EQ(7, QuantileSketch::quantile(state.data(), 0.5));
+
+  for (int64_t value : {5, 1, 3, 9}) QuantileSketch::add(state.data(), value);
+  EXPECT_EQ(1, QuantileSketch::quantile(state.data(), 0));
+  EXPECT_EQ(5, QuantileSketch::quantile(state.data(), 0.5));
+  EXPECT_EQ(9, QuantileSketch::quantile(state.data(), 1));
+}
+
+TEST(SketchesTest, QuantileSketchAccuracy) {
+  // A skewed distribution of 100000 values, added in a scrambled order to
+  // two sketches which are merged.
+  std::vector<int64_t> values;
+  for (int64_t i = 0; i < 100000; ++i) values.push_back(i * i);
+  std::vector<Register> state1(QuantileSketch::STATE_SIZE);
+  std::vector<Register> state2(QuantileSketch::STATE_SIZE);
+  QuantileSketch::init(state1.data());
+  QuantileSketch::init(state2.data());
+  for (size_t i = 0; i < values.size(); ++i) {
+    size_t index = i * 7919 % values.size();
+    QuantileSketch::add(i % 3 ? state1.data() : state2.data(), values[index]);
+  }
+  QuantileSketch::merge(state1.data(), state2.data());
+
+  // The error is measured in ranks. The minimum and maximum are exact.
+  for (double q : {0.0, 0.001, 0.01, 0.1, 0.5, 0.9, 0.99, 0.999, 1.0}) {
+    double estimate = QuantileSketch::quantile(state1.data(), q);
+    double rank = std::lower_bound(values.begin(), values.end(), estimate) -
+                  values.begin();
+    double max_error = q == 0.0 || q == 1.0 ? 0.0 : 0.002;
+    EXPECT_NEAR(q, rank / (values.size() - 1), max_error) << q;
+  }
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}